@@ -23,6 +23,8 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <time.h>
+#include <sys/mman.h>
 
 /** Maximum value size for integers and doubles. */
 #define MAXVALSZ    1024
@@ -33,23 +35,239 @@
 /** Invalid key token */
 #define DICT_INVALID_KEY    ((char*)-1)
 
+/** Size of the first chunk of an arena */
+#define ARENAMINSZ  4096
+
+/** Maximal size of arena chunks, larger blocks get their own chunk */
+#define ARENAMAXSZ  (1024*1024)
+
+/** Arena chunk header, followed by the chunk data */
+typedef struct _dict_chunk_ {
+    struct _dict_chunk_ *  next ;
+} dict_chunk ;
+
+/** String of a pool, followed by its characters */
+typedef struct _dict_str_ {
+    struct _dict_str_ *  next ;     /** Next string of the same bucket */
+    unsigned             hash ;     /** Hash of the string */
+    unsigned             refs ;     /** Number of entries holding it */
+} dict_str ;
+
+/** Initial number of buckets of a pool */
+#define POOLMINSZ   64
+
+/* Characters of a pooled string, and the other way round */
+#define pool_chars(x)   ((char *)((x) + 1))
+#define pool_str(s)     ((dict_str *)(void *)(s) - 1)
+
+/** Longest key hashed lowercased on the stack, see dictionary_find_ci() */
+#define DICT_FOLDSZ (256)
+
+/* Alignment of arena blocks */
+#define arena_round(n)  (((n) + 15) & ~(size_t)15)
+
+/** Hash function of new dictionaries */
+#ifdef DICT_SUPERFASTHASH
+#define DICT_DEFAULT_HASH   dictionary_hash_sfh
+#else
+#define DICT_DEFAULT_HASH   dictionary_hash_wy
+#endif
+
 /*---------------------------------------------------------------------------
                             Private functions
  ---------------------------------------------------------------------------*/
 
-/* Doubles the allocated size associated to a pointer */
-/* 'size' is the current allocated size. */
-static void * mem_double(void * ptr, int size)
+uint32_t SuperFastHash(const char *k, int l);
+static unsigned dict_hash_fold(dictionary * d, const char * key, size_t len,
+                               int * ok);
+
+#ifdef INIPARSER_STATS
+/* Counters of all dictionaries, see dictionary_stats() */
+static dict_stats       dict_counters ;
+#define dict_stat(f, n) ((void)__atomic_fetch_add(&dict_counters.f, \
+                                (unsigned long)(n), __ATOMIC_RELAXED))
+#else
+#define dict_stat(f, n) ((void)0)
+#endif
+
+/* Counts an allocation of n bytes from the C library */
+#define dict_stat_alloc(n)  (dict_stat(allocs, 1), dict_stat(bytes, n))
+
+/* Counts a lookup that examined dist slots */
+#define dict_stat_probes(dist) (dict_stat(lookups, 1), \
+    dict_stat(probes[(dist) < DICT_STATS_PROBES ? (dist) - 1 \
+                                                : DICT_STATS_PROBES - 1], 1))
+
+/* Seed of new dictionaries, drawn once per process, 0 until then */
+static unsigned long    dict_seed ;
+
+static unsigned long dictionary_default_seed(void)
+{
+    FILE          * f ;
+    unsigned long   seed = 0 ;
+
+    if (__atomic_load_n(&dict_seed, __ATOMIC_ACQUIRE) == 0) {
+        if ((f = fopen("/dev/urandom", "rb")) != NULL) {
+            if (fread(&seed, sizeof(seed), 1, f) != 1) {
+                seed = 0 ;
+            }
+            fclose(f);
+        }
+        /* Without entropy source, mix what differs between runs */
+        seed ^= (unsigned long)time(NULL) ^
+                ((unsigned long)getpid() << 16) ^
+                (unsigned long)(size_t)&seed ;
+        /* Threads racing here all use the seed stored first */
+        __sync_val_compare_and_swap(&dict_seed, 0UL, seed ? seed : 1UL);
+    }
+    return __atomic_load_n(&dict_seed, __ATOMIC_ACQUIRE) ;
+}
+
+/* Allocates n zeroed bytes from an arena */
+static void * arena_alloc(dict_arena * a, size_t n)
+{
+    dict_chunk * c ;
+    size_t       hdr, sz ;
+    void       * p ;
+
+    n = arena_round(n) ;
+    if ((size_t)(a->end - a->cur) < n) {
+        hdr = arena_round(sizeof(dict_chunk)) ;
+        sz = (n > a->next / 2) ? hdr + n : a->next ;
+        if ((c = (dict_chunk *)calloc(1, sz)) == NULL) {
+            return NULL ;
+        }
+        dict_stat_alloc(sz);
+        if (sz != a->next && a->chunks != NULL) {
+            /* Dedicated chunk, keep filling the current one */
+            c->next = a->chunks->next ;
+            a->chunks->next = c ;
+            return (char *)c + hdr ;
+        }
+        c->next = a->chunks ;
+        a->chunks = c ;
+        a->cur = (char *)c + hdr ;
+        a->end = (char *)c + sz ;
+        if (a->next < ARENAMAXSZ) {
+            a->next *= 2 ;
+        }
+    }
+    p = a->cur ;
+    a->cur += n ;
+    return p ;
+}
+
+/* Releases an arena and all its chunks */
+static void arena_free(dict_arena * a)
+{
+    dict_chunk * c ;
+
+    while ((c = a->chunks) != NULL) {
+        a->chunks = c->next ;
+        free(c);
+    }
+    free(a);
+}
+
+/* Doubles the number of buckets of a pool, returns 0 if Ok */
+static int pool_grow(dict_pool * p)
+{
+    dict_str   ** b, * x ;
+    unsigned      i, nb = 2 * p->nb ;
+
+    if ((b = (dict_str **)calloc(nb, sizeof(dict_str *))) == NULL) {
+        return -1 ;
+    }
+    dict_stat_alloc(nb * sizeof(dict_str *));
+    for (i = 0 ; i < p->nb ; i++) {
+        while ((x = p->b[i]) != NULL) {
+            p->b[i] = x->next ;
+            x->next = b[x->hash & (nb - 1)] ;
+            b[x->hash & (nb - 1)] = x ;
+        }
+    }
+    free(p->b);
+    p->b = b ;
+    p->nb = nb ;
+    return 0 ;
+}
+
+/* Returns the copy of the len characters of s held by a pool, taking */
+/* a reference to it, or NULL */
+static char * pool_get(dict_pool * p, const char * s, size_t len)
 {
-    void * newptr ;
- 
-    newptr = calloc(2*size, 1);
-    if (newptr==NULL) {
+    dict_str    * x ;
+    unsigned      hash = DICT_DEFAULT_HASH(s, len, p->seed) ;
+
+    for (x = p->b[hash & (p->nb - 1)] ; x != NULL ; x = x->next) {
+        if (x->hash == hash && !memcmp(pool_chars(x), s, len + 1)) {
+            x->refs++ ;
+            return pool_chars(x) ;
+        }
+    }
+    if (p->n >= p->nb && pool_grow(p) != 0) {
         return NULL ;
     }
-    memcpy(newptr, ptr, size);
-    free(ptr);
-    return newptr ;
+    if ((x = (dict_str *)malloc(sizeof(dict_str) + len + 1)) == NULL) {
+        return NULL ;
+    }
+    dict_stat_alloc(sizeof(dict_str) + len + 1);
+    memcpy(pool_chars(x), s, len + 1);
+    x->hash = hash ;
+    x->refs = 1 ;
+    x->next = p->b[hash & (p->nb - 1)] ;
+    p->b[hash & (p->nb - 1)] = x ;
+    p->n++ ;
+    return pool_chars(x) ;
+}
+
+/* Drops a reference to a string of a pool, freeing it with the last */
+static void pool_put(dict_pool * p, char * s)
+{
+    dict_str    * x = pool_str(s), ** q ;
+
+    if (--x->refs > 0) {
+        return ;
+    }
+    for (q = &p->b[x->hash & (p->nb - 1)] ; *q != x ; q = &(*q)->next)
+        ;
+    *q = x->next ;
+    p->n-- ;
+    free(x);
+}
+
+/* Releases a pool and all its strings */
+static void pool_free(dict_pool * p)
+{
+    dict_str    * x ;
+    unsigned      i ;
+
+    for (i = 0 ; i < p->nb ; i++) {
+        while ((x = p->b[i]) != NULL) {
+            p->b[i] = x->next ;
+            free(x);
+        }
+    }
+    free(p->b);
+    free(p);
+}
+
+/* Allocates zeroed memory for a dictionary, from its arena if any */
+static void * dict_calloc(dictionary * d, size_t n, size_t size)
+{
+    if (d->arena) {
+        return arena_alloc(d->arena, n * size) ;
+    }
+    dict_stat_alloc(n * size);
+    return calloc(n, size) ;
+}
+
+/* Frees memory allocated by dict_calloc(), a no-op within arenas */
+static void dict_free(dictionary * d, void * ptr)
+{
+    if (d->arena == NULL) {
+        free(ptr);
+    }
 }
 
 /*-------------------------------------------------------------------------*/
@@ -67,6 +285,7 @@ static char * xstrdup(char * s)
     char * t ;
     if (!s)
         return NULL ;
+    dict_stat_alloc(strlen(s)+1);
     t = malloc(strlen(s)+1) ;
     if (t) {
         strcpy(t,s);
@@ -75,46 +294,231 @@ static char * xstrdup(char * s)
 }
 
 #define hash_size(s) ((s) + ((s) >> 1))
-#define hash_freed ((void *)1)
 
-__inline__ static unsigned hash_first(dictionary *d, unsigned h)
+/* Metadata of a used slot: probe length plus one, saturated */
+#define META_MAX    255
+
+/* Key length of removed slots in a table being migrated: never matches */
+#define SLOT_DEAD   ((unsigned)-1)
+
+/* Number of slots migrated by each set or unset, see dictionary_resize() */
+#define DICT_MIGRATE  8
+
+/* Table of slots: the current one, or the one being migrated */
+typedef struct {
+    hash_t        * h ;
+    unsigned char * meta ;
+    unsigned        cap ;
+} slots_t ;
+
+__inline__ static slots_t cur_slots(dictionary * d)
+{
+    slots_t     t ;
+
+    t.h = d->h ;
+    t.meta = d->meta ;
+    t.cap = hash_size(d->size) ;
+    return t ;
+}
+
+__inline__ static slots_t old_slots(dictionary * d)
+{
+    slots_t     t ;
+
+    t.h = d->oh ;
+    t.meta = d->ometa ;
+    t.cap = d->ocap ;
+    return t ;
+}
+
+__inline__ static unsigned hash_first(slots_t * t, unsigned h)
+{
+       return h % t->cap;
+}
+
+__inline__ static unsigned hash_next(slots_t * t, unsigned i)
 {
-       return h % hash_size(d->size);
+       return ((i + 1) == t->cap) ? 0 : i + 1;
 }
 
-__inline__ static unsigned hash_next(dictionary *d, unsigned i)
+/* Probe length plus one of the used slot i */
+__inline__ static unsigned hash_dist(slots_t * t, unsigned i)
 {
-       return ((i + 1) == hash_size(d->size)) ? 0 : i + 1;
+    unsigned    f ;
+
+    if (t->meta[i] < META_MAX) {
+        return t->meta[i] ;
+    }
+    /* Saturated: compute it from the home slot */
+    f = hash_first(t, t->h[i].h) ;
+    return (i >= f ? i - f : i + t->cap - f) + 1 ;
 }
 
-__inline__ static hash_t * hash_get(dictionary * d, char * key, unsigned hash)
+/* Lowercases the ASCII letters of 8 bytes at once */
+__inline__ static uint64_t fold8(uint64_t v)
 {
-    unsigned    i ;
+    const uint64_t  ones = ~(uint64_t)0 / 255 ;
+    uint64_t        low = v & (ones * 0x7f) ;
+    uint64_t        ge_a = low + ones * (0x80 - 'A') ;
+    uint64_t        gt_z = low + ones * (0x7f - 'Z') ;
+
+    return v | (((ge_a ^ gt_z) & ~v & (ones * 0x80)) >> 2) ;
+}
 
-    for(i = hash_first(d, hash); d->h[i].e; i = hash_next(d, i)) {
-        if((d->h[i].e != hash_freed) && (d->h[i].h == hash) &&
-           (strcmp(d->h[i].e->key, key) == 0)) {
-            return &(d->h[i]);
+__inline__ static unsigned fold1(unsigned c)
+{
+    return (c - 'A' < 26u) ? c | 0x20 : c ;
+}
+
+/* Returns 0 if the n bytes of a equal those of b lowercased */
+static int fold_cmp(const char * a, const char * b, unsigned n)
+{
+    uint64_t    x, y ;
+
+    for ( ; n >= 8 ; a += 8, b += 8, n -= 8) {
+        memcpy(&x, a, 8) ;
+        memcpy(&y, b, 8) ;
+        if (x != fold8(y)) {
+            return 1 ;
+        }
+    }
+    for ( ; n > 0 ; a++, b++, n--) {
+        if ((unsigned char)*a != fold1((unsigned char)*b)) {
+            return 1 ;
         }
     }
+    return 0 ;
+}
 
-    return NULL ;
+/* First DICT_PREFIX bytes of a key, in the byte order of memory */
+__inline__ static unsigned hash_prefix(const char * key, unsigned len)
+{
+    unsigned    pre = 0 ;
+
+    memcpy(&pre, key, len < DICT_PREFIX ? len : DICT_PREFIX) ;
+    return pre ;
 }
 
-__inline__ static void hash_set(dictionary * d, unsigned hash, entry_t * e)
+/* Returns the slot of t holding key, or -1. Slots below skip are */
+/* ignored. If fold is set, key matches the key stored in lowercase. */
+__inline__ static int hash_find(dictionary * d, slots_t * t, unsigned skip,
+                                const char * key, unsigned len,
+                                unsigned hash, int fold)
 {
-    unsigned    i ;
+    unsigned    i, dist, m, pre ;
+    hash_t    * h ;
 
-    for(i = hash_first(d, hash); d->h[i].e && (d->h[i].e != hash_freed) ; ) {
-        i = hash_next(d, i);
+    pre = hash_prefix(key, len) ;
+    if (fold) {
+        pre = (unsigned)fold8(pre) ;
     }
-    d->h[i].e = e;
-    d->h[i].h = hash;
+    i = hash_first(t, hash) ;
+    for (dist = 1 ; (m = t->meta[i]) != 0 ; dist++) {
+        /* Keys further than their home slot than key would be here */
+        if (m < dist && (m < META_MAX || hash_dist(t, i) < dist)) {
+            break ;
+        }
+        h = &t->h[i] ;
+        if (h->h == hash && h->len == len && h->pre == pre && i >= skip &&
+            (len <= DICT_PREFIX ||
+             !(fold ? fold_cmp(d->e[h->i].key + DICT_PREFIX,
+                               key + DICT_PREFIX, len - DICT_PREFIX)
+                    : memcmp(d->e[h->i].key + DICT_PREFIX,
+                             key + DICT_PREFIX, len - DICT_PREFIX)))) {
+            dict_stat_probes(dist);
+            return (int)i ;
+        }
+        i = hash_next(t, i) ;
+    }
+    dict_stat_probes(dist);
+    return -1 ;
 }
 
-__inline__ static void free_val(dictionary *d, void *v)
+__inline__ static int hash_get(dictionary * d, slots_t * t, unsigned skip,
+                               const char * key, unsigned len, unsigned hash)
 {
-    if(v && d ) {
+    return hash_find(d, t, skip, key, len, hash, 0) ;
+}
+
+/* Stores slot s in t, the key must not be in it */
+__inline__ static void hash_set(slots_t * t, hash_t s)
+{
+    unsigned    i, dist, m ;
+    hash_t      x ;
+
+    i = hash_first(t, s.h) ;
+    for (dist = 1 ; t->meta[i] ; dist++) {
+        if ((m = hash_dist(t, i)) < dist) {
+            /* Take the place of the closer key, and move it on */
+            x = t->h[i] ;
+            t->h[i] = s ;
+            s = x ;
+            t->meta[i] = (unsigned char)(dist < META_MAX ? dist : META_MAX) ;
+            dist = m ;
+        }
+        i = hash_next(t, i) ;
+    }
+    t->h[i] = s ;
+    t->meta[i] = (unsigned char)(dist < META_MAX ? dist : META_MAX) ;
+}
+
+/* Frees slot i of t, shifting back the keys following it */
+__inline__ static void hash_remove(slots_t * t, unsigned i)
+{
+    unsigned    j, m ;
+
+    for (j = hash_next(t, i) ; (m = t->meta[j]) > 1 ; j = hash_next(t, j)) {
+        if (m == META_MAX) {
+            m = hash_dist(t, j) ;
+        }
+        t->h[i] = t->h[j] ;
+        t->meta[i] = (unsigned char)(m - 1 < META_MAX ? m - 1 : META_MAX) ;
+        i = j ;
+    }
+    t->meta[i] = 0 ;
+}
+
+/* Fills a slot for entry i, of key length len */
+__inline__ static hash_t hash_slot(unsigned hash, unsigned i,
+                                   const char * key, unsigned len)
+{
+    hash_t      s ;
+
+    s.h = hash ;
+    s.i = i ;
+    s.len = len ;
+    s.pre = hash_prefix(key, len) ;
+    return s ;
+}
+
+/* Returns the entry holding key, or NULL. See hash_find() for fold. */
+__inline__ static entry_t * dict_lookup(dictionary * d, const char * key,
+                                        unsigned len, unsigned hash,
+                                        int fold)
+{
+    slots_t     t ;
+    int         slot ;
+
+    t = cur_slots(d) ;
+    if ((slot = hash_find(d, &t, 0, key, len, hash, fold)) >= 0) {
+        return &d->e[t.h[slot].i] ;
+    }
+    if (d->oh != NULL) {
+        t = old_slots(d) ;
+        if ((slot = hash_find(d, &t, d->mig, key, len, hash, fold)) >= 0) {
+            return &d->e[t.h[slot].i] ;
+        }
+    }
+    return NULL ;
+}
+
+#define dict_find(d, key, len, hash)    dict_lookup(d, key, len, hash, 0)
+
+__inline__ static void free_val(dictionary *d, void *v, unsigned flags)
+{
+    if(v && d && (flags & DICT_VALPOOL)) {
+        pool_put(d->pool, v);
+    } else if(v && d && !(flags & DICT_VALREF)) {
         if(d->dict) {
             dictionary_del(v);
         } else {
@@ -123,9 +527,322 @@ __inline__ static void free_val(dictionary *d, void *v)
     }
 }
 
+/* Duplicates a string for a dictionary, into its arena if any */
+static char * dict_strdup(dictionary * d, char * s)
+{
+    char * t ;
+
+    if (d->arena == NULL) {
+        return xstrdup(s) ;
+    }
+    if ((t = (char *)arena_alloc(d->arena, strlen(s)+1)) != NULL) {
+        strcpy(t, s);
+    }
+    return t ;
+}
+
 __inline__ static void * dup_val(dictionary *d, void *v)
 {
-    return (v && d) ? (d->dict ? v : xstrdup(v)) : NULL;
+    return (v && d) ? (d->dict ? v : dict_strdup(d, v)) : NULL;
+}
+
+/* Returns non-zero if s lies in the entries of d: inline strings move */
+/* with them */
+#define dict_inline(d, s)   ((char *)(s) >= (char *)(d)->e && \
+                             (char *)(s) < (char *)((d)->e + (d)->size))
+
+/* Points the inline key of an entry copied from elsewhere to its own */
+/* storage */
+__inline__ static void entry_fix(entry_t * e)
+{
+    if (e->flags & DICT_KEYINL) {
+        e->key = e->sso ;
+    }
+}
+
+/* Stores the key of length len in a new entry: inline if it is short */
+/* enough and is to be copied, else from the pool if any, else as */
+/* flags tell */
+static void entry_key(dictionary * d, entry_t * e, char * key, unsigned len,
+                      unsigned flags)
+{
+    if (!(flags & DICT_KEYREF) && len < DICT_INLINE) {
+        e->key = (char *)memcpy(e->sso, key, len + 1) ;
+        e->flags = DICT_KEYINL ;
+    } else if (!(flags & DICT_KEYREF) && d->pool != NULL) {
+        e->key = pool_get(d->pool, key, len) ;
+        e->flags = DICT_KEYPOOL ;
+    } else {
+        e->key = (flags & DICT_KEYREF) ? key : dict_strdup(d, key);
+        /* Arena copies are not owned by the entry either */
+        e->flags = (flags & DICT_KEYREF) | (d->arena ? DICT_KEYREF : 0) ;
+    }
+}
+
+/* Stores val in an entry whose former value was released: a string to */
+/* copy goes into the pool if any, else val is stored as flags tell. */
+/* Values are never inline: pointers to them outlive moves of entries. */
+static void entry_val(dictionary * d, entry_t * e, void * val,
+                      unsigned flags)
+{
+    e->flags &= DICT_KEYREF | DICT_KEYINL | DICT_KEYPOOL ;
+    if (val != NULL && !d->dict && !(flags & DICT_VALREF) &&
+        d->pool != NULL) {
+        e->val = pool_get(d->pool, (char *)val, strlen((char *)val)) ;
+        e->flags |= DICT_VALPOOL ;
+        return ;
+    }
+    e->val = (flags & DICT_VALREF) ? val : dup_val(d, val);
+    if ((flags & DICT_VALREF) || (d->arena && !d->dict)) {
+        e->flags |= DICT_VALREF ;
+    }
+}
+
+/* Allocates a dictionary and its tables, from an arena if a is set */
+static dictionary * dictionary_alloc(dict_arena * a, int size)
+{
+    dictionary  *   d ;
+
+    /* If no size was specified, allocate space for DICTMINSZ */
+    if (size<DICTMINSZ) size=DICTMINSZ ;
+
+    d = (dictionary *)(a ? arena_alloc(a, sizeof(dictionary))
+                         : calloc(1, sizeof(dictionary)));
+    if (d == NULL) {
+        return NULL;
+    }
+    if (a == NULL) {
+        dict_stat_alloc(sizeof(dictionary));
+    }
+    d->arena = a ;
+    d->hash = DICT_DEFAULT_HASH ;
+    d->seed = dictionary_default_seed() ;
+    d->size = size ;
+    d->e = (entry_t *)dict_calloc(d, size, sizeof(entry_t));
+    d->h = (hash_t *)dict_calloc(d, hash_size(size), sizeof(hash_t));
+    d->meta = (unsigned char *)dict_calloc(d, hash_size(size), 1);
+    if (d->e == NULL || d->h == NULL || d->meta == NULL) {
+        if (a == NULL) {
+            dictionary_del(d);
+        }
+        return NULL ;
+    }
+    return d ;
+}
+
+/* Moves up to n slots of the table being migrated to the current one */
+static void dictionary_migrate(dictionary * d, unsigned n)
+{
+    slots_t     t ;
+
+    if (d->oh == NULL) {
+        return ;
+    }
+    t = cur_slots(d) ;
+    for ( ; n > 0 && d->mig < d->ocap ; n--, d->mig++) {
+        /* Slots keep their hash: keys are not hashed again */
+        if (d->ometa[d->mig] && d->oh[d->mig].len != SLOT_DEAD) {
+            hash_set(&t, d->oh[d->mig]);
+            dict_stat(rehashed, 1);
+        }
+    }
+    if (d->mig == d->ocap) {
+        dict_free(d, d->oh);
+        dict_free(d, d->ometa);
+        d->oh = NULL ;
+        d->ometa = NULL ;
+        d->ocap = d->mig = 0 ;
+    }
+}
+
+/* Moves the live entries in front of the removed ones, keeping their */
+/* order, so that entries 0 to n-1 are all used. Slots are renumbered */
+/* in place, which finishes any migration first. */
+static void dictionary_pack(dictionary * d)
+{
+    slots_t     t ;
+    unsigned    i, j, k ;
+
+    if (d->end == d->n) {
+        return ;
+    }
+    dict_stat(packs, 1);
+    dict_stat(reclaimed, d->end - d->n);
+    dictionary_migrate(d, d->ocap);
+    /* Each slot holds the hash of its entry: the entry hash field can */
+    /* carry the new index of the entry meanwhile */
+    for (j = k = 0 ; j < (unsigned)d->end ; j++) {
+        if (d->e[j].key != NULL) {
+            d->e[j].hash = k++ ;
+        }
+    }
+    t = cur_slots(d) ;
+    for (i = 0 ; i < t.cap ; i++) {
+        if (t.meta[i]) {
+            j = t.h[i].i ;
+            t.h[i].i = d->e[j].hash ;
+            d->e[j].hash = t.h[i].h ;
+        }
+    }
+    for (j = k = 0 ; j < (unsigned)d->end ; j++) {
+        if (d->e[j].key != NULL) {
+            d->e[k] = d->e[j] ;
+            entry_fix(&d->e[k++]);
+        }
+    }
+    memset(d->e + k, 0, (d->end - k) * sizeof(entry_t)) ;
+    d->end = (int)k ;
+}
+
+/* Drops the entry at position i, about to be removed, from the index */
+/* of the entries in use, which is built when the first entry but the  */
+/* last one is removed. Returns 0 if Ok, -1 if it cannot be built.     */
+static int dictionary_unindex(dictionary * d, int i)
+{
+    int     lo, hi, m ;
+
+    if (d->end == d->n) {
+        if (i == d->end - 1) {
+            /* Entries stay packed */
+            return 0 ;
+        }
+        if (d->ord == NULL &&
+            (d->ord = (int *)dict_calloc(d, d->size, sizeof(int))) == NULL) {
+            return -1 ;
+        }
+        for (m = 0 ; m < d->end ; m++) {
+            d->ord[m] = m ;
+        }
+    }
+    /* Positions are in increasing order */
+    for (lo = 0, hi = d->n - 1 ; lo < hi ; ) {
+        m = lo + (hi - lo) / 2 ;
+        if (d->ord[m] < i) {
+            lo = m + 1 ;
+        } else {
+            hi = m ;
+        }
+    }
+    memmove(d->ord + lo, d->ord + lo + 1, (d->n - lo - 1) * sizeof(int));
+    return 0 ;
+}
+
+/* Sets the storage size of a dictionary to size entries, which must be */
+/* more than the current size. Returns 0 if Ok. */
+/* Entries are packed, then copied at once in a single memcpy(). The    */
+/* table then becomes the table being migrated: unless the dictionary   */
+/* is in incremental mode or migrate is 0, all its slots are moved      */
+/* right away. Otherwise each set or unset moves DICT_MIGRATE slots of  */
+/* it, which is enough for the migration to end before the next growth */
+/* when the size doubles, and lookups search both tables meanwhile.     */
+static int dictionary_resize(dictionary * d, int size, int migrate)
+{
+    entry_t       * e ;
+    hash_t        * h ;
+    unsigned char * meta ;
+    int             i ;
+
+    /* Finish the previous migration, if still running */
+    dictionary_migrate(d, d->ocap);
+    dictionary_pack(d);
+
+    h = (hash_t *)dict_calloc(d, hash_size(size), sizeof(hash_t)) ;
+    meta = (unsigned char *)dict_calloc(d, hash_size(size), 1) ;
+    e = (entry_t *)dict_calloc(d, size, sizeof(entry_t)) ;
+    if (h == NULL || meta == NULL || e == NULL) {
+        dict_free(d, h);
+        dict_free(d, meta);
+        dict_free(d, e);
+        return -1 ;
+    }
+    memcpy(e, d->e, d->end * sizeof(entry_t)) ;
+    for (i = 0 ; i < d->end ; i++) {
+        entry_fix(&e[i]);
+    }
+    dict_free(d, d->e);
+    d->e = e ;
+    /* Entries are packed: the index is only needed again after unsets */
+    dict_free(d, d->ord);
+    d->ord = NULL ;
+    d->oh = d->h ;
+    d->ometa = d->meta ;
+    d->ocap = hash_size(d->size) ;
+    d->mig = 0 ;
+    d->h = h ;
+    d->meta = meta ;
+    d->size = size ;
+    dict_stat(grows, 1);
+
+    if (!migrate || !d->incremental) {
+        dictionary_migrate(d, d->ocap);
+    }
+    return 0 ;
+}
+
+/* Stores the key/value pair, duplicating whatever flags do not mark */
+/* as a reference. */
+static int dictionary_put(dictionary * d, char * key, void * val,
+                          unsigned flags)
+{
+    unsigned    hash, len, i ;
+    slots_t     t ;
+    entry_t   * e ;
+    char        kbuf[DICT_INLINE], vbuf[DICT_INLINE] ;
+
+    if (d==NULL || key==NULL) return -1 ;
+    if (d->dict) flags &= ~DICT_VALREF ;
+
+    /* Compute hash for this key */
+    len = (unsigned)strlen(key) ;
+    hash = d->hash(key, len, d->seed);
+    dictionary_migrate(d, DICT_MIGRATE);
+    /* Find if value is already in dictionary */
+    if((e = dict_find(d, key, len, hash)) != NULL) {
+        if (e->val == val) {
+            /* Same value: only cached conversions are dropped */
+            e->flags &= ~DICT_CACHE ;
+            return 0 ;
+        }
+        free_val(d, e->val, e->flags);
+        entry_val(d, e, val, flags);
+        return 0;
+    }
+
+    /* Add a new value */
+    /* Entries are appended: when the storage is full, pack it if enough */
+    /* entries were removed, or see if dictionary needs to grow */
+    if (d->end == d->size) {
+        /* Strings stored in the entries of d move with them */
+        if (dict_inline(d, key)) {
+            key = strcpy(kbuf, key) ;
+            flags &= ~DICT_KEYREF ;
+        }
+        if (!d->dict && dict_inline(d, val)) {
+            val = strcpy(vbuf, (char *)val) ;
+            flags &= ~DICT_VALREF ;
+        }
+        if (d->end - d->n >= d->size / 4) {
+            dictionary_pack(d);
+        } else if (dictionary_resize(d, 2 * d->size, 1) != 0) {
+            /* Cannot grow dictionary */
+            return -1 ;
+        }
+    }
+    i = (unsigned)d->end++ ;
+    e = &d->e[i] ;
+    if (d->end - 1 > d->n) {
+        d->ord[d->n] = (int)i ;
+    }
+
+    /* Copy key */
+    entry_key(d, e, key, len, flags);
+    entry_val(d, e, val, flags);
+    e->hash = hash ;
+    t = cur_slots(d) ;
+    hash_set(&t, hash_slot(hash, i, e->key, len));
+
+    d->n ++ ;
+    return 0 ;
 }
 
 /*---------------------------------------------------------------------------
@@ -137,16 +854,105 @@ __inline__ static void * dup_val(dictionary *d, void *v)
   @param    key     Character string to use for key.
   @return   1 unsigned int on at least 32 bits.
 
-  This hash function has been taken from an Article in Dr Dobbs Journal.
-  This is normally a collision-free function, distributing keys evenly.
-  The key is stored anyway in the struct so that collision can be avoided
-  by comparing the key itself in last resort.
+  This function returns the hash of key as computed by dictionaries
+  created with the default hash function and seed. The default seed is
+  drawn at random once per process, so that hash values cannot be
+  predicted from outside.
  */
 /*--------------------------------------------------------------------------*/
-uint32_t SuperFastHash(const char *k, int l);
 unsigned dictionary_hash(char * key)
 {
-    return SuperFastHash(key, strlen(key));
+    return DICT_DEFAULT_HASH(key, strlen(key), dictionary_default_seed());
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Compute the hash key a dictionary uses for a string.
+  @param    d       Dictionary the hash is meant for, or NULL.
+  @param    key     Key to hash, not necessarily NUL-terminated.
+  @param    len     Number of bytes in key.
+  @return   1 unsigned int on at least 32 bits.
+
+  This function hashes key with the function and seed of d, or with the
+  defaults if d is NULL. The result can be passed to dictionary_get_h()
+  to look key up in d, or in any dictionary sharing its hashing.
+ */
+/*--------------------------------------------------------------------------*/
+unsigned dictionary_hashn(dictionary * d, const char * key, size_t len)
+{
+    if (d == NULL) {
+        return DICT_DEFAULT_HASH(key, len, dictionary_default_seed());
+    }
+    return d->hash(key, len, d->seed);
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Legacy hash function.
+  @param    key     Bytes to hash.
+  @param    len     Number of bytes in key.
+  @param    seed    Ignored.
+  @return   1 unsigned int on at least 32 bits.
+
+  This is SuperFastHash by Paul Hsieh, the hash function of previous
+  versions, taken from an article in Dr Dobbs Journal. It ignores the
+  seed: its values never change, but colliding keys are easily built.
+  Build with -DDICT_SUPERFASTHASH to make it the default.
+ */
+/*--------------------------------------------------------------------------*/
+unsigned dictionary_hash_sfh(const char * key, size_t len, unsigned long seed)
+{
+    (void)seed ;
+    return SuperFastHash(key, (int)len);
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Change the hashing of a dictionary.
+  @param    d       Dictionary to modify.
+  @param    hash    Hash function, NULL for the default one.
+  @param    seed    Seed passed to the hash function.
+  @return   int 0 if Ok, -1 otherwise.
+
+  This function sets the hash function and seed of a dictionary,
+  hashing again the keys it already contains. Dictionaries created by
+  dictionary_new_child() inherit the hashing of their parent.
+ */
+/*--------------------------------------------------------------------------*/
+int dictionary_hashing(dictionary * d, dict_hash_fn hash, unsigned long seed)
+{
+    hash_t        * h ;
+    unsigned char * meta ;
+    unsigned        i, len ;
+    slots_t         t ;
+
+    if (d == NULL) return -1 ;
+
+    /* The table is rebuilt from the entries, drop any migration */
+    dictionary_migrate(d, d->ocap);
+    h = (hash_t *)dict_calloc(d, hash_size(d->size), sizeof(hash_t)) ;
+    meta = (unsigned char *)dict_calloc(d, hash_size(d->size), 1) ;
+    if (h == NULL || meta == NULL) {
+        dict_free(d, h);
+        dict_free(d, meta);
+        return -1 ;
+    }
+    dict_free(d, d->h);
+    dict_free(d, d->meta);
+    d->h = h ;
+    d->meta = meta ;
+    d->hash = hash ? hash : DICT_DEFAULT_HASH ;
+    d->seed = seed ;
+    t = cur_slots(d) ;
+    for (i = 0 ; i < (unsigned)d->size ; i++) {
+        if (d->e[i].key != NULL) {
+            len = (unsigned)strlen(d->e[i].key) ;
+            d->e[i].hash = d->hash(d->e[i].key, len, d->seed) ;
+            hash_set(&t, hash_slot(d->e[i].hash, i, d->e[i].key, len));
+            dict_stat(rehashed, 1);
+        }
+    }
+    return 0 ;
 }
 
 /*-------------------------------------------------------------------------*/
@@ -161,18 +967,69 @@ unsigned dictionary_hash(char * key)
  */
 /*--------------------------------------------------------------------------*/
 dictionary * dictionary_new(int size)
+{
+    return dictionary_alloc(NULL, size) ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Create a new dictionary object allocating from an arena.
+  @param    size    Optional initial size of the dictionary.
+  @return   1 newly allocated dictionary objet.
+
+  This function works like dictionary_new(), but the dictionary and
+  everything it stores are allocated from a new arena: a few large
+  chunks instead of one block per key and value. Memory is only
+  given back when the dictionary is deleted, which then costs one
+  free() per chunk: removed or replaced entries are not reclaimed.
+
+  Dictionaries stored as values (see dictionary_policy()) must be
+  created by dictionary_new_child() so that they share the arena.
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * dictionary_new_arena(int size)
 {
     dictionary  *   d ;
+    dict_arena  *   a ;
 
-    /* If no size was specified, allocate space for DICTMINSZ */
-    if (size<DICTMINSZ) size=DICTMINSZ ;
+    if ((a = (dict_arena *)calloc(1, sizeof(dict_arena))) == NULL) {
+        return NULL ;
+    }
+    dict_stat_alloc(sizeof(dict_arena));
+    a->next = ARENAMINSZ ;
+    if ((d = dictionary_alloc(a, size)) == NULL) {
+        arena_free(a);
+        return NULL ;
+    }
+    a->owner = d ;
+    return d ;
+}
 
-    if (!(d = (dictionary *)calloc(1, sizeof(dictionary)))) {
-        return NULL;
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Create a new dictionary object to be stored in another one.
+  @param    parent  Dictionary the new one will be a value of.
+  @param    size    Optional initial size of the dictionary.
+  @return   1 newly allocated dictionary objet.
+
+  This function creates a dictionary with the same allocation policy
+  as parent: if parent allocates from an arena, so does the new
+  dictionary, which is then released together with the arena and
+  deleting it on its own does nothing. The new dictionary also uses
+  the hash function, seed and resize policy of parent.
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * dictionary_new_child(dictionary * parent, int size)
+{
+    dictionary  *   d ;
+
+    d = dictionary_alloc(parent ? parent->arena : NULL, size) ;
+    if (d != NULL && parent != NULL) {
+        d->hash = parent->hash ;
+        d->seed = parent->seed ;
+        d->incremental = parent->incremental ;
+        d->pool = parent->pool ;
     }
-    d->size = size ;
-    d->e = (entry_t *)calloc(size, sizeof(entry_t));
-    d->h = (hash_t *)calloc(hash_size(size), sizeof(hash_t));
     return d ;
 }
 
@@ -189,11 +1046,100 @@ dictionary * dictionary_new(int size)
   to dictionary objects.
  */
 /*--------------------------------------------------------------------------*/
-void dictionary_policy(dictionary * d, int dict)
+void dictionary_policy(dictionary * d, int dict)
+{
+    if(d) {
+        d->dict = dict ? 1 : 0;
+    }
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Defines resize policy.
+  @param    d     dictionary object to modify.
+  @param    incremental  policy
+  @return   void
+
+  When a dictionary is full, its storage doubles. Its hash table is then
+  rebuilt at once by default. If incremental is set to a non-zero value,
+  the old and new tables are kept side by side instead, and each later
+  dictionary_set() or dictionary_unset() moves a few slots from one to
+  the other, bounding the time any single call takes. Dictionaries
+  created by dictionary_new_child() inherit the policy of their parent.
+ */
+/*--------------------------------------------------------------------------*/
+void dictionary_incremental(dictionary * d, int incremental)
+{
+    if(d) {
+        d->incremental = incremental ? 1 : 0;
+        if (!d->incremental) {
+            dictionary_migrate(d, d->ocap);
+        }
+    }
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Share identical strings between entries.
+  @param    d     dictionary object to modify.
+  @return   int 0 if Ok, -1 otherwise.
+
+  This function attaches a pool of strings to d. From then on, the keys
+  and string values copied by d and by the dictionaries later created
+  from it by dictionary_new_child() are looked up in the pool, and
+  identical strings share a single copy, freed with the last entry
+  holding it. Keys stored inline (see DICT_INLINE) and references
+  stored by dictionary_setref() are never pooled.
+
+  The pool is released with d: its children must be deleted first, and
+  they must not be modified concurrently. Nothing is done if d already
+  has a pool.
+ */
+/*--------------------------------------------------------------------------*/
+int dictionary_intern(dictionary * d)
+{
+    dict_pool   * p ;
+
+    if (d == NULL) return -1 ;
+    if (d->pool != NULL) return 0 ;
+    if ((p = (dict_pool *)calloc(1, sizeof(dict_pool))) == NULL) {
+        return -1 ;
+    }
+    if ((p->b = (dict_str **)calloc(POOLMINSZ, sizeof(dict_str *))) == NULL) {
+        free(p);
+        return -1 ;
+    }
+    dict_stat_alloc(sizeof(dict_pool));
+    dict_stat_alloc(POOLMINSZ * sizeof(dict_str *));
+    p->nb = POOLMINSZ ;
+    p->seed = d->seed ;
+    p->owner = d ;
+    d->pool = p ;
+    return 0 ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Make room for a number of entries.
+  @param    d     dictionary object to modify.
+  @param    n     Number of entries the dictionary should hold.
+  @return   int 0 if Ok, -1 otherwise.
+
+  This function grows the storage of a dictionary, if needed, so that
+  it can hold n entries without growing again. Reserving the expected
+  number of entries before filling a dictionary avoids the successive
+  doublings of its storage and hash table.
+ */
+/*--------------------------------------------------------------------------*/
+int dictionary_reserve(dictionary * d, int n)
 {
-    if(d) {
-        d->dict = dict ? 1 : 0;
+    if (d == NULL) return -1 ;
+    if (n - d->n <= d->size - d->end) return 0 ;
+    if (n <= d->size) {
+        dictionary_pack(d);
+        return 0 ;
     }
+    return dictionary_resize(d, n, 0) ;
 }
 
 /*-------------------------------------------------------------------------*/
@@ -208,16 +1154,45 @@ void dictionary_policy(dictionary * d, int dict)
 void dictionary_del(dictionary * d)
 {
     unsigned     i ;
+    dict_arena * a ;
 
     if (d==NULL) return ;
+    dict_stat(reclaimed, d->end - d->n);
+    if ((a = d->arena) != NULL) {
+        /* Everything is in the arena, released with its owner */
+        if (a->owner == d) {
+            if (d->aux_free != NULL)
+                d->aux_free(d->aux);
+            if (d->pool != NULL && d->pool->owner == d)
+                pool_free(d->pool);
+            if (d->map != NULL)
+                munmap(d->map, d->mapsz);
+            arena_free(a);
+        }
+        return ;
+    }
     for (i=0 ; i<d->size ; i++) {
         if (d->e[i].key != NULL) {
-            free(d->e[i].key);
-            free_val(d, d->e[i].val);
+            if (d->e[i].flags & DICT_KEYPOOL)
+                pool_put(d->pool, d->e[i].key);
+            else if (!(d->e[i].flags & (DICT_KEYREF | DICT_KEYINL)))
+                free(d->e[i].key);
+            free_val(d, d->e[i].val, d->e[i].flags);
         }
     }
+    /* Children release their strings first */
+    if (d->pool != NULL && d->pool->owner == d)
+        pool_free(d->pool);
+    if (d->aux_free != NULL)
+        d->aux_free(d->aux);
+    if (d->map != NULL)
+        munmap(d->map, d->mapsz);
     free(d->e);
     free(d->h);
+    free(d->meta);
+    free(d->oh);
+    free(d->ometa);
+    free(d->ord);
     free(d);
     return ;
 }
@@ -233,20 +1208,138 @@ void dictionary_del(dictionary * d)
   This function locates a key in a dictionary and returns a pointer to its
   value, or the passed 'def' pointer if no such key can be found in
   dictionary. The returned character pointer points to data internal to the
-  dictionary object, you should not try to free it or modify it.
+  dictionary object, you should not try to free it or modify it. It
+  stays valid until the key is set again or removed, or the dictionary
+  is deleted.
  */
 /*--------------------------------------------------------------------------*/
 void * dictionary_get(dictionary * d, char * key, void * def)
 {
-    unsigned    hash ;
-    hash_t    * match ;
+    unsigned    len ;
+    entry_t   * e ;
+
+    if (d==NULL || key==NULL) return def ;
+
+    len = (unsigned)strlen(key) ;
+    e = dict_find(d, key, len, d->hash(key, len, d->seed));
+    return (e && e->val) ? e->val : def ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get a value from a dictionary, given the hash of its key.
+  @param    d       dictionary object to search.
+  @param    key     Key to look for in the dictionary.
+  @param    len     Length of key.
+  @param    hash    Hash of key, as computed by dictionary_hashn().
+  @param    def     Default value to return if key not found.
+  @return   1 pointer to internally allocated character string.
+
+  This function is equivalent to dictionary_get(), for callers looking
+  up the same key repeatedly: the hash is computed once by the caller
+  instead of at each call.
+ */
+/*--------------------------------------------------------------------------*/
+void * dictionary_get_h(dictionary * d, char * key, size_t len,
+                        unsigned hash, void * def)
+{
+    entry_t   * e ;
 
     if (d==NULL || key==NULL) return def ;
 
-    hash = dictionary_hash(key);
-    match = hash_get(d, key, hash);
+    e = dict_find(d, key, (unsigned)len, hash);
+    return (e && e->val) ? e->val : def ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find the entry of a key, given the hash of the key.
+  @param    d       dictionary object to search.
+  @param    key     Key to look for in the dictionary.
+  @param    len     Length of key.
+  @param    hash    Hash of key, as computed by dictionary_hashn().
+  @return   Pointer to the entry of key, or NULL if not found.
+
+  This function is equivalent to dictionary_get_h(), but returns the
+  entry holding the key, for callers keeping values converted from it,
+  see DICT_CACHE. The entry is valid until the dictionary is modified.
+  Only its DICT_CACHE flags and cached values may be modified.
+ */
+/*--------------------------------------------------------------------------*/
+entry_t * dictionary_find_h(dictionary * d, char * key, size_t len,
+                           unsigned hash)
+{
+    if (d==NULL || key==NULL) return NULL ;
+
+    return dict_find(d, key, (unsigned)len, hash);
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find the entries of several keys at once.
+  @param    d       dictionary object to search.
+  @param    keys    Keys to look for.
+  @param    lens    Length of each key.
+  @param    hashes  Hash of each key, as computed by dictionary_hashn().
+  @param    found   Set to the entry of each key, or NULL if not found.
+  @param    n       Number of keys.
+  @return   Number of keys found.
+
+  This function is equivalent to n calls to dictionary_find_h(), with
+  the hash slots of all the keys fetched from memory first: the cache
+  misses of the lookups overlap instead of adding up.
+ */
+/*--------------------------------------------------------------------------*/
+int dictionary_find_n(dictionary * d, char ** keys, const size_t * lens,
+                      const unsigned * hashes, entry_t ** found, int n)
+{
+    slots_t     t ;
+    unsigned    s ;
+    int         i, m = 0 ;
+
+    if (d==NULL || keys==NULL || lens==NULL || hashes==NULL || found==NULL)
+        return 0 ;
+
+    t = cur_slots(d) ;
+    for (i = 0 ; i < n ; i++) {
+        s = hash_first(&t, hashes[i]) ;
+        __builtin_prefetch(&t.meta[s]);
+        __builtin_prefetch(&t.h[s]);
+    }
+    for (i = 0 ; i < n ; i++) {
+        found[i] = keys[i] ? dict_find(d, keys[i], (unsigned)lens[i],
+                                       hashes[i])
+                           : NULL ;
+        m += found[i] != NULL ;
+    }
+    return m ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find the entry of a key, ignoring case.
+  @param    d       dictionary object to search.
+  @param    key     Key to look for, not necessarily NUL-terminated.
+  @param    len     Length of key.
+  @return   Pointer to the entry of key, or NULL if not found.
+
+  This function finds the entry of the key equal to key with its ASCII
+  letters lowercased, as iniparser stores keys. The key is neither
+  copied nor modified: it is lowercased as it is hashed and compared.
+  Dictionaries hashing with another function than dictionary_hash_wy()
+  hash a lowercased copy instead, on the stack for keys up to
+  DICT_FOLDSZ bytes.
+ */
+/*--------------------------------------------------------------------------*/
+entry_t * dictionary_find_ci(dictionary * d, const char * key, size_t len)
+{
+    unsigned    hash ;
+    int         ok ;
+
+    if (d==NULL || key==NULL) return NULL ;
 
-    return (match && match->e && match->e->val) ? match->e->val : def ;
+    hash = dict_hash_fold(d, key, len, &ok) ;
+    return ok ? dict_lookup(d, key, (unsigned)len, hash, 1) : NULL ;
 }
 
 /*-------------------------------------------------------------------------*/
@@ -277,59 +1370,28 @@ void * dictionary_get(dictionary * d, char * key, void * def)
 /*--------------------------------------------------------------------------*/
 int dictionary_set(dictionary * d, char * key, void * val)
 {
-    unsigned    hash, i ;
-    hash_t    * h ;
-
-    if (d==NULL || key==NULL) return -1 ;
-    
-    /* Compute hash for this key */
-    hash = dictionary_hash(key);
-    /* Find if value is already in dictionary */
-    if((h = hash_get(d, key, hash)) != NULL) {
-        free_val(d, h->e->val);
-        h->e->val = dup_val(d, val);
-        return 0;
-    }
-
-    /* Add a new value */
-    /* See if dictionary needs to grow */
-    if (d->n==d->size) {
-
-        /* Reached maximum size: reallocate dictionary */
-        d->e = (entry_t *)mem_double(d->e, d->size * sizeof(entry_t)) ;
-        free(d->h);
-        d->h = (hash_t *)calloc(hash_size(d->size * 2), sizeof(hash_t)) ;
-
-        if ((d->e == NULL) || (d->h == NULL)) {
-            /* Cannot grow dictionary */
-            return -1 ;
-        }
-
-        /* Double size */
-        d->size *= 2 ;
-
-        /* Recompute all hashes */
-        for(i = 0 ; i < d->size / 2 ; i++) {
-            if(d->e[i].key) {
-                hash_set(d, dictionary_hash(d->e[i].key), &(d->e[i]));
-            }
-        }
-    }
-
-    /* Insert key in the first empty slot. Start at d->n and wrap at
-       d->size. Because d->n < d->size this will necessarily
-       terminate. */
-    for (i=d->n ; d->e[i].key ; ) {
-        if(++i == d->size) i = 0;
-    }
+    return dictionary_put(d, key, val, 0);
+}
 
-    /* Copy key */
-    d->e[i].key = xstrdup(key);
-    d->e[i].val = dup_val(d, val);
-    hash_set(d, hash, &(d->e[i]));
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Set a value in a dictionary without copying it.
+  @param    d       dictionary object to modify.
+  @param    key     Key to modify or add.
+  @param    val     Value to add.
+  @return   int     0 if Ok, anything else otherwise
 
-    d->n ++ ;
-    return 0 ;
+  This function behaves like dictionary_set(), except that neither the
+  key nor a string value are duplicated: the dictionary stores the
+  provided pointers and never frees them. The caller must guarantee
+  that both strings outlive the dictionary, e.g. because they live in
+  the memory mapping attached to it. Dictionary values (see
+  dictionary_policy()) are still owned by the dictionary.
+ */
+/*--------------------------------------------------------------------------*/
+int dictionary_setref(dictionary * d, char * key, void * val)
+{
+    return dictionary_put(d, key, val, DICT_KEYREF | DICT_VALREF);
 }
 
 /*-------------------------------------------------------------------------*/
@@ -345,31 +1407,113 @@ int dictionary_set(dictionary * d, char * key, void * val)
 /*--------------------------------------------------------------------------*/
 void dictionary_unset(dictionary * d, char * key)
 {
-    unsigned    hash ;
-    hash_t    * h ;
+    unsigned    len, hash ;
+    int         slot, unindexed ;
+    slots_t     t ;
+    entry_t   * e ;
 
     if (d==NULL || key==NULL) return ;
 
-    hash = dictionary_hash(key);
-    if((h = hash_get(d, key, hash)) == NULL) {
-        /* Key not found */
-        return ;
-    }
- 
-    if(h->e) {
-        free(h->e->key);
-        h->e->key = NULL;
-        free_val(d, h->e->val);
-        h->e->val = NULL;
+    dictionary_migrate(d, DICT_MIGRATE);
+    len = (unsigned)strlen(key) ;
+    hash = d->hash(key, len, d->seed) ;
+    t = cur_slots(d) ;
+    if ((slot = hash_get(d, &t, 0, key, len, hash)) >= 0) {
+        /* No tombstone: following keys move back into the slot */
+        e = &d->e[t.h[slot].i] ;
+        hash_remove(&t, (unsigned)slot);
+    } else {
+        if (d->oh == NULL) {
+            /* Key not found */
+            return ;
+        }
+        t = old_slots(d) ;
+        if ((slot = hash_get(d, &t, d->mig, key, len, hash)) < 0) {
+            /* Key not found */
+            return ;
+        }
+        /* Not migrated yet: only mark the slot as removed */
+        e = &d->e[t.h[slot].i] ;
+        t.h[slot].len = SLOT_DEAD ;
     }
 
-    /* Lazy deletion */
-    h->e = hash_freed;
-    h->h = 0;
+    if (e->flags & DICT_KEYPOOL)
+        pool_put(d->pool, e->key);
+    else if (!(e->flags & (DICT_KEYREF | DICT_KEYINL)))
+        free(e->key);
+    e->key = NULL;
+    free_val(d, e->val, e->flags);
+    e->val = NULL;
+    e->flags = 0;
+    dict_stat(removed, 1);
+    unindexed = dictionary_unindex(d, (int)(e - d->e)) ;
+    /* Removed entries are reclaimed when packing, but the last one */
+    if (e == &d->e[d->end - 1]) {
+        d->end -- ;
+        dict_stat(reclaimed, 1);
+    }
     d->n -- ;
+    if (unindexed != 0) {
+        /* Without an index, positions must match the entries */
+        dictionary_pack(d);
+    }
     return ;
 }
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get an entry of a dictionary by position.
+  @param    d       dictionary object to examine.
+  @param    n       Position of the entry, from 0 to d->n-1.
+  @return   Pointer to the entry, or NULL if n is out of range.
+
+  Entries are kept in the order they were added in: this function
+  returns the n-th key added that was not removed since, in constant
+  time. dictionary_unset() keeps an index of the entries in use so
+  that this function does not modify d. Do not modify the returned
+  entry.
+ */
+/*--------------------------------------------------------------------------*/
+entry_t * dictionary_entry(dictionary * d, int n)
+{
+    if (d==NULL || n<0 || n>=d->n) return NULL ;
+    return &d->e[d->end > d->n ? d->ord[n] : n] ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Iterate over the entries of a dictionary.
+  @param    d       dictionary object to examine.
+  @param    it      Iterator, to set to 0 before the first call.
+  @return   Pointer to the next entry, or NULL at the end.
+
+  This function returns the entries of a dictionary in the order they
+  were added in, skipping removed ones, without modifying it:
+
+  @code
+  int       it = 0 ;
+  entry_t * e ;
+
+  while ((e = dictionary_next(d, &it)) != NULL) {
+      printf("%s\n", e->key);
+  }
+  @endcode
+
+  Adding or removing keys while iterating may skip or repeat entries.
+  Do not modify the returned entry.
+ */
+/*--------------------------------------------------------------------------*/
+entry_t * dictionary_next(dictionary * d, int * it)
+{
+    if (d==NULL || it==NULL || *it<0) return NULL ;
+    while (*it < d->end) {
+        if (d->e[(*it)++].key != NULL) {
+            return &d->e[*it - 1] ;
+        }
+    }
+    return NULL ;
+}
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Dump a dictionary to an opened file pointer.
@@ -395,7 +1539,7 @@ void dictionary_dump(dictionary * d, FILE * out)
         fprintf(out, "invalid dictionary\n");
         return ;
     }
-    for (i=0 ; i<d->size ; i++) {
+    for (i=0 ; i<d->end ; i++) {
         if (d->e[i].key) {
             fprintf(out, "%20s\t[%s]\n",
                     d->e[i].key,
@@ -405,6 +1549,329 @@ void dictionary_dump(dictionary * d, FILE * out)
     return ;
 }
 
+/* Writer of dictionary images: measures them while buf is NULL */
+typedef struct {
+    char        *   buf ;   /** Image being written, or NULL */
+    size_t          tab ;   /** Offset of the next table */
+    size_t          str ;   /** Offset of the next string */
+} dict_writer ;
+
+/* Header of dictionary images, which dictionaries never point to */
+typedef struct {
+    unsigned        magic ; /** DICT_IMAGE_MAGIC, in native byte order */
+    unsigned        abi ;   /** Sizes of the structures of the image */
+    unsigned        hash ;  /** Hash of a fixed key by the default hash */
+    unsigned        pad ;
+} dict_image ;
+
+#define DICT_IMAGE_MAGIC    0x44696d67
+#define DICT_IMAGE_ABI      ((unsigned)(sizeof(dictionary) << 16 | \
+                                        sizeof(entry_t) << 8 | \
+                                        sizeof(hash_t)))
+#define DICT_IMAGE_KEY      "dictionary"
+
+/* Maximal nesting of dictionaries in an image */
+#define DICT_IMAGE_DEPTH    8
+
+/* Offsets stand for pointers in images, 0 for NULL */
+#define image_ptr(o)    ((void *)(size_t)(o))
+#define image_off(p)    ((size_t)(p))
+
+/* Reserves a table of n bytes in an image, returns its offset */
+static size_t image_table(dict_writer * w, size_t n)
+{
+    size_t      o = arena_round(w->tab) ;
+
+    w->tab = o + n ;
+    return o ;
+}
+
+/* Copies a string to an image, returns its offset or 0 for NULL */
+static size_t image_string(dict_writer * w, const char * s)
+{
+    size_t      o = w->str, n ;
+
+    if (s == NULL) {
+        return 0 ;
+    }
+    n = strlen(s) + 1 ;
+    if (w->buf != NULL) {
+        memcpy(w->buf + o, s, n);
+    }
+    w->str += n ;
+    return o ;
+}
+
+/* Writes d and the dictionaries it holds to an image, returns the */
+/* offset of d, or 0 if they cannot be serialized */
+static size_t image_dict(dict_writer * w, dictionary * d, int depth)
+{
+    dictionary  *   t ;
+    entry_t     *   e ;
+    size_t          o, eo, ho, mo, v ;
+    unsigned        cap ;
+    int             i ;
+
+    if (d->hash != DICT_DEFAULT_HASH || depth > DICT_IMAGE_DEPTH) {
+        return 0 ;
+    }
+    /* Only entries 0 to n-1 and the current table are written */
+    dictionary_migrate(d, d->ocap);
+    dictionary_pack(d);
+    cap = hash_size(d->size) ;
+    o = image_table(w, sizeof(dictionary)) ;
+    eo = image_table(w, d->size * sizeof(entry_t)) ;
+    ho = image_table(w, cap * sizeof(hash_t)) ;
+    mo = image_table(w, cap) ;
+    if (w->buf != NULL) {
+        t = (dictionary *)(w->buf + o) ;
+        memset(t, 0, sizeof(dictionary));
+        t->e = (entry_t *)image_ptr(eo) ;
+        t->h = (hash_t *)image_ptr(ho) ;
+        t->meta = (unsigned char *)image_ptr(mo) ;
+        t->incremental = d->incremental ;
+        t->n = d->n ;
+        t->end = d->end ;
+        t->size = d->size ;
+        t->dict = d->dict ;
+        t->seed = d->seed ;
+        memset(w->buf + eo, 0, d->size * sizeof(entry_t));
+        memcpy(w->buf + ho, d->h, cap * sizeof(hash_t));
+        memcpy(w->buf + mo, d->meta, cap);
+    }
+    for (i = 0 ; i < d->end ; i++) {
+        v = 0 ;
+        if (d->dict && d->e[i].val != NULL) {
+            if ((v = image_dict(w, (dictionary *)d->e[i].val, depth + 1))
+                == 0) {
+                return 0 ;
+            }
+        } else if (!d->dict) {
+            v = image_string(w, (char *)d->e[i].val) ;
+        }
+        if (w->buf != NULL) {
+            e = (entry_t *)(w->buf + eo) + i ;
+            e->key = (char *)image_ptr(image_string(w, d->e[i].key)) ;
+            e->val = image_ptr(v) ;
+            /* Strings of the image are never inline nor freed */
+            e->flags = DICT_KEYREF | DICT_VALREF ;
+            e->hash = d->e[i].hash ;
+        } else {
+            image_string(w, d->e[i].key);
+        }
+    }
+    return o ;
+}
+
+/* Turns the offsets of the dictionary at offset o of an image into */
+/* pointers, returns the dictionary or NULL if the image is invalid */
+static dictionary * image_map(char * p, size_t size, size_t o,
+                              dict_arena * a, int depth)
+{
+    dictionary  *   d ;
+    entry_t     *   e ;
+    unsigned        cap ;
+    size_t          eo, ho, mo ;
+    int             i ;
+
+    if (o < sizeof(dict_image) || o % 16 || o > size - sizeof(dictionary) ||
+        depth > DICT_IMAGE_DEPTH) {
+        return NULL ;
+    }
+    d = (dictionary *)(p + o) ;
+    if (d->size < 1 || (size_t)d->size > size / sizeof(entry_t)) {
+        return NULL ;
+    }
+    cap = hash_size((unsigned)d->size) ;
+    eo = image_off(d->e) ;
+    ho = image_off(d->h) ;
+    mo = image_off(d->meta) ;
+    if (d->n < 0 || d->n > d->end || d->end > d->size ||
+        eo > size || (size - eo) / sizeof(entry_t) < (size_t)d->size ||
+        ho > size || (size - ho) / sizeof(hash_t) < cap ||
+        mo > size || size - mo < cap) {
+        return NULL ;
+    }
+    d->e = (entry_t *)(p + eo) ;
+    d->h = (hash_t *)(p + ho) ;
+    d->meta = (unsigned char *)(p + mo) ;
+    d->arena = a ;
+    d->hash = DICT_DEFAULT_HASH ;
+    d->aux = NULL ;
+    d->aux_free = NULL ;
+    for (i = 0 ; i < d->end ; i++) {
+        e = &d->e[i] ;
+        if (image_off(e->key) == 0 || image_off(e->key) >= size) {
+            return NULL ;
+        }
+        e->key = p + image_off(e->key) ;
+        if (image_off(e->val) == 0) {
+            e->val = NULL ;
+        } else if (d->dict) {
+            if ((e->val = image_map(p, size, image_off(e->val), a,
+                                    depth + 1)) == NULL) {
+                return NULL ;
+            }
+        } else if (image_off(e->val) < size) {
+            e->val = p + image_off(e->val) ;
+        } else {
+            return NULL ;
+        }
+    }
+    return d ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Serialize a dictionary into a position-independent image.
+  @param    d       dictionary object to serialize, packed first.
+  @param    size    Set to the size of the image.
+  @return   Image to free with free(), or NULL on failure.
+
+  The image holds the dictionary structure, its entries, hash tables
+  and strings, and those of the dictionaries it holds if its values are
+  dictionaries, with offsets from the start of the image instead of
+  pointers. It can be saved to a file and mapped anywhere by another
+  process of the same build, see dictionary_map_image(). Hash values
+  are stored with the tables, keys are not hashed again.
+
+  Dictionaries with their own hash function cannot be serialized.
+ */
+/*--------------------------------------------------------------------------*/
+void * dictionary_image(dictionary * d, size_t * size)
+{
+    dict_writer     w ;
+    dict_image    * h ;
+    size_t          tab ;
+
+    if (d==NULL || size==NULL) return NULL ;
+
+    /* First pass to measure the tables and strings */
+    w.buf = NULL ;
+    w.tab = sizeof(dict_image) ;
+    w.str = 0 ;
+    if (image_dict(&w, d, 0) == 0) {
+        return NULL ;
+    }
+    tab = arena_round(w.tab) ;
+    *size = tab + w.str ;
+    if ((w.buf = (char *)calloc(1, *size)) == NULL) {
+        return NULL ;
+    }
+    dict_stat_alloc(*size);
+    w.tab = sizeof(dict_image) ;
+    w.str = tab ;
+    image_dict(&w, d, 0);
+
+    h = (dict_image *)w.buf ;
+    h->magic = DICT_IMAGE_MAGIC ;
+    h->abi = DICT_IMAGE_ABI ;
+    h->hash = DICT_DEFAULT_HASH(DICT_IMAGE_KEY, sizeof(DICT_IMAGE_KEY) - 1,
+                                0) ;
+    return w.buf ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Use a dictionary image in place.
+  @param    p       Image made by dictionary_image(), writable and
+                    aligned on 16 bytes, e.g. a private file mapping.
+  @param    size    Size of the image.
+  @return   Dictionary of the image, or NULL if the image is invalid.
+
+  The offsets of the image are replaced by pointers, everything else is
+  used where it is: lookups run against the image, without allocating
+  or hashing stored keys. The dictionaries of the image share an arena
+  that later changes allocate from. Deleting the returned dictionary
+  releases the arena and the memory mapping set in its map field, if
+  any; p must outlive it otherwise. An image can only be used once.
+
+  Images are trusted: their structure is checked, but not that their
+  hash tables match their entries.
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * dictionary_map_image(void * p, size_t size)
+{
+    dict_image  *   h = (dict_image *)p ;
+    dict_arena  *   a ;
+    dictionary  *   d ;
+
+    if (p == NULL || size < sizeof(dict_image) + sizeof(dictionary) ||
+        (size_t)p % 16 || ((char *)p)[size - 1] != 0 ||
+        h->magic != DICT_IMAGE_MAGIC || h->abi != DICT_IMAGE_ABI ||
+        h->hash != DICT_DEFAULT_HASH(DICT_IMAGE_KEY,
+                                     sizeof(DICT_IMAGE_KEY) - 1, 0)) {
+        return NULL ;
+    }
+    if ((a = (dict_arena *)calloc(1, sizeof(dict_arena))) == NULL) {
+        return NULL ;
+    }
+    dict_stat_alloc(sizeof(dict_arena));
+    a->next = ARENAMINSZ ;
+    if ((d = image_map((char *)p, size, arena_round(sizeof(dict_image)), a,
+                       0)) == NULL) {
+        free(a);
+        return NULL ;
+    }
+    a->owner = d ;
+    return d ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the counters of all dictionaries.
+  @param    s       Set to the counters.
+  @return   int 0 if Ok, -1 if s is NULL or the library was compiled
+            without INIPARSER_STATS.
+
+  The counters cover every dictionary of the process since it started,
+  or since dictionary_stats_reset(). They are only kept when the library
+  is compiled with INIPARSER_STATS defined, otherwise s is zeroed.
+  Counters are updated without locking: read while other threads use
+  dictionaries, each one is exact but they may not be from the same
+  instant.
+ */
+/*--------------------------------------------------------------------------*/
+int dictionary_stats(dict_stats * s)
+{
+    if (s == NULL) return -1 ;
+#ifdef INIPARSER_STATS
+    {
+        unsigned long * src = (unsigned long *)&dict_counters ;
+        unsigned long * dst = (unsigned long *)s ;
+        size_t          i ;
+
+        for (i = 0 ; i < sizeof(dict_stats) / sizeof(unsigned long) ; i++) {
+            dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED) ;
+        }
+    }
+    return 0 ;
+#else
+    memset(s, 0, sizeof(dict_stats));
+    return -1 ;
+#endif
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Reset the counters of all dictionaries.
+  @return   void
+
+  Sets to zero the counters dictionary_stats() returns.
+ */
+/*--------------------------------------------------------------------------*/
+void dictionary_stats_reset(void)
+{
+#ifdef INIPARSER_STATS
+    unsigned long * c = (unsigned long *)&dict_counters ;
+    size_t          i ;
+
+    for (i = 0 ; i < sizeof(dict_stats) / sizeof(unsigned long) ; i++) {
+        __atomic_store_n(&c[i], 0UL, __ATOMIC_RELAXED);
+    }
+#endif
+}
+
 
 /* Test code */
 #ifdef TESTDIC
@@ -509,4 +1976,162 @@ uint32_t SuperFastHash (const char * data, int len) {
     return hash;
 }
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Tell whether a dictionary uses the default hashing.
+  @param    d       Dictionary to examine.
+  @return   int 1 if d hashes with the default function and seed, else 0.
+
+  Hashes computed by dictionary_hashn() with a NULL dictionary can be
+  used to look keys up in d exactly when this function returns 1.
+ */
+/*--------------------------------------------------------------------------*/
+int dictionary_hash_default(dictionary * d)
+{
+    return d != NULL && d->hash == DICT_DEFAULT_HASH &&
+           d->seed == dictionary_default_seed() ;
+}
+
+/*
+ * Variant of wyhash by Wang Yi : https://github.com/wangyi-fudan/wyhash
+ * Public domain (The Unlicense)
+ */
+
+#define U64(hi, lo)     (((uint64_t)(hi) << 32) | (uint64_t)(lo))
+
+/* 64x64 bits multiplication, folding the 128 bits product on 64 bits */
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 wy_u128 ;
+
+__inline__ static uint64_t wy_mix(uint64_t a, uint64_t b)
+{
+    wy_u128     r = (wy_u128)a * b ;
+
+    return (uint64_t)r ^ (uint64_t)(r >> 64) ;
+}
+#else
+__inline__ static uint64_t wy_mix(uint64_t a, uint64_t b)
+{
+    uint64_t    ha = a >> 32, la = (uint32_t)a, hb = b >> 32, lb = (uint32_t)b ;
+    uint64_t    rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb ;
+    uint64_t    t = rl + (rm0 << 32), lo, hi ;
+
+    hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) ;
+    lo = t + (rm1 << 32) ;
+    hi += (lo < t) ;
+    return lo ^ hi ;
+}
+#endif
+
+__inline__ static uint64_t wy_r8(const uint8_t * p)
+{
+    uint64_t    v ;
+
+    memcpy(&v, p, 8) ;
+    return v ;
+}
+
+__inline__ static uint64_t wy_r4(const uint8_t * p)
+{
+    uint32_t    v ;
+
+    memcpy(&v, p, 4) ;
+    return v ;
+}
+
+/* Reads of wyhash, lowercasing the bytes read if fold is set */
+#define wy_f8(p, fold)  ((fold) ? fold8(wy_r8(p)) : wy_r8(p))
+#define wy_f4(p, fold)  ((fold) ? fold8(wy_r4(p)) : wy_r4(p))
+#define wy_f1(p, fold)  ((uint64_t)((fold) ? fold1(*(p)) : *(p)))
+
+__inline__ static unsigned wy_hash(const char * key, size_t len,
+                                   unsigned long seed, int fold)
+{
+    const uint8_t     * p = (const uint8_t *)key ;
+    const uint64_t      s0 = U64(0xa0761d64, 0x78bd642f) ;
+    const uint64_t      s1 = U64(0xe7037ed1, 0xa0b428db) ;
+    const uint64_t      s2 = U64(0x8ebc6af0, 0x9c88c6e3) ;
+    const uint64_t      s3 = U64(0x589965cc, 0x75374cc3) ;
+    uint64_t            a, b, h, h1, h2 ;
+    size_t              i ;
+
+    h = (uint64_t)seed ^ s0 ;
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (wy_f4(p, fold) << 32) | wy_f4(p + ((len >> 3) << 2), fold) ;
+            b = (wy_f4(p + len - 4, fold) << 32) |
+                wy_f4(p + len - 4 - ((len >> 3) << 2), fold) ;
+        } else if (len > 0) {
+            a = (wy_f1(p, fold) << 16) |
+                (wy_f1(p + (len >> 1), fold) << 8) | wy_f1(p + len - 1, fold) ;
+            b = 0 ;
+        } else {
+            a = b = 0 ;
+        }
+    } else {
+        i = len ;
+        if (i > 48) {
+            h1 = h2 = h ;
+            do {
+                h = wy_mix(wy_f8(p, fold) ^ s1, wy_f8(p + 8, fold) ^ h) ;
+                h1 = wy_mix(wy_f8(p + 16, fold) ^ s2,
+                            wy_f8(p + 24, fold) ^ h1) ;
+                h2 = wy_mix(wy_f8(p + 32, fold) ^ s3,
+                            wy_f8(p + 40, fold) ^ h2) ;
+                p += 48 ;
+                i -= 48 ;
+            } while (i > 48) ;
+            h ^= h1 ^ h2 ;
+        }
+        while (i > 16) {
+            h = wy_mix(wy_f8(p, fold) ^ s1, wy_f8(p + 8, fold) ^ h) ;
+            p += 16 ;
+            i -= 16 ;
+        }
+        a = wy_f8(p + i - 16, fold) ;
+        b = wy_f8(p + i - 8, fold) ;
+    }
+    h = wy_mix(wy_mix(a ^ s1, b ^ h) ^ s0 ^ (uint64_t)len, s1) ;
+    return (unsigned)(h ^ (h >> 32)) ;
+}
+
+unsigned dictionary_hash_wy(const char * key, size_t len, unsigned long seed)
+{
+    return wy_hash(key, len, seed, 0) ;
+}
+
+/* Hash of key lowercased, as d hashes it. Returns 0 and sets *ok to 0 */
+/* if key could not be folded for lack of memory. */
+static unsigned dict_hash_fold(dictionary * d, const char * key, size_t len,
+                               int * ok)
+{
+    char        buf[DICT_FOLDSZ], * l ;
+    unsigned    h ;
+    size_t      i ;
+
+    *ok = 1 ;
+    if (d->hash == dictionary_hash_wy) {
+        return wy_hash(key, len, d->seed, 1) ;
+    }
+    if (len == 0) {
+        return d->hash(key, 0, d->seed) ;
+    }
+    /* Other hash functions get a lowercased copy */
+    if ((l = len <= sizeof(buf) ? buf : (char *)malloc(len)) == NULL) {
+        *ok = 0 ;
+        return 0 ;
+    }
+    if (l != buf) {
+        dict_stat_alloc(len);
+    }
+    for (i = 0 ; i < len ; i++) {
+        l[i] = (char)fold1((unsigned char)key[i]) ;
+    }
+    h = d->hash(l, len, d->seed) ;
+    if (l != buf) {
+        free(l);
+    }
+    return h ;
+}
+
 /* vim: set ts=4 et sw=4 tw=75 */
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <stdint.h>
 
 /*---------------------------------------------------------------------------
                                 New types
@@ -35,27 +36,104 @@
 /**
   @brief    Dictionary entry
 
-  This object contains a string/pointer pair.
+  This object contains a string/pointer pair. Entries with a NULL key
+  are unused. Short keys are stored in the entry itself, and key then
+  points into sso: it moves with the entry when the dictionary grows or
+  is packed. Values are never stored in entries, so that pointers to
+  them stay valid while other keys are added or removed.
  */
 /*-------------------------------------------------------------------------*/
 
+/** Size of the inline storage of entries */
+#define DICT_INLINE     16
+
 typedef struct {
     char        *  key;  /** String containing the key */
     void        *  val;  /** Pointer to the value */
+    unsigned       flags;/** Storage flags, see DICT_KEYREF and DICT_VALREF */
+    unsigned       hash; /** Hash of the key */
+    uint64_t       num;  /** Cached integer value, see DICT_CACHE */
+    double         dbl;  /** Cached floating-point value, see DICT_CACHE */
+    char           sso[DICT_INLINE]; /** Short key, see DICT_KEYINL */
 } entry_t;
 
+/** Entry flag: the key is not owned (nor freed) by the dictionary */
+#define DICT_KEYREF     0x01
+/** Entry flag: the value is not owned (nor freed) by the dictionary */
+#define DICT_VALREF     0x02
+/** Entry flag: the key is stored in the entry */
+#define DICT_KEYINL     0x04
+/** Entry flag: the key is shared through the pool of the dictionary */
+#define DICT_KEYPOOL    0x10
+/** Entry flag: the value is shared through the pool of the dictionary */
+#define DICT_VALPOOL    0x20
+/**
+ * Entry flags left to the users of the dictionary, to tell which
+ * values converted from the string value are cached in num and dbl.
+ * The dictionary clears them whenever the value of the entry changes.
+ */
+#define DICT_CACHE      0xffff00
+
+/** Number of key bytes copied into hash slots */
+#define DICT_PREFIX     4
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Hash entry
 
-  This object is part of an open-addressing hash table.
+  This object is a slot of an open-addressing hash table using Robin
+  Hood probing. Besides the index of the entry, it holds the length
+  and first bytes of the key, so that most probes are resolved without
+  touching the entry. Whether the slot is used is recorded in a
+  separate array of metadata bytes.
  */
 /*-------------------------------------------------------------------------*/
 typedef struct {
     unsigned       h;   /** Hash value */
-    entry_t     *  e;   /** Pointer to matching entry */
+    unsigned       i;   /** Index of matching entry */
+    unsigned       len; /** Key length */
+    unsigned       pre; /** First DICT_PREFIX key bytes, zero-padded */
 } hash_t;
 
+/** Hash function: hash of the len bytes at key, for a given seed */
+typedef unsigned (* dict_hash_fn)(const char * key, size_t len,
+                                  unsigned long seed);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Memory arena
+
+  This object is a bump allocator growing by chunks. A dictionary
+  created by dictionary_new_arena() takes its strings and tables from
+  an arena, which is shared with all the dictionaries created from it
+  by dictionary_new_child() and released at once with its owner.
+ */
+/*-------------------------------------------------------------------------*/
+typedef struct _dict_arena_ {
+    struct _dict_chunk_ *  chunks ; /** List of chunks, current first */
+    char                *  cur ;    /** Next free byte in current chunk */
+    char                *  end ;    /** End of current chunk */
+    size_t                 next ;   /** Size of the next chunk */
+    void                *  owner ;  /** Dictionary owning the arena */
+} dict_arena ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    String pool
+
+  This object is a hash set of reference-counted strings. The keys and
+  values a dictionary copies are looked up in its pool, if any, so that
+  identical strings share one copy. See dictionary_intern().
+ */
+/*-------------------------------------------------------------------------*/
+typedef struct _dict_pool_ {
+    struct _dict_str_   ** b ;      /** Buckets of strings */
+    unsigned               nb ;     /** Number of buckets, a power of 2 */
+    unsigned               n ;      /** Number of strings */
+    unsigned long          seed ;   /** Hash seed */
+    void                *  owner ;  /** Dictionary owning the pool */
+} dict_pool ;
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Dictionary object
@@ -70,11 +148,54 @@ typedef struct {
 typedef struct {
     entry_t      *  e ;     /** List of elements */
     hash_t       *  h ;     /** List of hash */
+    unsigned char * meta ;  /** Slot metadata: 0 if free, else probe length */
+    hash_t       *  oh ;    /** Hash table being migrated, or NULL */
+    unsigned char * ometa ; /** Slot metadata of oh */
+    unsigned        ocap ;  /** Number of slots in oh */
+    unsigned        mig ;   /** Next slot of oh to migrate */
+    int             incremental ; /** Non-zero to migrate slots gradually */
     int             n ;     /** Number of entries in dictionary */
+    int             end ;   /** Entries in use or removed since packing */
     int             size ;  /** Storage size */
+    int          *  ord ;   /** While end > n, positions of the entries */
+                            /** in use, in order, or NULL */
     int             dict ;  /** Values are dictionaries */
+    void         *  map ;   /** Memory mapping released with the dictionary */
+    size_t          mapsz ; /** Size of the memory mapping */
+    void         *  aux ;   /** Data of the dictionary owner, or NULL */
+    void         (* aux_free)(void *) ; /** Releases aux with the dictionary */
+    dict_arena   *  arena ; /** Arena to allocate from, or NULL */
+    dict_pool    *  pool ;  /** Pool of shared strings, or NULL */
+    dict_hash_fn    hash ;  /** Hash function */
+    unsigned long   seed ;  /** Hash seed */
 } dictionary ;
 
+/** Number of buckets of the probe histogram of dict_stats */
+#define DICT_STATS_PROBES   8
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Dictionary counters
+
+  Counters of all the dictionaries of a process, see dictionary_stats().
+  Removed entries leave a hole in the storage until it is packed:
+  removed minus reclaimed is the number of such holes.
+ */
+/*-------------------------------------------------------------------------*/
+typedef struct _dict_stats_ {
+    unsigned long   lookups ;   /** Hash table searches */
+    /** Searches by number of slots examined: 1, 2, ... and, in the last
+        bucket, DICT_STATS_PROBES or more */
+    unsigned long   probes[DICT_STATS_PROBES] ;
+    unsigned long   grows ;     /** Storage and hash table resizes */
+    unsigned long   rehashed ;  /** Keys moved to another hash table */
+    unsigned long   packs ;     /** Storage packings */
+    unsigned long   removed ;   /** Entries removed */
+    unsigned long   reclaimed ; /** Holes of removed entries reclaimed */
+    unsigned long   allocs ;    /** Allocations from the C library */
+    unsigned long   bytes ;     /** Bytes of these allocations */
+} dict_stats ;
+
 
 /*---------------------------------------------------------------------------
                             Function prototypes
@@ -86,14 +207,86 @@ typedef struct {
   @param    key     Character string to use for key.
   @return   1 unsigned int on at least 32 bits.
 
-  This hash function has been taken from an Article in Dr Dobbs Journal.
-  This is normally a collision-free function, distributing keys evenly.
-  The key is stored anyway in the struct so that collision can be avoided
-  by comparing the key itself in last resort.
+  This function returns the hash of key as computed by dictionaries
+  created with the default hash function and seed. The default seed is
+  drawn at random once per process, so that hash values cannot be
+  predicted from outside.
  */
 /*--------------------------------------------------------------------------*/
 unsigned dictionary_hash(char * key);
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Compute the hash key a dictionary uses for a string.
+  @param    d       Dictionary the hash is meant for, or NULL.
+  @param    key     Key to hash, not necessarily NUL-terminated.
+  @param    len     Number of bytes in key.
+  @return   1 unsigned int on at least 32 bits.
+
+  This function hashes key with the function and seed of d, or with the
+  defaults if d is NULL. The result can be passed to dictionary_get_h()
+  to look key up in d, or in any dictionary sharing its hashing.
+ */
+/*--------------------------------------------------------------------------*/
+unsigned dictionary_hashn(dictionary * d, const char * key, size_t len);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Default hash function.
+  @param    key     Bytes to hash.
+  @param    len     Number of bytes in key.
+  @param    seed    Seed mixed into the hash.
+  @return   1 unsigned int on at least 32 bits.
+
+  This is a variant of wyhash, processing 8 bytes at a time. Without
+  knowing the seed, inputs colliding in a dictionary cannot be built.
+ */
+/*--------------------------------------------------------------------------*/
+unsigned dictionary_hash_wy(const char * key, size_t len, unsigned long seed);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Legacy hash function.
+  @param    key     Bytes to hash.
+  @param    len     Number of bytes in key.
+  @param    seed    Ignored.
+  @return   1 unsigned int on at least 32 bits.
+
+  This is SuperFastHash by Paul Hsieh, the hash function of previous
+  versions, taken from an article in Dr Dobbs Journal. It ignores the
+  seed: its values never change, but colliding keys are easily built.
+  Build with -DDICT_SUPERFASTHASH to make it the default.
+ */
+/*--------------------------------------------------------------------------*/
+unsigned dictionary_hash_sfh(const char * key, size_t len, unsigned long seed);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Change the hashing of a dictionary.
+  @param    d       Dictionary to modify.
+  @param    hash    Hash function, NULL for the default one.
+  @param    seed    Seed passed to the hash function.
+  @return   int 0 if Ok, -1 otherwise.
+
+  This function sets the hash function and seed of a dictionary,
+  hashing again the keys it already contains. Dictionaries created by
+  dictionary_new_child() inherit the hashing of their parent.
+ */
+/*--------------------------------------------------------------------------*/
+int dictionary_hashing(dictionary * d, dict_hash_fn hash, unsigned long seed);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Tell whether a dictionary uses the default hashing.
+  @param    d       Dictionary to examine.
+  @return   int 1 if d hashes with the default function and seed, else 0.
+
+  Hashes computed by dictionary_hashn() with a NULL dictionary can be
+  used to look keys up in d exactly when this function returns 1.
+ */
+/*--------------------------------------------------------------------------*/
+int dictionary_hash_default(dictionary * d);
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Create a new dictionary object.
@@ -107,6 +300,40 @@ unsigned dictionary_hash(char * key);
 /*--------------------------------------------------------------------------*/
 dictionary * dictionary_new(int size);
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Create a new dictionary object allocating from an arena.
+  @param    size    Optional initial size of the dictionary.
+  @return   1 newly allocated dictionary objet.
+
+  This function works like dictionary_new(), but the dictionary and
+  everything it stores are allocated from a new arena: a few large
+  chunks instead of one block per key and value. Memory is only
+  given back when the dictionary is deleted, which then costs one
+  free() per chunk: removed or replaced entries are not reclaimed.
+
+  Dictionaries stored as values (see dictionary_policy()) must be
+  created by dictionary_new_child() so that they share the arena.
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * dictionary_new_arena(int size);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Create a new dictionary object to be stored in another one.
+  @param    parent  Dictionary the new one will be a value of.
+  @param    size    Optional initial size of the dictionary.
+  @return   1 newly allocated dictionary objet.
+
+  This function creates a dictionary with the same allocation policy
+  as parent: if parent allocates from an arena, so does the new
+  dictionary, which is then released together with the arena and
+  deleting it on its own does nothing. The new dictionary also uses
+  the hash function, seed and resize policy of parent.
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * dictionary_new_child(dictionary * parent, int size);
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Defines storage policy for values.
@@ -122,6 +349,58 @@ dictionary * dictionary_new(int size);
 /*--------------------------------------------------------------------------*/
 void dictionary_policy(dictionary * d, int dict);
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Defines resize policy.
+  @param    d     dictionary object to modify.
+  @param    incremental  policy
+  @return   void
+
+  When a dictionary is full, its storage doubles. Its hash table is then
+  rebuilt at once by default. If incremental is set to a non-zero value,
+  the old and new tables are kept side by side instead, and each later
+  dictionary_set() or dictionary_unset() moves a few slots from one to
+  the other, bounding the time any single call takes. Dictionaries
+  created by dictionary_new_child() inherit the policy of their parent.
+ */
+/*--------------------------------------------------------------------------*/
+void dictionary_incremental(dictionary * d, int incremental);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Share identical strings between entries.
+  @param    d     dictionary object to modify.
+  @return   int 0 if Ok, -1 otherwise.
+
+  This function attaches a pool of strings to d. From then on, the keys
+  and string values copied by d and by the dictionaries later created
+  from it by dictionary_new_child() are looked up in the pool, and
+  identical strings share a single copy, freed with the last entry
+  holding it. Keys stored inline (see DICT_INLINE) and references
+  stored by dictionary_setref() are never pooled.
+
+  The pool is released with d: its children must be deleted first, and
+  they must not be modified concurrently. Nothing is done if d already
+  has a pool.
+ */
+/*--------------------------------------------------------------------------*/
+int dictionary_intern(dictionary * d);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Make room for a number of entries.
+  @param    d     dictionary object to modify.
+  @param    n     Number of entries the dictionary should hold.
+  @return   int 0 if Ok, -1 otherwise.
+
+  This function grows the storage of a dictionary, if needed, so that
+  it can hold n entries without growing again. Reserving the expected
+  number of entries before filling a dictionary avoids the successive
+  doublings of its storage and hash table.
+ */
+/*--------------------------------------------------------------------------*/
+int dictionary_reserve(dictionary * d, int n);
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Delete a dictionary object
@@ -144,11 +423,86 @@ void dictionary_del(dictionary * vd);
   This function locates a key in a dictionary and returns a pointer to its
   value, or the passed 'def' pointer if no such key can be found in
   dictionary. The returned character pointer points to data internal to the
-  dictionary object, you should not try to free it or modify it.
+  dictionary object, you should not try to free it or modify it. It
+  stays valid until the key is set again or removed, or the dictionary
+  is deleted.
  */
 /*--------------------------------------------------------------------------*/
 void * dictionary_get(dictionary * d, char * key, void * def);
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get a value from a dictionary, given the hash of its key.
+  @param    d       dictionary object to search.
+  @param    key     Key to look for in the dictionary.
+  @param    len     Length of key.
+  @param    hash    Hash of key, as computed by dictionary_hashn().
+  @param    def     Default value to return if key not found.
+  @return   1 pointer to internally allocated character string.
+
+  This function is equivalent to dictionary_get(), for callers looking
+  up the same key repeatedly: the hash is computed once by the caller
+  instead of at each call.
+ */
+/*--------------------------------------------------------------------------*/
+void * dictionary_get_h(dictionary * d, char * key, size_t len,
+                        unsigned hash, void * def);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find the entry of a key, given the hash of the key.
+  @param    d       dictionary object to search.
+  @param    key     Key to look for in the dictionary.
+  @param    len     Length of key.
+  @param    hash    Hash of key, as computed by dictionary_hashn().
+  @return   Pointer to the entry of key, or NULL if not found.
+
+  This function is equivalent to dictionary_get_h(), but returns the
+  entry holding the key, for callers keeping values converted from it,
+  see DICT_CACHE. The entry is valid until the dictionary is modified.
+  Only its DICT_CACHE flags and cached values may be modified.
+ */
+/*--------------------------------------------------------------------------*/
+entry_t * dictionary_find_h(dictionary * d, char * key, size_t len,
+                           unsigned hash);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find the entries of several keys at once.
+  @param    d       dictionary object to search.
+  @param    keys    Keys to look for.
+  @param    lens    Length of each key.
+  @param    hashes  Hash of each key, as computed by dictionary_hashn().
+  @param    found   Set to the entry of each key, or NULL if not found.
+  @param    n       Number of keys.
+  @return   Number of keys found.
+
+  This function is equivalent to n calls to dictionary_find_h(), with
+  the hash slots of all the keys fetched from memory first: the cache
+  misses of the lookups overlap instead of adding up.
+ */
+/*--------------------------------------------------------------------------*/
+int dictionary_find_n(dictionary * d, char ** keys, const size_t * lens,
+                      const unsigned * hashes, entry_t ** found, int n);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find the entry of a key, ignoring case.
+  @param    d       dictionary object to search.
+  @param    key     Key to look for, not necessarily NUL-terminated.
+  @param    len     Length of key.
+  @return   Pointer to the entry of key, or NULL if not found.
+
+  This function finds the entry of the key equal to key with its ASCII
+  letters lowercased, as iniparser stores keys. The key is neither
+  copied nor modified: it is lowercased as it is hashed and compared.
+  Dictionaries hashing with another function than dictionary_hash_wy()
+  hash a lowercased copy instead, on the stack for keys up to
+  DICT_FOLDSZ bytes.
+ */
+/*--------------------------------------------------------------------------*/
+entry_t * dictionary_find_ci(dictionary * d, const char * key, size_t len);
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Set a value in a dictionary.
@@ -177,6 +531,24 @@ void * dictionary_get(dictionary * d, char * key, void * def);
 /*--------------------------------------------------------------------------*/
 int dictionary_set(dictionary * vd, char * key, void * val);
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Set a value in a dictionary without copying it.
+  @param    d       dictionary object to modify.
+  @param    key     Key to modify or add.
+  @param    val     Value to add.
+  @return   int     0 if Ok, anything else otherwise
+
+  This function behaves like dictionary_set(), except that neither the
+  key nor a string value are duplicated: the dictionary stores the
+  provided pointers and never frees them. The caller must guarantee
+  that both strings outlive the dictionary, e.g. because they live in
+  the memory mapping attached to it. Dictionary values (see
+  dictionary_policy()) are still owned by the dictionary.
+ */
+/*--------------------------------------------------------------------------*/
+int dictionary_setref(dictionary * d, char * key, void * val);
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Delete a key in a dictionary
@@ -190,6 +562,47 @@ int dictionary_set(dictionary * vd, char * key, void * val);
 /*--------------------------------------------------------------------------*/
 void dictionary_unset(dictionary * d, char * key);
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get an entry of a dictionary by position.
+  @param    d       dictionary object to examine.
+  @param    n       Position of the entry, from 0 to d->n-1.
+  @return   Pointer to the entry, or NULL if n is out of range.
+
+  Entries are kept in the order they were added in: this function
+  returns the n-th key added that was not removed since, in constant
+  time. dictionary_unset() keeps an index of the entries in use so
+  that this function does not modify d. Do not modify the returned
+  entry.
+ */
+/*--------------------------------------------------------------------------*/
+entry_t * dictionary_entry(dictionary * d, int n);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Iterate over the entries of a dictionary.
+  @param    d       dictionary object to examine.
+  @param    it      Iterator, to set to 0 before the first call.
+  @return   Pointer to the next entry, or NULL at the end.
+
+  This function returns the entries of a dictionary in the order they
+  were added in, skipping removed ones, without modifying it:
+
+  @code
+  int       it = 0 ;
+  entry_t * e ;
+
+  while ((e = dictionary_next(d, &it)) != NULL) {
+      printf("%s\n", e->key);
+  }
+  @endcode
+
+  Adding or removing keys while iterating may skip or repeat entries.
+  Do not modify the returned entry.
+ */
+/*--------------------------------------------------------------------------*/
+entry_t * dictionary_next(dictionary * d, int * it);
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Dump a dictionary to an opened file pointer.
@@ -204,4 +617,71 @@ void dictionary_unset(dictionary * d, char * key);
 /*--------------------------------------------------------------------------*/
 void dictionary_dump(dictionary * d, FILE * out);
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Serialize a dictionary into a position-independent image.
+  @param    d       dictionary object to serialize, packed first.
+  @param    size    Set to the size of the image.
+  @return   Image to free with free(), or NULL on failure.
+
+  The image holds the dictionary structure, its entries, hash tables
+  and strings, and those of the dictionaries it holds if its values are
+  dictionaries, with offsets from the start of the image instead of
+  pointers. It can be saved to a file and mapped anywhere by another
+  process of the same build, see dictionary_map_image(). Hash values
+  are stored with the tables, keys are not hashed again.
+
+  Dictionaries with their own hash function cannot be serialized.
+ */
+/*--------------------------------------------------------------------------*/
+void * dictionary_image(dictionary * d, size_t * size);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Use a dictionary image in place.
+  @param    p       Image made by dictionary_image(), writable and
+                    aligned on 16 bytes, e.g. a private file mapping.
+  @param    size    Size of the image.
+  @return   Dictionary of the image, or NULL if the image is invalid.
+
+  The offsets of the image are replaced by pointers, everything else is
+  used where it is: lookups run against the image, without allocating
+  or hashing stored keys. The dictionaries of the image share an arena
+  that later changes allocate from. Deleting the returned dictionary
+  releases the arena and the memory mapping set in its map field, if
+  any; p must outlive it otherwise. An image can only be used once.
+
+  Images are trusted: their structure is checked, but not that their
+  hash tables match their entries.
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * dictionary_map_image(void * p, size_t size);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the counters of all dictionaries.
+  @param    s       Set to the counters.
+  @return   int 0 if Ok, -1 if s is NULL or the library was compiled
+            without INIPARSER_STATS.
+
+  The counters cover every dictionary of the process since it started,
+  or since dictionary_stats_reset(). They are only kept when the library
+  is compiled with INIPARSER_STATS defined, otherwise s is zeroed.
+  Counters are updated without locking: read while other threads use
+  dictionaries, each one is exact but they may not be from the same
+  instant.
+ */
+/*--------------------------------------------------------------------------*/
+int dictionary_stats(dict_stats * s);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Reset the counters of all dictionaries.
+  @return   void
+
+  Sets to zero the counters dictionary_stats() returns.
+ */
+/*--------------------------------------------------------------------------*/
+void dictionary_stats_reset(void);
+
 #endif
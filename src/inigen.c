@@ -0,0 +1,478 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    inigen.c
+   @date    Oct 2026
+   @version 4.0
+   @brief   Generates the header of a configuration schema.
+
+   inigen reads a schema, an ini file giving the type and the default
+   value of each key of a configuration, and writes a C header with a
+   structure holding a field per key, the schema placing the keys by a
+   minimal perfect hash, and a function loading an ini file into the
+   structure with iniparser_load_schema():
+
+   @code
+   [server]
+   port    = int 8080
+   host    = string localhost
+   verbose = boolean false
+   @endcode
+
+   Types are string, int, double, boolean, int64 and uint64, the rest
+   of the value is the default, if any. Keys before the first section
+   are fields of the structure itself, the others are fields of a
+   structure per section.
+
+   Usage: inigen schema.ini name [header.h]
+*/
+/*--------------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------------
+                                Includes
+ ---------------------------------------------------------------------------*/
+#include <ctype.h>
+#include "iniparser.h"
+
+/*---------------------------- Defines -------------------------------------*/
+
+/* Largest displacement tried for a bucket */
+#define GEN_DISPMAX     (65535)
+
+/* Seeds tried before giving up */
+#define GEN_SEEDS       (256)
+
+/* Average number of keys per bucket */
+#define GEN_LOAD        (4)
+
+/*---------------------------------------------------------------------------
+                        Private to this module
+ ---------------------------------------------------------------------------*/
+
+/* Field of the schema being generated */
+typedef struct _gen_field_ {
+    char        *   key ;   /* "section:key" */
+    char        *   sec ;   /* C name of the section, or NULL */
+    char        *   name ;  /* C name of the field */
+    int             type ;  /* Index in gen_types */
+    char        *   def ;   /* Default value, or NULL */
+    uint64_t        hash ;  /* Schema hash of key */
+    int             slot ;  /* Slot of the field */
+} gen_field ;
+
+/* Types of fields */
+static const struct {
+    char    *   name ;      /* Name in schemas */
+    char    *   ctype ;     /* C type of the fields */
+    char    *   itype ;     /* ini_type of the fields */
+} gen_types[] = {
+    { "string",  "char *",   "INI_TYPE_STRING"  },
+    { "int",     "int",      "INI_TYPE_INT"     },
+    { "double",  "double",   "INI_TYPE_DOUBLE"  },
+    { "boolean", "int",      "INI_TYPE_BOOLEAN" },
+    { "int64",   "int64_t",  "INI_TYPE_INT64"   },
+    { "uint64",  "uint64_t", "INI_TYPE_UINT64"  }
+} ;
+
+#define GEN_NTYPES  (int)(sizeof(gen_types) / sizeof(gen_types[0]))
+
+/* Keywords that cannot name fields */
+static const char * gen_keywords[] = {
+    "auto", "break", "case", "char", "const", "continue", "default", "do",
+    "double", "else", "enum", "extern", "float", "for", "goto", "if",
+    "inline", "int", "long", "register", "restrict", "return", "short",
+    "signed", "sizeof", "static", "struct", "switch", "typedef", "union",
+    "unsigned", "void", "volatile", "while", NULL
+} ;
+
+/* Returns a C identifier made of s, to free with free(), or NULL */
+static char * gen_ident(const char * s, size_t len)
+{
+    char    *   id ;
+    size_t      i, j = 0 ;
+
+    if ((id = (char *)malloc(len + 3)) == NULL) {
+        return NULL ;
+    }
+    if (len == 0 || isdigit((int)(unsigned char)s[0])) {
+        id[j++] = '_' ;
+    }
+    for (i=0 ; i<len ; i++) {
+        id[j++] = isalnum((int)(unsigned char)s[i]) ? s[i] : '_' ;
+    }
+    id[j] = (char)0 ;
+    for (i=0 ; gen_keywords[i] != NULL ; i++) {
+        if (!strcmp(id, gen_keywords[i])) {
+            id[j++] = '_' ;
+            id[j] = (char)0 ;
+            break ;
+        }
+    }
+    return id ;
+}
+
+/* Reads a field of the schema, returns 0 if Ok */
+static int gen_parse(gen_field * f, char * sec, char * key, char * val)
+{
+    size_t      n ;
+
+    f->key = (char *)malloc(strlen(sec) + strlen(key) + 2) ;
+    f->sec = sec[0] ? gen_ident(sec, strlen(sec)) : NULL ;
+    f->name = gen_ident(key, strlen(key)) ;
+    if (f->key == NULL || (sec[0] && f->sec == NULL) || f->name == NULL) {
+        fprintf(stderr, "inigen: memory allocation failure\n");
+        return -1 ;
+    }
+    sprintf(f->key, "%s:%s", sec, key);
+
+    /* Type, then the default up to the end of the value */
+    while (isspace((int)(unsigned char)*val)) val++ ;
+    for (n=0 ; val[n] && !isspace((int)(unsigned char)val[n]) ; n++)
+        ;
+    for (f->type=0 ; f->type<GEN_NTYPES ; f->type++) {
+        if (strlen(gen_types[f->type].name) == n &&
+            !strncmp(gen_types[f->type].name, val, n)) {
+            break ;
+        }
+    }
+    if (f->type == GEN_NTYPES) {
+        fprintf(stderr, "inigen: %s: unknown type \"%.*s\"\n", f->key,
+                (int)n, val);
+        return -1 ;
+    }
+    for (val += n ; isspace((int)(unsigned char)*val) ; val++)
+        ;
+    /* Quotes keep blanks around the default, as in values */
+    n = strlen(val) ;
+    if (n >= 2 && (val[0] == '"' || val[0] == '\'') && val[n-1] == val[0]) {
+        val[n-1] = (char)0 ;
+        val++ ;
+    }
+    f->def = *val ? val : NULL ;
+    return 0 ;
+}
+
+/* Returns a field of the n first ones whose C name clashes with the */
+/* one of field n, or -1 */
+static int gen_clash(gen_field * f, int n)
+{
+    int     j ;
+
+    for (j=0 ; j<n ; j++) {
+        /* Same field name in the same structure */
+        if (!strcmp(f[j].name, f[n].name) &&
+            (f[j].sec == NULL ? f[n].sec == NULL
+                              : f[n].sec != NULL &&
+                                !strcmp(f[j].sec, f[n].sec))) {
+            return j ;
+        }
+        /* Sections of the same C name, or named as a key */
+        if (f[j].sec != NULL && f[n].sec != NULL &&
+            !strcmp(f[j].sec, f[n].sec) &&
+            strncmp(f[j].key, f[n].key, strcspn(f[n].key, ":") + 1)) {
+            return j ;
+        }
+        if ((f[j].sec == NULL && f[n].sec != NULL &&
+             !strcmp(f[j].name, f[n].sec)) ||
+            (f[n].sec == NULL && f[j].sec != NULL &&
+             !strcmp(f[n].name, f[j].sec))) {
+            return j ;
+        }
+    }
+    return -1 ;
+}
+
+/* Builds a minimal perfect hash of the fields with seed, filling disp */
+/* and the slot of each field. work holds 3 * n + nb integers. Returns */
+/* 0 if Ok. */
+static int gen_hash(gen_field * f, int n, unsigned short * disp, int nb,
+                    unsigned long seed, int * work)
+{
+    int         * count = work, * order = work + nb ;
+    int         * taken = order + n, * slots = taken + n ;
+    ini_schema    sc ;
+    int           i, j, k, b, d, m ;
+
+    memset(work, 0, (3 * n + nb) * sizeof(int));
+    memset(disp, 0, nb * sizeof(unsigned short));
+    memset(&sc, 0, sizeof(sc));
+    sc.n = n ;
+    sc.disp = disp ;
+    sc.nb = nb ;
+    sc.seed = seed ;
+
+    for (i=0 ; i<n ; i++) {
+        f[i].hash = iniparser_schema_hash(f[i].key, strlen(f[i].key), seed) ;
+        count[(uint32_t)(f[i].hash >> 32) % (uint32_t)nb]++ ;
+    }
+    /* Largest buckets first, while most slots are free */
+    for (k=n ; k>0 ; k-=m) {
+        for (i=b=0 ; i<nb ; i++) {
+            if (count[i] > count[b]) {
+                b = i ;
+            }
+        }
+        m = count[b] ;
+        count[b] = 0 ;
+        for (i=j=0 ; i<n ; i++) {
+            if ((int)((uint32_t)(f[i].hash >> 32) % (uint32_t)nb) == b) {
+                order[j++] = i ;
+            }
+        }
+        for (d=0 ; d<=GEN_DISPMAX ; d++) {
+            disp[b] = (unsigned short)d ;
+            for (j=0 ; j<m ; j++) {
+                slots[j] = iniparser_schema_slot(&sc, f[order[j]].hash) ;
+                if (taken[slots[j]]) {
+                    break ;
+                }
+                taken[slots[j]] = 1 ;
+            }
+            if (j == m) {
+                break ;
+            }
+            while (j-- > 0) {
+                taken[slots[j]] = 0 ;
+            }
+        }
+        if (d > GEN_DISPMAX) {
+            return -1 ;
+        }
+        for (j=0 ; j<m ; j++) {
+            f[order[j]].slot = slots[j] ;
+        }
+    }
+    return 0 ;
+}
+
+/* Writes s as a C string literal */
+static void gen_string(FILE * out, const char * s)
+{
+    fputc('"', out);
+    for ( ; *s ; s++) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(out, "\\%c", *s);
+        } else if (isprint((int)(unsigned char)*s)) {
+            fputc(*s, out);
+        } else {
+            fprintf(out, "\\%03o", (unsigned)(unsigned char)*s);
+        }
+    }
+    fputc('"', out);
+}
+
+/* Writes the member of a field, indented by ind */
+static void gen_member(FILE * out, int ind, int type, char * name, char * key)
+{
+    int     n = (int)strlen(name) ;
+
+    fprintf(out, "%*s%-12s%s ;%*s/** %s */\n", ind, "",
+            gen_types[type].ctype, name, n < 16 ? 17 - n : 1, "", key);
+}
+
+/* Writes the header of the n fields of schema name, returns 0 if Ok */
+static int gen_write(FILE * out, char * schema, char * name, gen_field * f,
+                      int n, unsigned short * disp, int nb,
+                      unsigned long seed)
+{
+    int     i, j, k ;
+    char  * guard ;
+
+    if ((guard = gen_ident(name, strlen(name))) == NULL) {
+        return -1 ;
+    }
+    for (i=0 ; guard[i] ; i++) {
+        guard[i] = (char)toupper((int)(unsigned char)guard[i]);
+    }
+
+    fprintf(out, "/*\n * %s.h: configuration schema generated by inigen"
+                 " from %s.\n * Do not edit.\n */\n\n", name, schema);
+    fprintf(out, "#ifndef _%s_H_\n#define _%s_H_\n\n", guard, guard);
+    fprintf(out, "#include <stddef.h>\n#include \"iniparser.h\"\n\n");
+
+    /* Structure: keys without section, then a structure per section */
+    fprintf(out, "typedef struct _%s_ {\n", name);
+    for (i=0 ; i<n ; i++) {
+        if (f[i].sec == NULL) {
+            gen_member(out, 4, f[i].type, f[i].name, f[i].key);
+        }
+    }
+    for (i=0 ; i<n ; i++) {
+        if (f[i].sec == NULL || (i > 0 && f[i-1].sec != NULL &&
+                                 !strcmp(f[i-1].sec, f[i].sec))) {
+            continue ;
+        }
+        fprintf(out, "    struct {\n");
+        for (j=i ; j<n && f[j].sec != NULL && !strcmp(f[j].sec, f[i].sec) ;
+             j++) {
+            gen_member(out, 8, f[j].type, f[j].name, f[j].key);
+        }
+        fprintf(out, "    } %s ;\n", f[i].sec);
+    }
+    fprintf(out, "} %s ;\n\n", name);
+
+    /* Fields by slot */
+    fprintf(out, "static const ini_field %s_fields[] = {\n", name);
+    for (k=0 ; k<n ; k++) {
+        for (i=0 ; f[i].slot != k ; i++)
+            ;
+        fprintf(out, "    { ");
+        gen_string(out, f[i].key);
+        fprintf(out, ", %lu, %s, ", (unsigned long)strlen(f[i].key),
+                gen_types[f[i].type].itype);
+        if (f[i].def != NULL) {
+            gen_string(out, f[i].def);
+        } else {
+            fprintf(out, "NULL");
+        }
+        if (f[i].sec != NULL) {
+            fprintf(out, ",\n      offsetof(%s, %s.%s) }%s\n", name,
+                    f[i].sec, f[i].name, k < n - 1 ? "," : "");
+        } else {
+            fprintf(out, ",\n      offsetof(%s, %s) }%s\n", name,
+                    f[i].name, k < n - 1 ? "," : "");
+        }
+    }
+    fprintf(out, "} ;\n\n");
+
+    fprintf(out, "static const unsigned short %s_disp[] = {", name);
+    for (i=0 ; i<nb ; i++) {
+        fprintf(out, "%s%u%s", i % 10 ? " " : "\n    ", (unsigned)disp[i],
+                i < nb - 1 ? "," : "\n");
+    }
+    fprintf(out, "} ;\n\n");
+
+    fprintf(out, "static const ini_schema %s_schema = {\n", name);
+    fprintf(out, "    %s_fields, %d, %s_disp, %d, %luUL, sizeof(%s)\n",
+            name, n, name, nb, seed, name);
+    fprintf(out, "} ;\n\n");
+
+    fprintf(out, "/* Loads ininame into c, see iniparser_load_schema() */\n");
+    fprintf(out, "static __inline__ dictionary * %s_load(char * ininame, "
+                 "%s * c)\n{\n", name, name);
+    fprintf(out, "    return iniparser_load_schema(ininame, &%s_schema, c) "
+                 ";\n}\n\n", name);
+    fprintf(out, "#endif\n");
+    free(guard);
+    return 0 ;
+}
+
+/* Reads the fields of schema d into f, finds a perfect hash of them */
+/* and writes the header of structure name to hname, or to stdout if */
+/* hname is NULL. Returns the exit status of inigen. */
+static int gen_schema(dictionary * d, char * ininame, char * name,
+                      char * hname, gen_field * f, unsigned short * disp,
+                      int nb, int * work)
+{
+    FILE            *   out = stdout ;
+    char            *   sec, * key, * val ;
+    int                 i, j, it, n, ns, status ;
+    unsigned long       seed ;
+
+    ns = iniparser_getnsec(d) ;
+    for (i=n=0 ; i<ns ; i++) {
+        sec = iniparser_getsecname(d, i) ;
+        for (it=0 ; (key = iniparser_key_iter(d, sec, &it, &val)) != NULL ; ) {
+            if (gen_parse(&f[n], sec, key, val ? val : "") != 0) {
+                return 1 ;
+            }
+            if ((j = gen_clash(f, n)) >= 0) {
+                fprintf(stderr, "inigen: %s and %s have the same C name\n",
+                        f[j].key, f[n].key);
+                return 1 ;
+            }
+            n++ ;
+        }
+    }
+
+    for (seed=0 ; seed<GEN_SEEDS ; seed++) {
+        if (gen_hash(f, n, disp, nb, seed, work) == 0) {
+            break ;
+        }
+    }
+    if (seed == GEN_SEEDS) {
+        fprintf(stderr, "inigen: cannot build a perfect hash\n");
+        return 1 ;
+    }
+    if (hname != NULL && (out = fopen(hname, "w")) == NULL) {
+        fprintf(stderr, "inigen: cannot create %s\n", hname);
+        return 1 ;
+    }
+    status = 0 ;
+    if (gen_write(out, ininame, name, f, n, disp, nb, seed) != 0) {
+        fprintf(stderr, "inigen: memory allocation failure\n");
+        status = 1 ;
+    }
+    if (out != stdout && fclose(out) != 0 && status == 0) {
+        fprintf(stderr, "inigen: cannot write %s\n", hname);
+        status = 1 ;
+    }
+    return status ;
+}
+
+/*---------------------------------------------------------------------------
+                            Function codes
+ ---------------------------------------------------------------------------*/
+
+int main(int argc, char * argv[])
+{
+    dictionary      *   d ;
+    gen_field       *   f ;
+    unsigned short  *   disp ;
+    int             *   work ;
+    int                 i, it, n, nb, ns, status ;
+
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "usage: inigen schema.ini name [header.h]\n");
+        return 1 ;
+    }
+    for (i=0 ; argv[2][i] ; i++) {
+        if (!isalnum((int)(unsigned char)argv[2][i]) && argv[2][i] != '_') {
+            break ;
+        }
+    }
+    if (i == 0 || argv[2][i] || isdigit((int)(unsigned char)argv[2][0])) {
+        fprintf(stderr, "inigen: %s is not a C identifier\n", argv[2]);
+        return 1 ;
+    }
+    if ((d = iniparser_load(argv[1])) == NULL) {
+        return 1 ;
+    }
+
+    /* Count the keys, then read them */
+    ns = iniparser_getnsec(d) ;
+    for (i=n=0 ; i<ns ; i++) {
+        for (it=0 ; iniparser_key_iter(d, iniparser_getsecname(d, i), &it,
+                                       NULL) != NULL ; n++)
+            ;
+    }
+    if (n == 0) {
+        fprintf(stderr, "inigen: no keys in %s\n", argv[1]);
+        iniparser_freedict(d);
+        return 1 ;
+    }
+    nb = n / GEN_LOAD + 1 ;
+    f = (gen_field *)calloc(n, sizeof(gen_field)) ;
+    disp = (unsigned short *)calloc(nb, sizeof(unsigned short)) ;
+    work = (int *)malloc((3 * n + nb) * sizeof(int)) ;
+    if (f == NULL || disp == NULL || work == NULL) {
+        fprintf(stderr, "inigen: memory allocation failure\n");
+        status = 1 ;
+    } else {
+        status = gen_schema(d, argv[1], argv[2], argc == 4 ? argv[3] : NULL,
+                            f, disp, nb, work) ;
+    }
+
+    /* Fields not read yet are zeroed */
+    for (i=0 ; f != NULL && i<n ; i++) {
+        free(f[i].key);
+        free(f[i].sec);
+        free(f[i].name);
+    }
+    free(f);
+    free(disp);
+    free(work);
+    iniparser_freedict(d);
+    return status ;
+}
+
+/* vim: set ts=4 et sw=4 tw=75 */
@@ -9,12 +9,76 @@
    @brief   Parser for ini files.
 */
 /*--------------------------------------------------------------------------*/
+/* mmap() and friends are POSIX, which -ansi does not expose by default */
+#define _POSIX_C_SOURCE 200112L
+
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include "iniparser.h"
+#include "iniscan.h"
+#include "iniread.h"
 
 /*---------------------------- Defines -------------------------------------*/
 #define ASCIILINESZ         (1024)
 #define INI_INVALID_KEY     ((char*)-1)
+#define INI_READERS         (64)
+#define INI_CACHELINE       (64)
+#define INI_READSZ          (16 * 1024)
+#define INI_WRITESZ         (16 * 1024)
+
+/* Width keys are padded to by iniparser_dump_ini() */
+#define INI_KEYWIDTH        (30)
+
+/* Largest number of settings iniparser_lookup() resolves together */
+#define INI_BATCH           (16)
+
+/* Values cached in entries, see DICT_CACHE */
+#define INI_CACHE_NUM       0x0100  /* num holds the integer magnitude */
+#define INI_CACHE_NEG       0x0200  /* The integer is negative */
+#define INI_CACHE_BIG       0x0400  /* The magnitude exceeds 64 bits */
+#define INI_CACHE_BAD       0x0800  /* The value is not only an integer */
+#define INI_CACHE_DBL       0x1000  /* dbl holds the atof() value */
+#define INI_CACHE_BOOL      0x2000  /* The boolean value is known */
+#define INI_CACHE_TRUE      0x4000  /* The value is true */
+#define INI_CACHE_FALSE     0x8000  /* The value is false */
+
+/* Section entries of lazy loads, see INI_LOAD_LAZY */
+#define INI_SECTION_LAZY    0x0100  /* The lines of the section are pending */
+#define INI_SECTION_INDEXED 0x0200  /* num holds the first range of the */
+                                    /* section lines in the index */
+
+/* Key entries of overlays, see iniparser_overlay(). The bit is apart */
+/* from those of the entries of lazy sections, which have no value yet. */
+#define INI_REMOVED         0x010000  /* The key of the base is removed */
+
+/* Binary images, see iniparser_save_binary() */
+#define INI_BINARY_MAGIC    "iniparsr"
+#define INI_BINARY_VERSION  (1)
+#define INI_BINARY_HDR      (64)
+
+/* Schema hashes, see iniparser_schema_hash(): FNV-1a, then a final mix */
+#define INI_U64(hi, lo)     (((uint64_t)(hi) << 32) | (uint64_t)(lo))
+#define INI_FNV_BASIS       INI_U64(0xcbf29ce4, 0x84222325)
+#define INI_FNV_PRIME       INI_U64(0x00000100, 0x000001b3)
+
+/* Smallest chunk iniparser_load_parallel() hands to a thread */
+#ifndef INI_CHUNK_MIN
+#define INI_CHUNK_MIN       (1 << 20)
+#endif
+
+/* Error statuses of chunks loaded in parallel start from this value: */
+/* below it, a section or key line of the chunk reset the status, as */
+/* it does when loading sequentially */
+#define INI_ERRS_KEEP       (1 << 30)
 
 /*---------------------------------------------------------------------------
                         Private to this module
@@ -31,92 +95,356 @@ typedef enum _line_status_ {
     LINE_VALUE
 } line_status ;
 
+#ifdef INIPARSER_STATS
+/* Counters of all parsers, see iniparser_stats() */
+static struct {
+    unsigned long   bytes ;                 /* Input fed */
+    unsigned long   lines[LINE_VALUE + 1] ; /* Lines by status */
+    unsigned long   chunks ;                /* Chunks of parallel loads */
+    uint64_t        ns ;                    /* Time spent parsing */
+} ini_counters ;
+
+#define ini_stat(f, n)  ((void)__atomic_fetch_add(&ini_counters.f, (n), \
+                                                  __ATOMIC_RELAXED))
+
+/* Monotonic time in nanoseconds */
+static uint64_t ini_clock(void)
+{
+    struct timespec ts ;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec ;
+}
+
+typedef uint64_t    ini_clock_t ;
+#define ini_stat_begin(t)   ((t) = ini_clock())
+#define ini_stat_end(t)     ini_stat(ns, ini_clock() - (t))
+#else
+#define ini_stat(f, n)      ((void)0)
+typedef int         ini_clock_t ;
+#define ini_stat_begin(t)   ((t) = 0)
+#define ini_stat_end(t)     ((void)(t))
+#endif
+
+/**
+ * Span of characters inside a line (internal use only). Spans point
+ * into the scanned line and are not NUL-terminated.
+ */
+typedef struct _ini_span_ {
+    char    *   s ;     /** First character of the span */
+    int         n ;     /** Number of characters in the span */
+} ini_span ;
+
+/**
+ * Key counts of a first pass over an ini file (internal use only),
+ * used to presize the dictionary and its sections on load.
+ */
+typedef struct _ini_count_ {
+    int     *   keys ;  /** Keys after each section line, [0] before */
+    int         n ;     /** Number of section lines plus one */
+    int         sz ;    /** Allocated size of keys */
+    int         next ;  /** Index of the counts of the next section line */
+    int         cont ;  /** Non-zero if the last line is continued */
+    int         first ; /** First non-blank character of the line, or 0 */
+    int         last ;  /** Last non-blank character of the line */
+} ini_count ;
+
+/**
+ * Compiled key (see iniparser_key_new()). The lowercased "section:key"
+ * string, then the section and key names, are stored right after the
+ * structure.
+ */
+struct _ini_key_ {
+    char    *   section ;   /** Lowercased section name */
+    char    *   key ;       /** Lowercased key name */
+    char    *   full ;      /** Lowercased "section:key", for flat loads */
+    size_t      slen ;      /** Length of section */
+    size_t      klen ;      /** Length of key */
+    size_t      flen ;      /** Length of full */
+    unsigned    shash ;     /** Hash of section, for the default hashing */
+    unsigned    khash ;     /** Hash of key, for the default hashing */
+    unsigned    fhash ;     /** Hash of full, for the default hashing */
+} ;
+
+/**
+ * Chunk of an ini file loaded by iniparser_load_parallel() (internal
+ * use only)
+ */
+typedef struct _ini_chunk_ {
+    dictionary  *   dict ;      /** Sections of the chunk */
+    char        *   p ;         /** First character of the chunk */
+    char        *   end ;       /** End of the chunk */
+    char        *   ininame ;   /** Name of the ini file */
+    int             lineno ;    /** Lines before the chunk, or in it */
+    int             errs ;      /** Error status */
+} ini_chunk ;
+
+/**
+ * Lines of a section in the mapping of a lazy load (internal use only):
+ * a named section line and the lines up to the next one. The ranges
+ * of a repeated section are chained in file order.
+ */
+typedef struct _ini_range_ {
+    size_t          start ;     /** Offset of the section line */
+    size_t          end ;       /** Offset of the end of the range */
+    unsigned        hash ;      /** Hash of the lines, as first mapped */
+    int             lineno ;    /** Lines before the range */
+    int             next ;      /** Index plus one of the next range, or 0 */
+    int             last ;      /** In a first range, index of the last one */
+} ini_range ;
+
+/**
+ * Mapping of a file reloaded into a dictionary (internal use only)
+ */
+typedef struct _ini_map_ {
+    void            *   p ;     /** Mapping */
+    size_t              size ;  /** Size of the mapping */
+    struct _ini_map_ *  next ;  /** Mapping of an earlier load, or NULL */
+} ini_map ;
+
+/**
+ * Section index of a lazy load (internal use only), attached to the
+ * dictionary. Indexed section entries hold the index plus one of their
+ * first range in their num field. The mappings of reloads are kept
+ * with the index, since unchanged sections still point into them.
+ */
+typedef struct _ini_lazy_ {
+    char        *   p ;         /** Mapping the ranges are offsets in */
+    ini_range   *   r ;         /** Ranges, in file order */
+    int             n ;         /** Number of ranges */
+    int             sz ;        /** Allocated size of r */
+    ini_map     *   maps ;      /** Mappings of reloads, latest first */
+} ini_lazy ;
+
+/**
+ * File header of binary images (internal use only), followed by the
+ * dictionary image at offset INI_BINARY_HDR
+ */
+typedef struct _ini_binary_ {
+    char            magic[8] ;  /** INI_BINARY_MAGIC */
+    unsigned        version ;   /** INI_BINARY_VERSION */
+    unsigned        check ;     /** Hash of the dictionary image */
+    unsigned long   size ;      /** Size of the dictionary image */
+    long            isize ;     /** Size of the ini file, or -1 */
+    long            mtime ;     /** Modification time of the ini file */
+    unsigned long   ino ;       /** Inode of the ini file */
+} ini_binary ;
+
+/**
+ * Loader context of the callbacks storing lines into a dictionary
+ * (internal use only). Lines inside [p, end) are stored by reference.
+ */
+typedef struct _ini_load_ {
+    dictionary  *   dict ;      /** Dictionary to fill */
+    dictionary  *   cur ;       /** Current section, or NULL */
+    char        *   ininame ;   /** Name of the ini file */
+    char        *   p ;         /** Input stored by reference, or NULL */
+    char        *   end ;       /** End of the input stored by reference */
+    int             errs ;      /** Error status, as in iniparser_load() */
+    ini_count   *   hints ;     /** First pass counts, or NULL */
+    char        *   fkey ;      /** Flat loads: "section:" then the key */
+    size_t          flen ;      /** Length of "section:" in fkey, or 0 */
+    size_t          fsz ;       /** Allocated size of fkey */
+    int             skip ;      /** Flat loads: skip the keys of a */
+                                /** section that cannot be stored */
+} ini_load ;
+
+/**
+ * Loader context of schema loads (internal use only). Keys of the
+ * schema are converted into dest, the others stored by l, whose fkey
+ * holds the name of the current section followed by a colon.
+ */
+typedef struct _ini_schema_load_ {
+    ini_load            l ;     /** Loader of the keys the schema lacks */
+    const ini_schema *  sc ;    /** Schema of dest */
+    char             *  dest ;  /** Structure to fill */
+    uint64_t            h ;     /** Schema hash of fkey */
+} ini_schema_load ;
+
+/**
+ * String value of a schema load (internal use only), released with the
+ * dictionary of the load. The characters follow the structure.
+ */
+typedef struct _ini_str_ {
+    struct _ini_str_ *  next ;  /** Previous string of the load */
+} ini_str ;
+
+/**
+ * First pass context of lazy loads (internal use only). Lines before
+ * the first named section line are loaded, the others only indexed.
+ */
+typedef struct _ini_index_ {
+    ini_load        l ;         /** Loader of the first lines */
+    ini_lazy    *   lz ;        /** Index being built */
+    char        *   line ;      /** First character of the current line */
+    int             lineno ;    /** Lines before the current line */
+    int             lazy ;      /** Non-zero once past a named section */
+} ini_index ;
+
+/**
+ * Output of iniparser_dump_ini(). Bytes are gathered in buf, then
+ * written to f or fd when it is full. Memory outputs have neither:
+ * bytes that do not fit are counted but dropped.
+ */
+typedef struct _ini_out_ {
+    char        *   buf ;       /** Output buffer */
+    size_t          len ;       /** Bytes in buf */
+    size_t          cap ;       /** Size of buf */
+    size_t          total ;     /** Bytes output so far, including dropped */
+    FILE        *   f ;         /** Stream to write to, or NULL */
+    int             fd ;        /** Descriptor to write to, or -1 */
+    int             err ;       /** Non-zero after a write error */
+} ini_out ;
+
+/**
+ * Streaming parser (see iniparser_parser_new()). The join buffer holds
+ * the multi-line input joined so far, followed by the physical line
+ * going on in the next chunk.
+ */
+struct _ini_parser_ {
+    ini_handler     h ;         /** Callbacks */
+    void        *   ctx ;       /** Context of the callbacks */
+    char        *   join ;      /** Join buffer */
+    size_t          jlen ;      /** Joined characters in join */
+    size_t          plen ;      /** Partial line characters after them */
+    size_t          jsz ;       /** Allocated size of join */
+    int             pending ;   /** Non-zero if the joined line goes on */
+    int             lineno ;    /** Physical lines completed */
+    int             status ;    /** Status that stopped parsing, or 0 */
+} ;
+
+/**
+ * Reader slot of a published configuration (see iniparser_config_new()),
+ * alone in its cache line so that readers do not contend.
+ */
+typedef struct _ini_reader_ {
+    void    *   p ;     /** Dictionary in use, the config if claimed */
+    char    pad[INI_CACHELINE - sizeof(void *)] ;
+} ini_reader ;
+
+/**
+ * Published configuration. Readers announce the dictionary they use in
+ * a slot, as hazard pointers: a replaced dictionary is freed once no
+ * slot holds it any more.
+ */
+struct _ini_config_ {
+    dictionary  *   cur ;           /** Published dictionary, or NULL */
+    ini_reader  *   readers ;       /** Reader slots */
+    int             nreaders ;      /** Number of reader slots */
+} ;
+
+/* Sequentially consistent accesses to the fields of ini_config */
+#define ini_atomic_load(p)      __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define ini_atomic_store(p, v)  __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+
+/* Hash of a handle name for d, recomputed if d has its own hashing */
+#define ini_key_hash(d, h, name, len, hash) \
+    (dictionary_hash_default(d) ? (h)->hash \
+                                : dictionary_hashn((d), (h)->name, (h)->len))
+
+/* Structural character searches, see iniscan.h */
+#define ini_find(p, end, c) \
+    ((char *)iniscan_ops_get()->find2((p), (end), (c), (c)))
+#define ini_find2(p, end, a, b) \
+    ((char *)iniscan_ops_get()->find2((p), (end), (a), (b)))
+
+/* Section dictionary of the entry e of d, parsed first if pending */
+#define ini_section(d, e) \
+    (((e)->flags & INI_SECTION_LAZY) ? iniparser_lazy_section((d), (e)) \
+                                     : (dictionary *)(e)->val)
+
+static dictionary * iniparser_lazy_section(dictionary * d, entry_t * e);
+
+/* Non-zero if d was loaded with INI_LOAD_FLAT, see iniparser_flat_new() */
+#define ini_flat(d)     ((d)->aux_free == iniparser_flat_free)
+/* Section directory of a flat dictionary */
+#define ini_flat_dir(d) ((dictionary *)(d)->aux)
+
+static void iniparser_flat_free(void * p);
+
+/* Non-zero if d is an overlay or a section of one, which falls through */
+/* to its base for the keys it does not hold, see iniparser_overlay() */
+#define ini_layer(d)        ((d)->aux_free == iniparser_layer_free)
+/* Dictionary an overlay falls through to */
+#define ini_layer_base(d)   ((dictionary *)(d)->aux)
+/* Non-zero if e hides a key removed from the base of an overlay */
+#define ini_removed(e)      ((e)->val == NULL && ((e)->flags & INI_REMOVED))
+
+static void iniparser_layer_free(void * p);
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Convert a string to lowercase.
   @param    s   String to convert.
-  @return   ptr to statically allocated string.
+  @param    l   Buffer of ASCIILINESZ+1 characters to write to.
+  @return   l, or NULL if s is NULL.
 
-  This function returns a pointer to a statically allocated string
-  containing a lowercased version of the input string. Do not free
-  or modify the returned string! Since the returned string is statically
-  allocated, it will be modified at each function call (not re-entrant).
+  This function stores a lowercased version of the input string into
+  the buffer provided by the caller, truncated to ASCIILINESZ
+  characters. It uses no static storage and is re-entrant.
  */
 /*--------------------------------------------------------------------------*/
-static char * strlwc(char * s)
+static char * strlwc(char * s, char * l)
 {
-    static char l[ASCIILINESZ+1];
     int i ;
 
     if (s==NULL) return NULL ;
-    memset(l, 0, ASCIILINESZ+1);
     i=0 ;
     while (s[i] && i<ASCIILINESZ) {
-        l[i] = (char)tolower((int)s[i]);
+        l[i] = (char)tolower((int)(unsigned char)s[i]);
         i++ ;
     }
-    l[ASCIILINESZ]=(char)0;
+    l[i]=(char)0;
     return l ;
 }
 
-/*-------------------------------------------------------------------------*/
-/**
-  @brief    Remove blanks at the beginning and the end of a string.
-  @param    s   String to parse.
-  @return   ptr to statically allocated string.
+/* Removes blanks at the beginning and the end of a span */
+static void span_strip(ini_span * sp)
+{
+    char * end ;
 
-  This function returns a pointer to a statically allocated string,
-  which is identical to the input string, except that all blank
-  characters at the end and the beg. of the string have been removed.
-  Do not free or modify the returned string! Since the returned string
-  is statically allocated, it will be modified at each function call
-  (not re-entrant).
- */
-/*--------------------------------------------------------------------------*/
-static char * strstrip(char * s)
+    end = (char *)iniscan_ops_get()->rskipws(sp->s, sp->s + sp->n);
+    sp->s = (char *)iniscan_ops_get()->skipws(sp->s, end);
+    sp->n = (int)(end - sp->s) ;
+}
+
+/* Converts a span to lowercase in place and NUL-terminates it. The */
+/* character following the span is overwritten. */
+static char * span_lwc(ini_span * sp)
 {
-    static char l[ASCIILINESZ+1];
-    char * last ;
-    
-    if (s==NULL) return NULL ;
-    
-    while (isspace((int)*s) && *s) s++;
-    memset(l, 0, ASCIILINESZ+1);
-    strcpy(l, s);
-    last = l + strlen(l);
-    while (last > l) {
-        if (!isspace((int)*(last-1)))
-            break ;
-        last -- ;
+    int i ;
+
+    for (i=0 ; i<sp->n ; i++) {
+        sp->s[i] = (char)tolower((int)(unsigned char)sp->s[i]);
     }
-    *last = (char)0;
-    return (char*)l ;
+    sp->s[sp->n] = (char)0;
+    return sp->s ;
 }
 
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Parse a string into 2 lowercase part
   @param    q   String to parse.
+  @param    l   Buffer of ASCIILINESZ+1 characters to write to.
   @param    s   Pointer where to store pointer to first string
   @param    k   Pointer where to store pointer to second string
   @return   0 on success, -1 on failure.
 
   This function parses an input string and sets two pointers to a
   lowercase version of the input string split in two at the ':'
-  character. Do not free or modify the returned string! Since the
-  returned string is statically allocated, it will be modified at each
-  function call (not re-entrant).
+  character. Both strings are stored in the buffer provided by the
+  caller, usually on its stack, so that the function is re-entrant.
  */
 /*--------------------------------------------------------------------------*/
-int iniparser_split(char *q, char ** s, char ** k)
+int iniparser_split(char *q, char * l, char ** s, char ** k)
 {
     char       * section, * key ;
 
-    if (q==NULL || s==NULL || k==NULL) {
+    if (q==NULL || l==NULL || s==NULL || k==NULL) {
         return -1 ;
     }
 
-    section = strlwc(q);
+    section = strlwc(q, l);
     if ((key = strchr(section, ':')) != NULL) {
         (*key++) = '\0';
     } else {
@@ -128,6 +456,248 @@ int iniparser_split(char *q, char ** s, char ** k)
     return 0 ;
 }
 
+/* Does nothing: overlays do not own their base */
+static void iniparser_layer_free(void * p)
+{
+    (void)p ;
+}
+
+/* Returns the entry of key in d, ignoring case, or if d is an overlay */
+/* without it, in its bases. Returns NULL if the key is removed. */
+static entry_t * iniparser_layer_find(dictionary * d, const char * key,
+                                      size_t len)
+{
+    entry_t    * e ;
+
+    while ((e = dictionary_find_ci(d, key, len)) == NULL && ini_layer(d)) {
+        d = ini_layer_base(d) ;
+    }
+    return (e && !ini_removed(e)) ? e : NULL ;
+}
+
+/* Returns the range of the iterator of d, its bases included */
+static int iniparser_layer_span(dictionary * d)
+{
+    int     n = 0 ;
+
+    for ( ; ini_layer(d) ; d = ini_layer_base(d)) {
+        n += d->end ;
+    }
+    return n + d->end ;
+}
+
+/* Iterates over the entries visible in d as dictionary_next() does: */
+/* if d is an overlay, the entries of its base in their order, each one */
+/* replaced by the entry of d of the same key if any, then the other */
+/* entries of d. Removed keys are skipped. */
+static entry_t * iniparser_layer_next(dictionary * d, int * it)
+{
+    dictionary * b ;
+    entry_t    * e, * o ;
+    int          span, j ;
+
+    if (!ini_layer(d) || *it < 0) {
+        return dictionary_next(d, it) ;
+    }
+    b = ini_layer_base(d) ;
+    span = iniparser_layer_span(b) ;
+    while (*it < span) {
+        if ((e = iniparser_layer_next(b, it)) == NULL) {
+            *it = span ;
+            break ;
+        }
+        if ((o = dictionary_find_ci(d, e->key, strlen(e->key))) != NULL) {
+            e = o ;
+        }
+        if (!ini_removed(e)) {
+            return e ;
+        }
+    }
+    for (j = *it - span ; (o = dictionary_next(d, &j)) != NULL ; ) {
+        if (!ini_removed(o) &&
+            iniparser_layer_find(b, o->key, strlen(o->key)) == NULL) {
+            *it = span + j ;
+            return o ;
+        }
+    }
+    *it = span + j ;
+    return NULL ;
+}
+
+/* Returns the number of entries visible in d */
+static int iniparser_layer_count(dictionary * d)
+{
+    dictionary * b ;
+    entry_t    * e ;
+    int          i, n ;
+
+    if (!ini_layer(d)) {
+        return d->n ;
+    }
+    b = ini_layer_base(d) ;
+    n = iniparser_layer_count(b) ;
+    for (i=0 ; (e = dictionary_next(d, &i)) != NULL ; ) {
+        if (iniparser_layer_find(b, e->key, strlen(e->key)) != NULL) {
+            n -= ini_removed(e) ;
+        } else {
+            n += !ini_removed(e) ;
+        }
+    }
+    return n ;
+}
+
+/* Returns the section called name in d, given its length and its hash */
+/* for d, or NULL. A pending section is parsed first. */
+static dictionary * iniparser_getsec(dictionary * d, char * name, size_t len,
+                                     unsigned hash)
+{
+    entry_t    * e ;
+
+    if ((e = dictionary_find_h(d, name, len, hash)) == NULL && ini_layer(d)) {
+        e = iniparser_layer_find(ini_layer_base(d), name, len) ;
+    }
+    return e ? ini_section(d, e) : NULL ;
+}
+
+/* Returns the section called name in d to modify, given its length, or */
+/* NULL. The first time a section of the base of an overlay is to be */
+/* modified, the overlay gets an overlay of the section. */
+static dictionary * iniparser_modsec(dictionary * d, char * name, size_t len)
+{
+    dictionary * sd ;
+    entry_t    * e ;
+
+    if ((e = dictionary_find_h(d, name, len,
+                               dictionary_hashn(d, name, len))) != NULL) {
+        return ini_section(d, e) ;
+    }
+    if (!ini_layer(d) ||
+        (e = iniparser_layer_find(ini_layer_base(d), name, len)) == NULL) {
+        return NULL ;
+    }
+    if ((sd = dictionary_new_child(d, 0)) == NULL) {
+        return NULL ;
+    }
+    sd->aux = e->val ;
+    sd->aux_free = iniparser_layer_free ;
+    if (dictionary_set(d, name, sd) != 0) {
+        dictionary_del(sd);
+        return NULL ;
+    }
+    return sd ;
+}
+
+/* Removes key from the section sd. A key of the base of an overlay */
+/* section is hidden instead. */
+static void iniparser_remove(dictionary * sd, char * key)
+{
+    entry_t    * e ;
+    size_t       len = strlen(key) ;
+
+    if (!ini_layer(sd) ||
+        iniparser_layer_find(ini_layer_base(sd), key, len) == NULL) {
+        dictionary_unset(sd, key);
+    } else if (dictionary_set(sd, key, NULL) == 0 &&
+               (e = dictionary_find_ci(sd, key, len)) != NULL) {
+        e->flags |= INI_REMOVED ;
+    }
+}
+
+/* Releases the section directory of a flat dictionary */
+static void iniparser_flat_free(void * p)
+{
+    dictionary_del((dictionary *)p);
+}
+
+/* Makes the empty dictionary d flat: keys are stored in d itself as */
+/* "section:key", and section names in a directory. Returns 0 if Ok. */
+static int iniparser_flat_new(dictionary * d)
+{
+    dictionary * dir ;
+
+    if ((dir = dictionary_new_child(d, 0)) == NULL) {
+        return -1 ;
+    }
+    /* Section names are not shared: the pool may go first */
+    dir->pool = NULL ;
+    d->aux = dir ;
+    d->aux_free = iniparser_flat_free ;
+    return 0 ;
+}
+
+/* Adds the lowercase section called name to the directory of the flat */
+/* dictionary d if it is not there yet, returns 0 if Ok. Names with a */
+/* colon are refused: keys are split at their first colon, and "a:b" in */
+/* section "s" would be the same key as "b" in section "s:a". */
+static int iniparser_flat_add(dictionary * d, char * name, size_t len)
+{
+    dictionary * dir = ini_flat_dir(d) ;
+
+    if (memchr(name, ':', len) != NULL) {
+        return -1 ;
+    }
+    if (dictionary_find_h(dir, name, len,
+                          dictionary_hashn(dir, name, len)) != NULL) {
+        return 0 ;
+    }
+    return dictionary_set(dir, name, NULL) ;
+}
+
+/* Returns the directory entry of the section of the flat key k, the */
+/* name before its first colon */
+static entry_t * iniparser_flat_section(dictionary * d, char * k)
+{
+    dictionary * dir = ini_flat_dir(d) ;
+    char       * c ;
+
+    if ((c = strchr(k, ':')) == NULL) {
+        return NULL ;
+    }
+    return dictionary_find_h(dir, k, (size_t)(c - k),
+                             dictionary_hashn(dir, k, (size_t)(c - k))) ;
+}
+
+/* Groups the entries of the flat dictionary d by section: on success, */
+/* the indexes of the entries of the i-th directory slot are stored in */
+/* (*idx)[(*start)[i]] to (*idx)[(*start)[i+1]-1], in the order they */
+/* were added in. Returns 0 if Ok, -1 if memory cannot be allocated; */
+/* both arrays are then NULL, else they are freed by the caller. */
+static int iniparser_flat_groups(dictionary * d, int ** idx, int ** start)
+{
+    dictionary * dir = ini_flat_dir(d) ;
+    entry_t    * e, * s ;
+    int        * sec, i, j ;
+
+    *idx = (int *)malloc((d->end + 1) * sizeof(int)) ;
+    *start = (int *)calloc(dir->end + 2, sizeof(int)) ;
+    sec = (int *)malloc((d->end + 1) * sizeof(int)) ;
+    if (*idx == NULL || *start == NULL || sec == NULL) {
+        free(*idx) ;
+        free(*start) ;
+        free(sec) ;
+        *idx = *start = NULL ;
+        return -1 ;
+    }
+    /* Counting sort on the directory slot of each entry */
+    for (i = 0 ; (e = dictionary_next(d, &i)) != NULL ; ) {
+        s = iniparser_flat_section(d, e->key) ;
+        sec[i-1] = s ? (int)(s - dir->e) : -1 ;
+        if (s != NULL) {
+            (*start)[sec[i-1] + 2]++ ;
+        }
+    }
+    for (j = 2 ; j <= dir->end + 1 ; j++) {
+        (*start)[j] += (*start)[j-1] ;
+    }
+    for (i = 0 ; (e = dictionary_next(d, &i)) != NULL ; ) {
+        if (sec[i-1] >= 0) {
+            (*idx)[(*start)[sec[i-1] + 1]++] = i - 1 ;
+        }
+    }
+    free(sec) ;
+    return 0 ;
+}
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Get number of sections in a dictionary
@@ -149,7 +719,7 @@ int iniparser_split(char *q, char ** s, char ** k)
 int iniparser_getnsec(dictionary * d)
 {
     if (d==NULL) return -1 ;
-    return d->n ;
+    return ini_flat(d) ? ini_flat_dir(d)->n : iniparser_layer_count(d) ;
 }
 
 /*-------------------------------------------------------------------------*/
@@ -161,26 +731,150 @@ int iniparser_getnsec(dictionary * d)
 
   This function locates the n-th section in a dictionary and returns
   its name as a pointer to a string statically allocated inside the
-  dictionary. Do not free or modify the returned string!
+  dictionary. Do not free or modify the returned string! Sections are
+  numbered in the order they were added in, and each call takes
+  constant time without modifying the dictionary.
 
   This function returns NULL in case of error.
  */
 /*--------------------------------------------------------------------------*/
 char * iniparser_getsecname(dictionary * d, int n)
 {
-    int i, j ;
+    entry_t * e ;
+    int       i = 0 ;
+
+    if (d != NULL && ini_flat(d)) {
+        d = ini_flat_dir(d) ;
+    }
+    if (d != NULL && ini_layer(d) && n >= 0) {
+        while ((e = iniparser_layer_next(d, &i)) != NULL && n-- > 0)
+            ;
+        return e ? e->key : NULL ;
+    }
+    if ((e = dictionary_entry(d, n)) == NULL) return NULL ;
+    return e->key ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Iterate over the sections of a dictionary.
+  @param    d   Dictionary to examine
+  @param    it  Iterator, to set to 0 before the first call
+  @return   Name of the next section, or NULL at the end
+
+  This function returns the section names of a dictionary in the
+  order they were added in, one per call:
+
+  @code
+  int    it = 0 ;
+  char * sec ;
+
+  while ((sec = iniparser_sec_iter(d, &it)) != NULL) {
+      printf("[%s]\n", sec);
+  }
+  @endcode
+
+  Only live sections are visited and the dictionary is not modified.
+  Do not free or modify the returned string!
+ */
+/*--------------------------------------------------------------------------*/
+char * iniparser_sec_iter(dictionary * d, int * it)
+{
+    entry_t * e ;
+
+    if (d != NULL && ini_flat(d)) {
+        d = ini_flat_dir(d) ;
+    }
+    if ((e = iniparser_layer_next(d, it)) == NULL) return NULL ;
+    return e->key ;
+}
+
+/* iniparser_key_iter() for a flat dictionary: the whole dictionary is */
+/* scanned for the keys of section */
+static char * iniparser_key_iter_flat(dictionary * d, char * section,
+                                      int * it, char ** val)
+{
+    entry_t    * s, * e ;
+    size_t       i, n = strlen(section) ;
+
+    if ((s = dictionary_find_ci(ini_flat_dir(d), section, n)) == NULL) {
+        return NULL ;
+    }
+    while ((e = dictionary_next(d, it)) != NULL) {
+        for (i = 0 ; i < n && e->key[i] == s->key[i] ; i++)
+            ;
+        if (i == n && e->key[n] == ':' &&
+            (strchr(e->key + n + 1, ':') == NULL ||
+             iniparser_flat_section(d, e->key) == s)) {
+            if (val != NULL) {
+                *val = (char *)e->val ;
+            }
+            return e->key + n + 1 ;
+        }
+    }
+    return NULL ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Iterate over the keys of a section.
+  @param    d       Dictionary to examine
+  @param    section Section name
+  @param    it      Iterator, to set to 0 before the first call
+  @param    val     Where to store the value of the key, or NULL
+  @return   Name of the next key in section, or NULL at the end
+
+  This function returns the key names of a section in the order they
+  were added in, one per call, as iniparser_sec_iter() does for
+  sections. Keys are returned without the section name, and their
+  value is stored in val when it is not NULL. Do not free or modify
+  the returned strings!
+
+  This function returns NULL if the section cannot be found.
+ */
+/*--------------------------------------------------------------------------*/
+char * iniparser_key_iter(dictionary * d, char * section, int * it,
+                          char ** val)
+{
+    dictionary * sd ;
+    entry_t    * e ;
+
+    if (d==NULL || section==NULL) return NULL ;
+    if (ini_flat(d)) {
+        return iniparser_key_iter_flat(d, section, it, val) ;
+    }
+    e = iniparser_layer_find(d, section, strlen(section)) ;
+    sd = e ? ini_section(d, e) : NULL ;
+    if (sd == NULL || (e = iniparser_layer_next(sd, it)) == NULL) {
+        return NULL ;
+    }
+    if (val != NULL) {
+        *val = (char *)e->val ;
+    }
+    return e->key ;
+}
 
-    if (d==NULL || n<0 || n > d->n) return NULL ;
+/* iniparser_dump() for a flat dictionary, keys grouped by section */
+static void iniparser_dump_flat(dictionary * d, FILE * f)
+{
+    int       i, j, * idx, * start ;
+    entry_t * k ;
 
-    for (i=0, j=0 ; i<d->size ; i++) {
-        if (d->e[i].key) {
-            if(j == n) {
-                break;
+    if (iniparser_flat_groups(d, &idx, &start) != 0) {
+        return ;
+    }
+    for (i=0 ; i<ini_flat_dir(d)->end ; i++) {
+        for (j=start[i] ; j<start[i+1] ; j++) {
+            k = &d->e[idx[j]] ;
+            if (k->val!=NULL) {
+                fprintf(f, "[%s]=[%s]\n", k->key, (char*)k->val);
+            } else {
+                fprintf(f, "[%s]=UNDEF\n", k->key);
             }
-            j++;
         }
     }
-    return d->e[i].key ;
+    free(idx) ;
+    free(start) ;
 }
 
 /*-------------------------------------------------------------------------*/
@@ -198,22 +892,23 @@ char * iniparser_getsecname(dictionary * d, int n)
 /*--------------------------------------------------------------------------*/
 void iniparser_dump(dictionary * d, FILE * f)
 {
-    int     i, j ;
+    int       i, j ;
+    entry_t * s, * k ;
 
     if (d==NULL || f==NULL) return ;
-    for (i=0 ; i<d->size ; i++) {
-        if (d->e[i].key==NULL)
-            continue ;
-        if (d->e[i].val!=NULL) {
-            dictionary *sd = (dictionary *)d->e[i].val;
-            for (j=0 ; j<sd->size ; j++) {
-                if (d->e[j].key==NULL)
-                    continue ;
-                if (sd->e[j].val!=NULL) {
-                    fprintf(f, "[%s:%s]=[%s]\n", d->e[i].key,
-                            sd->e[j].key, (char*)sd->e[j].val);
+    if (ini_flat(d)) {
+        iniparser_dump_flat(d, f) ;
+        return ;
+    }
+    for (i=0 ; (s = iniparser_layer_next(d, &i)) != NULL ; ) {
+        if (ini_section(d, s)!=NULL) {
+            dictionary *sd = (dictionary *)s->val;
+            for (j=0 ; (k = iniparser_layer_next(sd, &j)) != NULL ; ) {
+                if (k->val!=NULL) {
+                    fprintf(f, "[%s:%s]=[%s]\n", s->key,
+                            k->key, (char*)k->val);
                 } else {
-                    fprintf(f, "[%s:%s]=UNDEF\n", d->e[i].key, sd->e[j].key);
+                    fprintf(f, "[%s:%s]=UNDEF\n", s->key, k->key);
                 }
             }
         }
@@ -221,69 +916,490 @@ void iniparser_dump(dictionary * d, FILE * f)
     return ;
 }
 
-/*-------------------------------------------------------------------------*/
-/**
-  @brief    Save a dictionary to a loadable ini file
-  @param    d   Dictionary to dump
-  @param    f   Opened file pointer to dump to
-  @return   void
-
-  This function dumps a given dictionary into a loadable ini file.
-  It is Ok to specify @c stderr or @c stdout as output files.
- */
-/*--------------------------------------------------------------------------*/
-void iniparser_dump_ini(dictionary * d, FILE * f)
+/* Writes the buffered output, returns -1 if more output must be dropped */
+static int ini_flush(ini_out * o)
 {
-    int     i, j ;
+    size_t      done = 0 ;
+    ssize_t     n ;
 
-    for (i=0 ; i<d->size ; i++) {
-        if (d->e[i].key==NULL)
-            continue ;
-        if(d->e[i].key[0] != '\0') {
-            fprintf(f, "\n[%s]\n", d->e[i].key);
+    if (o->err) {
+        return -1 ;
+    }
+    if (o->f != NULL) {
+        if (fwrite(o->buf, 1, o->len, o->f) != o->len) {
+            o->err = 1 ;
         }
-        if (d->e[i].val!=NULL) {
-            dictionary *sd = (dictionary *)d->e[i].val;
-            for (j=0 ; j<sd->size ; j++) {
-                if (d->e[j].key==NULL)
+    } else if (o->fd >= 0) {
+        while (done < o->len) {
+            if ((n = write(o->fd, o->buf + done, o->len - done)) < 0) {
+                if (errno == EINTR) {
                     continue ;
-                fprintf(f, "%-30s = %s\n", sd->e[j].key,
-                        sd->e[j].val ? (char *)sd->e[j].val : "");
+                }
+                o->err = 1 ;
+                break ;
             }
+            done += (size_t)n ;
         }
+    } else {
+        /* Memory output: the buffer stays full */
+        o->err = 1 ;
     }
-
-    fprintf(f, "\n");
-    return ;
+    if (o->err) {
+        return -1 ;
+    }
+    o->len = 0 ;
+    return 0 ;
 }
 
-/*-------------------------------------------------------------------------*/
-/**
-  @brief    Get the string associated to a key
-  @param    d       Dictionary to search
-  @param    key     Key string to look for
-  @param    def     Default value to return if key not found.
-  @return   pointer to statically allocated character string
+/* Appends n bytes of s to the output */
+static void ini_put(ini_out * o, const char * s, size_t n)
+{
+    size_t      m ;
 
-  This function queries a dictionary for a key. A key as read from an
-  ini file is given as "section:key". If the key cannot be found,
+    o->total += n ;
+    while (n > 0) {
+        if (o->len == o->cap && ini_flush(o) < 0) {
+            return ;
+        }
+        m = (n < o->cap - o->len) ? n : o->cap - o->len ;
+        memcpy(o->buf + o->len, s, m) ;
+        o->len += m ;
+        s += m ;
+        n -= m ;
+    }
+}
+
+/* Appends n blanks to the output */
+static void ini_pad(ini_out * o, size_t n)
+{
+    static const char   blanks[] = "                                " ;
+    size_t              m ;
+
+    for ( ; n > 0 ; n -= m) {
+        m = (n < sizeof(blanks) - 1) ? n : sizeof(blanks) - 1 ;
+        ini_put(o, blanks, m) ;
+    }
+}
+
+/* Writes a key line of a section to o */
+static void ini_dump_key(ini_out * o, entry_t * k, size_t skip)
+{
+    size_t      n ;
+
+    n = strlen(k->key + skip) ;
+    ini_put(o, k->key + skip, n) ;
+    ini_pad(o, n < INI_KEYWIDTH ? INI_KEYWIDTH - n : 0) ;
+    ini_put(o, " = ", 3) ;
+    if (k->val != NULL) {
+        ini_put(o, (char *)k->val, strlen((char *)k->val)) ;
+    }
+    ini_put(o, "\n", 1) ;
+}
+
+/* Writes the flat dictionary d to o as ini_dump() does */
+static void ini_dump_flat(dictionary * d, ini_out * o)
+{
+    dictionary * dir = ini_flat_dir(d) ;
+    int          i, j, * idx, * start ;
+    size_t       n ;
+
+    if (iniparser_flat_groups(d, &idx, &start) != 0) {
+        o->err = 1 ;
+        return ;
+    }
+    for (i=0 ; i<dir->end ; i++) {
+        if (dir->e[i].key == NULL) {
+            continue ;
+        }
+        n = strlen(dir->e[i].key) ;
+        if (n > 0) {
+            ini_put(o, "\n[", 2) ;
+            ini_put(o, dir->e[i].key, n) ;
+            ini_put(o, "]\n", 2) ;
+        }
+        for (j=start[i] ; j<start[i+1] ; j++) {
+            ini_dump_key(o, &d->e[idx[j]], n + 1) ;
+        }
+    }
+    free(idx) ;
+    free(start) ;
+}
+
+/* Writes d to o as iniparser_dump_ini() documents it */
+static void ini_dump(dictionary * d, ini_out * o)
+{
+    int         i, j ;
+    entry_t   * s, * k ;
+
+    if (d != NULL && ini_flat(d)) {
+        ini_dump_flat(d, o) ;
+        ini_put(o, "\n", 1) ;
+        return ;
+    }
+    for (i=0 ; (s = iniparser_layer_next(d, &i)) != NULL ; ) {
+        if(s->key[0] != '\0') {
+            ini_put(o, "\n[", 2) ;
+            ini_put(o, s->key, strlen(s->key)) ;
+            ini_put(o, "]\n", 2) ;
+        }
+        if (ini_section(d, s)!=NULL) {
+            dictionary *sd = (dictionary *)s->val;
+            for (j=0 ; (k = iniparser_layer_next(sd, &j)) != NULL ; ) {
+                ini_dump_key(o, k, 0) ;
+            }
+        }
+    }
+    ini_put(o, "\n", 1) ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Save a dictionary to a loadable ini file
+  @param    d   Dictionary to dump
+  @param    f   Opened file pointer to dump to
+  @return   void
+
+  This function dumps a given dictionary into a loadable ini file.
+  It is Ok to specify @c stderr or @c stdout as output files.
+  The output is formatted in a buffer of its own and handed to the
+  stream by blocks.
+ */
+/*--------------------------------------------------------------------------*/
+void iniparser_dump_ini(dictionary * d, FILE * f)
+{
+    char        buf[INI_WRITESZ] ;
+    ini_out     o ;
+
+    if (f == NULL) return ;
+
+    memset(&o, 0, sizeof(o)) ;
+    o.buf = buf ;
+    o.cap = sizeof(buf) ;
+    o.f = f ;
+    o.fd = -1 ;
+    ini_dump(d, &o) ;
+    ini_flush(&o) ;
+    return ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Save a dictionary to a file descriptor
+  @param    d   Dictionary to dump
+  @param    fd  File descriptor to write to
+  @return   int 0 if Ok, -1 on write error.
+
+  This function writes the same output as iniparser_dump_ini(), with
+  write() calls of 16 kB blocks, without going through stdio.
+  The descriptor may be a socket or a pipe: short writes are resumed.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_dump_ini_fd(dictionary * d, int fd)
+{
+    char        buf[INI_WRITESZ] ;
+    ini_out     o ;
+
+    if (fd < 0) return -1 ;
+
+    memset(&o, 0, sizeof(o)) ;
+    o.buf = buf ;
+    o.cap = sizeof(buf) ;
+    o.fd = fd ;
+    ini_dump(d, &o) ;
+    return ini_flush(&o) ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Save a dictionary to a memory buffer
+  @param    d       Dictionary to dump
+  @param    buf     Buffer to write to, may be NULL if size is 0
+  @param    size    Size of buf
+  @return   Length of the whole output, not counting the final NUL.
+
+  This function writes the same output as iniparser_dump_ini() to buf,
+  as snprintf() does: at most size-1 characters are stored, followed by
+  a NUL character. A return value of size or more means the output was
+  truncated; calling the function with a size of 0 measures it.
+ */
+/*--------------------------------------------------------------------------*/
+size_t iniparser_dump_ini_to_buffer(dictionary * d, char * buf, size_t size)
+{
+    ini_out     o ;
+
+    memset(&o, 0, sizeof(o)) ;
+    o.buf = buf ;
+    o.cap = size ? size - 1 : 0 ;
+    o.fd = -1 ;
+    ini_dump(d, &o) ;
+    if (size > 0) {
+        buf[o.len] = '\0' ;
+    }
+    return o.total ;
+}
+
+/* iniparser_find() for a flat dictionary: the names are joined on the */
+/* stack, or in the heap if they are long */
+static entry_t * iniparser_find_flat(dictionary * d, const char * s,
+                                     size_t slen, const char * k,
+                                     size_t klen)
+{
+    char         buf[2 * ASCIILINESZ + 2], * p = buf ;
+    entry_t    * e ;
+
+    if (memchr(s, ':', slen) != NULL) {
+        /* No such section: the key would be one of another section */
+        return NULL ;
+    }
+    if (slen + klen + 1 > sizeof(buf) &&
+        (p = (char *)malloc(slen + klen + 1)) == NULL) {
+        return NULL ;
+    }
+    memcpy(p, s, slen) ;
+    p[slen] = ':' ;
+    memcpy(p + slen + 1, k, klen) ;
+    e = dictionary_find_ci(d, p, slen + klen + 1) ;
+    if (p != buf) {
+        free(p) ;
+    }
+    return (e && e->val) ? e : NULL ;
+}
+
+/* Returns the entry of key in section of d if it has a value, or NULL. */
+/* Both names are looked up ignoring case, without being copied. */
+static entry_t * iniparser_find(dictionary * d, const char * s, size_t slen,
+                                const char * k, size_t klen)
+{
+    entry_t    * e ;
+
+    dictionary * sd ;
+
+    if (ini_flat(d)) {
+        return iniparser_find_flat(d, s, slen, k, klen) ;
+    }
+    if ((e = iniparser_layer_find(d, s, slen)) == NULL ||
+        (sd = ini_section(d, e)) == NULL) {
+        return NULL ;
+    }
+    e = iniparser_layer_find(sd, k, klen) ;
+    return (e && e->val) ? e : NULL ;
+}
+
+/* Returns the entry of "section:key" in d if it has a value, or NULL */
+static entry_t * iniparser_entry(dictionary * d, char * key)
+{
+    entry_t   * e ;
+    size_t      n, colon = 0 ;
+
+    if (d==NULL || key==NULL)
+        return NULL ;
+
+    /* Keys are truncated to ASCIILINESZ characters, as by strlwc() */
+    for (n = 0 ; n < ASCIILINESZ && key[n] ; n++) {
+        if (key[n] == ':' && colon == 0) {
+            colon = n + 1 ;
+        }
+    }
+    if (colon == 0) {
+        return NULL ;
+    }
+    if (ini_flat(d)) {
+        /* The key is stored as it is given */
+        e = dictionary_find_ci(d, key, n) ;
+        return (e && e->val) ? e : NULL ;
+    }
+    return iniparser_find(d, key, colon - 1, key + colon, n - colon) ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a key
+  @param    d       Dictionary to search
+  @param    key     Key string to look for
+  @param    def     Default value to return if key not found.
+  @return   pointer to statically allocated character string
+
+  This function queries a dictionary for a key. A key as read from an
+  ini file is given as "section:key". If the key cannot be found,
   the pointer passed as 'def' is returned.
   The returned char pointer is pointing to a string allocated in
-  the dictionary, do not free or modify it.
+  the dictionary, do not free or modify it. It stays valid until the
+  key is set again or removed, or the dictionary is freed.
  */
 /*--------------------------------------------------------------------------*/
 char * iniparser_getstring(dictionary * d, char * key, char * def)
 {
-    dictionary * sd ;
-    char       * s, * k ;
+    entry_t    * e ;
 
-    if (d==NULL || key==NULL || iniparser_split(key, &s, &k) < 0)
-        return def ;
+    return (e = iniparser_entry(d, key)) != NULL ? (char *)e->val : def ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a key in a section
+  @param    d       Dictionary to search
+  @param    section Section name
+  @param    key     Key name in section
+  @return   Pointer to the value, or NULL if the key cannot be found.
+
+  This function is equivalent to iniparser_getstring() with the key
+  given as section and key names instead of "section:key", and NULL as
+  default. Both names are matched ignoring case. They are not copied:
+  this is the fastest way to look up a key without a handle.
+ */
+/*--------------------------------------------------------------------------*/
+char * iniparser_get(dictionary * d, const char * section, const char * key)
+{
+    entry_t    * e ;
+
+    if (d==NULL || section==NULL || key==NULL)
+        return NULL ;
+
+    e = iniparser_find(d, section, strlen(section), key, strlen(key)) ;
+    return e ? (char *)e->val : NULL ;
+}
+
+/* Parses an integer as strtol(s, NULL, 0) does, without range limit: */
+/* stores its magnitude in mag and returns its INI_CACHE_* flags */
+static unsigned iniparser_parse_int(const char * s, uint64_t * mag)
+{
+    unsigned    f = INI_CACHE_NUM ;
+    uint64_t    m = 0 ;
+    unsigned    base = 10, d ;
+    int         any = 0 ;
 
-    if((sd = (dictionary *)dictionary_get(d, s, NULL)) != NULL) {
-        return (char *)dictionary_get(sd, k, def);
+    while (iniscan_isblank(*s)) {
+        s++ ;
     }
-    return def ;
+    if (*s == '-' || *s == '+') {
+        if (*s++ == '-') {
+            f |= INI_CACHE_NEG ;
+        }
+    }
+    if (s[0] == '0') {
+        if ((s[1] == 'x' || s[1] == 'X') && isxdigit((unsigned char)s[2])) {
+            base = 16 ;
+            s += 2 ;
+        } else {
+            base = 8 ;
+        }
+    }
+    for ( ; ; s++) {
+        if (*s >= '0' && *s <= '9') {
+            d = (unsigned)(*s - '0') ;
+        } else if (*s >= 'a' && *s <= 'f') {
+            d = (unsigned)(*s - 'a') + 10 ;
+        } else if (*s >= 'A' && *s <= 'F') {
+            d = (unsigned)(*s - 'A') + 10 ;
+        } else {
+            break ;
+        }
+        if (d >= base) {
+            break ;
+        }
+        any = 1 ;
+        if (m > (UINT64_MAX - d) / base) {
+            f |= INI_CACHE_BIG ;
+        } else {
+            m = m * base + d ;
+        }
+    }
+    while (iniscan_isblank(*s)) {
+        s++ ;
+    }
+    if (!any || *s) {
+        f |= INI_CACHE_BAD ;
+    }
+    *mag = m ;
+    return f ;
+}
+
+/* Returns the INI_CACHE_* flags of the integer value of an entry, */
+/* and its magnitude in mag, converting the value on first use */
+static unsigned iniparser_number(entry_t * e, uint64_t * mag)
+{
+    unsigned    f = __atomic_load_n(&e->flags, __ATOMIC_ACQUIRE) ;
+
+    if (f & INI_CACHE_NUM) {
+        *mag = __atomic_load_n(&e->num, __ATOMIC_RELAXED) ;
+        return f ;
+    }
+    f = iniparser_parse_int((char *)e->val, mag) ;
+    /* Concurrent readers converting the same value store the same */
+    /* cache, which is published by the flags */
+    __atomic_store_n(&e->num, *mag, __ATOMIC_RELAXED);
+    __atomic_fetch_or(&e->flags, f, __ATOMIC_RELEASE);
+    return f ;
+}
+
+/* Returns the signed value of an integer, clamped, setting err */
+static int64_t iniparser_int64(unsigned f, uint64_t m, int * err)
+{
+    const uint64_t  lim = (uint64_t)1 << 63 ;
+
+    *err = (f & INI_CACHE_BAD) ? EINVAL : 0 ;
+    if (f & INI_CACHE_NEG) {
+        if ((f & INI_CACHE_BIG) || m > lim) {
+            *err = *err ? *err : ERANGE ;
+            m = lim ;
+        }
+        /* -(lim-1) - 1 avoids overflowing on the lowest value */
+        return m == lim ? -(int64_t)(lim - 1) - 1 : -(int64_t)m ;
+    }
+    if ((f & INI_CACHE_BIG) || m > lim - 1) {
+        *err = *err ? *err : ERANGE ;
+        m = lim - 1 ;
+    }
+    return (int64_t)m ;
+}
+
+/* Returns the unsigned value of an integer, clamped, setting err */
+static uint64_t iniparser_uint64(unsigned f, uint64_t m, int * err)
+{
+    *err = (f & INI_CACHE_BAD) ? EINVAL : 0 ;
+    if ((f & INI_CACHE_NEG) && m > 0) {
+        *err = *err ? *err : ERANGE ;
+        return 0 ;
+    }
+    if (f & INI_CACHE_BIG) {
+        *err = *err ? *err : ERANGE ;
+        return UINT64_MAX ;
+    }
+    return m ;
+}
+
+/* Returns the value of an entry as iniparser_getint() converts it: */
+/* clamped to a long as by strtol(), then cast to an int */
+static int iniparser_int(entry_t * e)
+{
+    uint64_t    m ;
+    int64_t     v ;
+    unsigned    f ;
+    int         err ;
+
+    f = iniparser_number(e, &m) ;
+    v = iniparser_int64(f, m, &err) ;
+    if (v > (int64_t)LONG_MAX) {
+        v = LONG_MAX ;
+    } else if (v < (int64_t)LONG_MIN) {
+        v = LONG_MIN ;
+    }
+    return (int)(long)v ;
+}
+
+/* Returns the value of an entry converted by atof(), cached */
+static double iniparser_double(entry_t * e)
+{
+    double      v ;
+
+    if (__atomic_load_n(&e->flags, __ATOMIC_ACQUIRE) & INI_CACHE_DBL) {
+        __atomic_load(&e->dbl, &v, __ATOMIC_RELAXED);
+        return v ;
+    }
+    v = atof((char *)e->val) ;
+    __atomic_store(&e->dbl, &v, __ATOMIC_RELAXED);
+    __atomic_fetch_or(&e->flags, INI_CACHE_DBL, __ATOMIC_RELEASE);
+    return v ;
 }
 
 /*-------------------------------------------------------------------------*/
@@ -306,20 +1422,22 @@ char * iniparser_getstring(dictionary * d, char * key, char * def)
   "042"     ->  34 (octal -> decimal)
   "0x42"    ->  66 (hexa  -> decimal)
 
-  Warning: the conversion may overflow in various ways. Conversion is
-  totally outsourced to strtol(), see the associated man page for overflow
-  handling.
+  Warning: the conversion may overflow in various ways. Values are
+  converted as by strtol(), see the associated man page for overflow
+  handling, then cast to an int. iniparser_getint64() reports overflows
+  instead.
+
+  The converted value is cached in the entry, until the value changes.
 
   Credits: Thanks to A. Becker for suggesting strtol()
  */
 /*--------------------------------------------------------------------------*/
 int iniparser_getint(dictionary * d, char * key, int notfound)
 {
-    char    *   str ;
+    entry_t *   e ;
 
-    str = iniparser_getstring(d, key, INI_INVALID_KEY);
-    if (str==INI_INVALID_KEY) return notfound ;
-    return (int)strtol(str, NULL, 0);
+    if ((e = iniparser_entry(d, key)) == NULL) return notfound ;
+    return iniparser_int(e);
 }
 
 /*-------------------------------------------------------------------------*/
@@ -333,15 +1451,37 @@ int iniparser_getint(dictionary * d, char * key, int notfound)
   This function queries a dictionary for a key. A key as read from an
   ini file is given as "section:key". If the key cannot be found,
   the notfound value is returned.
+
+  Values are converted as by atof(). The converted value is cached in
+  the entry, until the value changes.
  */
 /*--------------------------------------------------------------------------*/
 double iniparser_getdouble(dictionary * d, char * key, double notfound)
 {
-    char    *   str ;
+    entry_t *   e ;
+
+    if ((e = iniparser_entry(d, key)) == NULL) return notfound ;
+    return iniparser_double(e);
+}
+
+/* Converts the value of an entry to a boolean, see */
+/* iniparser_getboolean(), caching the result */
+static int iniparser_boolean(entry_t * e, int notfound)
+{
+    unsigned    f = __atomic_load_n(&e->flags, __ATOMIC_ACQUIRE) ;
+    char      * c = (char *)e->val ;
 
-    str = iniparser_getstring(d, key, INI_INVALID_KEY);
-    if (str==INI_INVALID_KEY) return notfound ;
-    return atof(str);
+    if (!(f & INI_CACHE_BOOL)) {
+        f = INI_CACHE_BOOL ;
+        if (c[0]=='y' || c[0]=='Y' || c[0]=='1' || c[0]=='t' || c[0]=='T') {
+            f |= INI_CACHE_TRUE ;
+        } else if (c[0]=='n' || c[0]=='N' || c[0]=='0' || c[0]=='f' ||
+                   c[0]=='F') {
+            f |= INI_CACHE_FALSE ;
+        }
+        __atomic_fetch_or(&e->flags, f, __ATOMIC_RELEASE);
+    }
+    return (f & INI_CACHE_TRUE) ? 1 : (f & INI_CACHE_FALSE) ? 0 : notfound ;
 }
 
 /*-------------------------------------------------------------------------*/
@@ -378,319 +1518,3310 @@ double iniparser_getdouble(dictionary * d, char * key, double notfound)
 /*--------------------------------------------------------------------------*/
 int iniparser_getboolean(dictionary * d, char * key, int notfound)
 {
-    char    *   c ;
-    int         ret ;
+    entry_t *   e ;
 
-    c = iniparser_getstring(d, key, INI_INVALID_KEY);
-    if (c==INI_INVALID_KEY) return notfound ;
-    if (c[0]=='y' || c[0]=='Y' || c[0]=='1' || c[0]=='t' || c[0]=='T') {
-        ret = 1 ;
-    } else if (c[0]=='n' || c[0]=='N' || c[0]=='0' || c[0]=='f' || c[0]=='F') {
-        ret = 0 ;
-    } else {
-        ret = notfound ;
-    }
-    return ret;
+    if ((e = iniparser_entry(d, key)) == NULL) return notfound ;
+    return iniparser_boolean(e, notfound);
 }
 
 /*-------------------------------------------------------------------------*/
 /**
-  @brief    Finds out if a given entry exists in a dictionary
-  @param    ini     Dictionary to search
-  @param    entry   Name of the entry to look for
-  @return   integer 1 if entry exists, 0 otherwise
+  @brief    Get the string associated to a key, convert to a 64-bit int
+  @param    d Dictionary to search
+  @param    key Key string to look for
+  @param    notfound Value to return in case of error
+  @param    error Set to an error code, or NULL
+  @return   64-bit integer
 
-  Finds out if a given entry exists in the dictionary. Since sections
-  are stored as keys with NULL associated values, this is the only way
-  of querying for the presence of sections in a dictionary.
+  This function converts values as iniparser_getint() does, in decimal,
+  octal or hexadecimal, and reports what it could not convert. error is
+  set to:
+
+  - 0 if the value is an integer in range.
+  - EINVAL if the value holds no integer, or characters after it. The
+    integer it starts with is returned, or 0.
+  - ERANGE if the integer does not fit an int64_t. The nearest limit
+    is returned.
+  - ENOENT if the key cannot be found. notfound is returned.
+
+  The converted value is cached in the entry, until the value changes.
  */
 /*--------------------------------------------------------------------------*/
-int iniparser_find_entry(
-    dictionary  *   ini,
-    char        *   entry
-)
+int64_t iniparser_getint64(dictionary * d, char * key, int64_t notfound,
+                           int * error)
 {
-    int found=0 ;
-    if (iniparser_getstring(ini, entry, INI_INVALID_KEY)!=INI_INVALID_KEY) {
-        found = 1 ;
+    entry_t *   e ;
+    uint64_t    m ;
+    unsigned    f ;
+    int         err ;
+
+    if ((e = iniparser_entry(d, key)) == NULL) {
+        if (error) *error = ENOENT ;
+        return notfound ;
     }
-    return found ;
+    f = iniparser_number(e, &m) ;
+    notfound = iniparser_int64(f, m, &err) ;
+    if (error) *error = err ;
+    return notfound ;
 }
 
-int iniparser_set_val(dictionary * ini, char * section, char *key, char * val)
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a key, convert to an unsigned
+            64-bit int
+  @param    d Dictionary to search
+  @param    key Key string to look for
+  @param    notfound Value to return in case of error
+  @param    error Set to an error code, or NULL
+  @return   Unsigned 64-bit integer
+
+  This function is equivalent to iniparser_getint64() for unsigned
+  values: error is set to ERANGE for negative values, for which 0 is
+  returned, and for values above UINT64_MAX.
+ */
+/*--------------------------------------------------------------------------*/
+uint64_t iniparser_getuint64(dictionary * d, char * key, uint64_t notfound,
+                             int * error)
 {
-    dictionary   * sd;
+    entry_t *   e ;
+    uint64_t    m ;
+    unsigned    f ;
+    int         err ;
 
-    if (ini==NULL || section==NULL)
-        return -1 ;
+    if ((e = iniparser_entry(d, key)) == NULL) {
+        if (error) *error = ENOENT ;
+        return notfound ;
+    }
+    f = iniparser_number(e, &m) ;
+    m = iniparser_uint64(f, m, &err) ;
+    if (error) *error = err ;
+    return m ;
+}
 
-    if(!ini->dict) {
-        if(ini->n == 0) {
-            dictionary_policy(ini, 1);
-        } else {
-            return -1;
+/* Stores the value of setting s, from entry e or from the default of s */
+static void iniparser_store(const ini_setting * s, entry_t * e)
+{
+    entry_t     def ;
+    uint64_t    m ;
+    unsigned    f ;
+    int         err ;
+
+    if (e == NULL) {
+        if (s->def == NULL) {
+            return ;
         }
+        /* Defaults are converted as values, with their own cache */
+        memset(&def, 0, sizeof(def));
+        def.val = s->def ;
+        e = &def ;
     }
+    switch (s->type) {
+        case INI_TYPE_STRING:
+        *(char **)s->dest = (char *)e->val ;
+        break ;
 
-    if((sd = (dictionary *)dictionary_get(ini, section, NULL)) == NULL) {
-        if((sd = dictionary_new(0)) == NULL) {
-            return -1;
-        }
-        dictionary_set(ini, section, sd);
+        case INI_TYPE_INT:
+        *(int *)s->dest = iniparser_int(e) ;
+        break ;
+
+        case INI_TYPE_DOUBLE:
+        *(double *)s->dest = iniparser_double(e) ;
+        break ;
+
+        case INI_TYPE_BOOLEAN:
+        *(int *)s->dest = iniparser_boolean(e, *(int *)s->dest) ;
+        break ;
+
+        case INI_TYPE_INT64:
+        f = iniparser_number(e, &m) ;
+        *(int64_t *)s->dest = iniparser_int64(f, m, &err) ;
+        break ;
+
+        case INI_TYPE_UINT64:
+        f = iniparser_number(e, &m) ;
+        *(uint64_t *)s->dest = iniparser_uint64(f, m, &err) ;
+        break ;
+
+        default:
+        break ;
     }
+}
 
-    if(key) {
-        return dictionary_set(sd, key, val);
+/* Returns non-zero if two split section names are the same */
+#define ini_same_section(a, b) \
+    ((a) == NULL ? (b) == NULL : (b) != NULL && !strcmp((a), (b)))
+
+/* iniparser_lookup() for a flat dictionary: the keys of any batch of */
+/* settings are found together */
+static int iniparser_lookup_flat(dictionary * d, const ini_setting * s,
+                                 int n)
+{
+    char       * keys[INI_BATCH] ;
+    size_t       lens[INI_BATCH] ;
+    unsigned     hashes[INI_BATCH] ;
+    entry_t    * hits[INI_BATCH], * found[INI_BATCH] ;
+    int          which[INI_BATCH] ;
+    char         pool[INI_BATCH * 64 + ASCIILINESZ + 1] ;
+    char       * p ;
+    int          i, j, m, k, nfound = 0 ;
+
+    for (i = 0 ; i < n ; i += m) {
+        /* Lowercase a batch of settings, skipping keys without colon */
+        p = pool ;
+        for (m = k = 0 ; i + m < n && m < INI_BATCH &&
+                         pool + sizeof(pool) - p > ASCIILINESZ ; m++) {
+            found[m] = NULL ;
+            if (strlwc(s[i+m].key, p) != NULL && strchr(p, ':') != NULL) {
+                keys[k] = p ;
+                lens[k] = strlen(p) ;
+                hashes[k] = dictionary_hashn(d, p, lens[k]) ;
+                which[k] = m ;
+                p += lens[k++] + 1 ;
+            }
+        }
+        dictionary_find_n(d, keys, lens, hashes, hits, k);
+        for (j = 0 ; j < k ; j++) {
+            if (hits[j] != NULL && hits[j]->val != NULL) {
+                found[which[j]] = hits[j] ;
+            }
+        }
+        for (j = 0 ; j < m ; j++) {
+            nfound += found[j] != NULL ;
+            iniparser_store(&s[i+j], found[j]);
+        }
     }
-    return 0;
+    return nfound ;
 }
 
 /*-------------------------------------------------------------------------*/
 /**
-  @brief    Set an entry in a dictionary.
-  @param    ini     Dictionary to modify.
-  @param    entry   Entry to modify (entry name)
-  @param    val     New value to associate to the entry.
-  @return   int 0 if Ok, -1 otherwise.
+  @brief    Look up many keys at once.
+  @param    d   Dictionary to search
+  @param    s   Settings to resolve
+  @param    n   Number of settings
+  @return   Number of settings found in d, or -1 on error.
 
-  If the given entry can be found in the dictionary, it is modified to
-  contain the provided value. If it cannot be found, -1 is returned.
-  It is Ok to set val to NULL.
- */
+  This function stores the value of each "section:key" setting at its
+  destination, converted to its type as by the matching getter. When
+  the key cannot be found, the default of the setting is converted
+  instead; without default, the destination is left as it was. So is a
+  boolean destination when the value is neither true nor false.
+  Strings are not copied.
+
+  Settings are resolved by batches of consecutive settings of the same
+  section: the section is looked up once for the whole batch, and the
+  lookups of its keys are interleaved to hide memory latency. Tables
+  sorted by section, as ini files usually are, are resolved fastest.
+  Dictionaries loaded with INI_LOAD_FLAT resolve batches of any keys.
+  Conversion errors are not reported, see iniparser_getint64() for this.
+
+  @code
+  static int    port ;
+  static char * host ;
+
+  static const ini_setting settings[] = {
+      { "server:port", INI_TYPE_INT,    "8080",      &port },
+      { "server:host", INI_TYPE_STRING, "localhost", &host }
+  };
+
+  iniparser_lookup(ini, settings, 2);
+  @endcode
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_lookup(dictionary * d, const ini_setting * s, int n)
+{
+    char       * secs[INI_BATCH], * keys[INI_BATCH] ;
+    size_t       lens[INI_BATCH] ;
+    unsigned     hashes[INI_BATCH] ;
+    entry_t    * found[INI_BATCH] ;
+    char         pool[INI_BATCH * 64 + ASCIILINESZ + 1] ;
+    char       * p ;
+    int          i, j, m, nfound = 0 ;
+
+    dictionary * sd ;
+
+    if (d==NULL || (s==NULL && n>0))
+        return -1 ;
+    if (ini_flat(d))
+        return iniparser_lookup_flat(d, s, n) ;
+
+    for (i = 0 ; i < n ; i += m) {
+        /* Lowercase a batch of settings of the same section */
+        p = pool ;
+        for (m = 0 ; i + m < n && m < INI_BATCH &&
+                     pool + sizeof(pool) - p > ASCIILINESZ ; m++) {
+            if (iniparser_split(s[i+m].key, p, &secs[m], &keys[m]) < 0) {
+                secs[m] = keys[m] = NULL ;
+            }
+            if (m > 0 && !ini_same_section(secs[0], secs[m])) {
+                break ;
+            }
+            if (keys[m] != NULL) {
+                lens[m] = strlen(keys[m]) ;
+                p = keys[m] + lens[m] + 1 ;
+            }
+        }
+
+        /* Hash the keys of the batch, then find them together */
+        sd = secs[0] ? iniparser_getsec(d, secs[0], strlen(secs[0]),
+                                        dictionary_hashn(d, secs[0],
+                                                         strlen(secs[0])))
+                     : NULL ;
+        if (sd != NULL) {
+            for (j = 0 ; j < m ; j++) {
+                hashes[j] = dictionary_hashn(sd, keys[j], lens[j]) ;
+            }
+            dictionary_find_n(sd, keys, lens, hashes, found, m);
+            for (j = 0 ; j < m && ini_layer(sd) ; j++) {
+                if (found[j] == NULL && keys[j] != NULL) {
+                    found[j] = iniparser_layer_find(ini_layer_base(sd),
+                                                    keys[j], lens[j]) ;
+                }
+            }
+        }
+        for (j = 0 ; j < m ; j++) {
+            if (sd == NULL || (found[j] != NULL && found[j]->val == NULL)) {
+                found[j] = NULL ;
+            }
+            nfound += found[j] != NULL ;
+            iniparser_store(&s[i+j], found[j]);
+        }
+    }
+    return nfound ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Finds out if a given entry exists in a dictionary
+  @param    ini     Dictionary to search
+  @param    entry   Name of the entry to look for
+  @return   integer 1 if entry exists, 0 otherwise
+
+  Finds out if a given entry exists in the dictionary. Since sections
+  are stored as keys with NULL associated values, this is the only way
+  of querying for the presence of sections in a dictionary.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_find_entry(
+    dictionary  *   ini,
+    char        *   entry
+)
+{
+    int found=0 ;
+    if (iniparser_getstring(ini, entry, INI_INVALID_KEY)!=INI_INVALID_KEY) {
+        found = 1 ;
+    }
+    return found ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Compile a key for repeated lookups
+  @param    key     Key string to compile, as "section:key"
+  @return   Pointer to a newly allocated handle, NULL on error
+
+  This function normalizes and hashes a key once, so that the *_h
+  getters below can look it up without lowercasing, splitting or
+  hashing it again. A handle does not depend on any dictionary and can
+  be used with all of them, though dictionaries whose hashing was
+  changed by dictionary_hashing() need the names to be hashed again.
+  NULL is returned if key does not contain a colon or memory cannot be
+  allocated.
+
+  The returned handle must be freed using iniparser_key_free().
+ */
+/*--------------------------------------------------------------------------*/
+ini_key * iniparser_key_new(char * key)
+{
+    ini_key    * h ;
+    char       * s ;
+    size_t       i, len ;
+
+    if (key==NULL || strchr(key, ':')==NULL)
+        return NULL ;
+
+    len = strlen(key) ;
+    if ((h = (ini_key *)malloc(sizeof(ini_key) + 2 * (len + 1))) == NULL)
+        return NULL ;
+    h->full = (char *)(h + 1) ;
+    for (i=0 ; i<=len ; i++) {
+        h->full[i] = (char)tolower((int)(unsigned char)key[i]);
+    }
+    h->flen = len ;
+    h->fhash = dictionary_hashn(NULL, h->full, h->flen);
+    s = strcpy(h->full + len + 1, h->full) ;
+    h->section = s ;
+    h->key = strchr(s, ':') ;
+    *h->key++ = (char)0 ;
+    h->slen = strlen(h->section) ;
+    h->klen = strlen(h->key) ;
+    h->shash = dictionary_hashn(NULL, h->section, h->slen);
+    h->khash = dictionary_hashn(NULL, h->key, h->klen);
+    return h ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Free a key handle
+  @param    h   Handle returned by iniparser_key_new(), or NULL
+  @return   void
+ */
+/*--------------------------------------------------------------------------*/
+void iniparser_key_free(ini_key * h)
+{
+    free(h);
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a compiled key
+  @param    d       Dictionary to search
+  @param    h       Key handle returned by iniparser_key_new()
+  @param    def     Default value to return if key not found.
+  @return   pointer to statically allocated character string
+
+  This function is equivalent to iniparser_getstring() for the key h
+  was compiled from.
+ */
+/*--------------------------------------------------------------------------*/
+char * iniparser_getstring_h(dictionary * d, ini_key * h, char * def)
+{
+    dictionary * sd ;
+    entry_t    * e ;
+
+    if (d==NULL || h==NULL)
+        return def ;
+    if (ini_flat(d)) {
+        return (char *)dictionary_get_h(d, h->full, h->flen,
+                            ini_key_hash(d, h, full, flen, fhash), def);
+    }
+
+    sd = iniparser_getsec(d, h->section, h->slen,
+                          ini_key_hash(d, h, section, slen, shash));
+    if (sd != NULL && ini_layer(sd)) {
+        e = iniparser_layer_find(sd, h->key, h->klen) ;
+        return (e && e->val) ? (char *)e->val : def ;
+    }
+    if (sd != NULL) {
+        return (char *)dictionary_get_h(sd, h->key, h->klen,
+                            ini_key_hash(sd, h, key, klen, khash), def);
+    }
+    return def ;
+}
+
+/* Returns the entry of a compiled key in d if it has a value, or NULL */
+static entry_t * iniparser_entry_h(dictionary * d, ini_key * h)
+{
+    dictionary * sd ;
+    entry_t    * e ;
+
+    if (d==NULL || h==NULL)
+        return NULL ;
+
+    if (ini_flat(d)) {
+        e = dictionary_find_h(d, h->full, h->flen,
+                              ini_key_hash(d, h, full, flen, fhash));
+        return (e && e->val) ? e : NULL ;
+    }
+    sd = iniparser_getsec(d, h->section, h->slen,
+                          ini_key_hash(d, h, section, slen, shash));
+    if (sd == NULL) {
+        return NULL ;
+    }
+    e = dictionary_find_h(sd, h->key, h->klen,
+                          ini_key_hash(sd, h, key, klen, khash));
+    if (e == NULL && ini_layer(sd)) {
+        e = iniparser_layer_find(ini_layer_base(sd), h->key, h->klen) ;
+    }
+    return (e && e->val) ? e : NULL ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a compiled key, convert to an int
+  @param    d Dictionary to search
+  @param    h Key handle returned by iniparser_key_new()
+  @param    notfound Value to return in case of error
+  @return   integer
+
+  This function is equivalent to iniparser_getint() for the key h was
+  compiled from.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_getint_h(dictionary * d, ini_key * h, int notfound)
+{
+    entry_t *   e ;
+
+    if ((e = iniparser_entry_h(d, h)) == NULL) return notfound ;
+    return iniparser_int(e);
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a compiled key, convert to a double
+  @param    d Dictionary to search
+  @param    h Key handle returned by iniparser_key_new()
+  @param    notfound Value to return in case of error
+  @return   double
+
+  This function is equivalent to iniparser_getdouble() for the key h
+  was compiled from.
+ */
+/*--------------------------------------------------------------------------*/
+double iniparser_getdouble_h(dictionary * d, ini_key * h, double notfound)
+{
+    entry_t *   e ;
+
+    if ((e = iniparser_entry_h(d, h)) == NULL) return notfound ;
+    return iniparser_double(e);
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a compiled key, convert to a boolean
+  @param    d Dictionary to search
+  @param    h Key handle returned by iniparser_key_new()
+  @param    notfound Value to return in case of error
+  @return   integer
+
+  This function is equivalent to iniparser_getboolean() for the key h
+  was compiled from.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_getboolean_h(dictionary * d, ini_key * h, int notfound)
+{
+    entry_t *   e ;
+
+    if ((e = iniparser_entry_h(d, h)) == NULL) return notfound ;
+    return iniparser_boolean(e, notfound);
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a compiled key, convert to a
+            64-bit int
+  @param    d Dictionary to search
+  @param    h Key handle returned by iniparser_key_new()
+  @param    notfound Value to return in case of error
+  @param    error Set to an error code, or NULL
+  @return   64-bit integer
+
+  This function is equivalent to iniparser_getint64() for the key h
+  was compiled from.
+ */
+/*--------------------------------------------------------------------------*/
+int64_t iniparser_getint64_h(dictionary * d, ini_key * h, int64_t notfound,
+                             int * error)
+{
+    entry_t *   e ;
+    uint64_t    m ;
+    unsigned    f ;
+    int         err ;
+
+    if ((e = iniparser_entry_h(d, h)) == NULL) {
+        if (error) *error = ENOENT ;
+        return notfound ;
+    }
+    f = iniparser_number(e, &m) ;
+    notfound = iniparser_int64(f, m, &err) ;
+    if (error) *error = err ;
+    return notfound ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a compiled key, convert to an
+            unsigned 64-bit int
+  @param    d Dictionary to search
+  @param    h Key handle returned by iniparser_key_new()
+  @param    notfound Value to return in case of error
+  @param    error Set to an error code, or NULL
+  @return   Unsigned 64-bit integer
+
+  This function is equivalent to iniparser_getuint64() for the key h
+  was compiled from.
+ */
+/*--------------------------------------------------------------------------*/
+uint64_t iniparser_getuint64_h(dictionary * d, ini_key * h,
+                               uint64_t notfound, int * error)
+{
+    entry_t *   e ;
+    uint64_t    m ;
+    unsigned    f ;
+    int         err ;
+
+    if ((e = iniparser_entry_h(d, h)) == NULL) {
+        if (error) *error = ENOENT ;
+        return notfound ;
+    }
+    f = iniparser_number(e, &m) ;
+    m = iniparser_uint64(f, m, &err) ;
+    if (error) *error = err ;
+    return m ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Finds out if a compiled key exists in a dictionary
+  @param    ini     Dictionary to search
+  @param    h       Key handle returned by iniparser_key_new()
+  @return   integer 1 if entry exists, 0 otherwise
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_find_entry_h(dictionary * ini, ini_key * h)
+{
+    return iniparser_getstring_h(ini, h, INI_INVALID_KEY)!=INI_INVALID_KEY ;
+}
+
+/* iniparser_set_val() for a flat dictionary */
+static int iniparser_set_flat(dictionary * ini, char * section, char * key,
+                              char * val)
+{
+    char           buf[2 * ASCIILINESZ + 2], * p = buf ;
+    size_t         slen = strlen(section), klen ;
+    int            status ;
+
+    if (iniparser_flat_add(ini, section, slen) != 0)
+        return -1 ;
+    if (key == NULL)
+        return 0 ;
+
+    klen = strlen(key) ;
+    if (slen + klen + 2 > sizeof(buf) &&
+        (p = (char *)malloc(slen + klen + 2)) == NULL)
+        return -1 ;
+    memcpy(p, section, slen) ;
+    p[slen] = ':' ;
+    memcpy(p + slen + 1, key, klen + 1) ;
+    status = dictionary_set(ini, p, val) ;
+    if (p != buf)
+        free(p) ;
+    return status ;
+}
+
+int iniparser_set_val(dictionary * ini, char * section, char *key, char * val)
+{
+    dictionary   * sd;
+    size_t         len;
+
+    if (ini==NULL || section==NULL)
+        return -1 ;
+    if (ini_flat(ini))
+        return iniparser_set_flat(ini, section, key, val) ;
+
+    if(!ini->dict) {
+        if(ini->n == 0) {
+            dictionary_policy(ini, 1);
+        } else {
+            return -1;
+        }
+    }
+
+    len = strlen(section) ;
+    if(!key && ini_layer(ini) &&
+       iniparser_layer_find(ini, section, len) != NULL) {
+        return 0;
+    }
+    if((sd = iniparser_modsec(ini, section, len)) == NULL) {
+        if((sd = dictionary_new_child(ini, 0)) == NULL) {
+            return -1;
+        }
+        dictionary_set(ini, section, sd);
+    }
+
+    if(key) {
+        return dictionary_set(sd, key, val);
+    }
+    return 0;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Set an entry in a dictionary.
+  @param    ini     Dictionary to modify.
+  @param    entry   Entry to modify (entry name)
+  @param    val     New value to associate to the entry.
+  @return   int 0 if Ok, -1 otherwise.
+
+  If the given entry can be found in the dictionary, it is modified to
+  contain the provided value. If it cannot be found, -1 is returned.
+  It is Ok to set val to NULL.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_set(dictionary * ini, char * entry, char * val)
+{
+    char       * s, * k ;
+    char         l[ASCIILINESZ+1] ;
+
+    if (ini==NULL || entry==NULL || iniparser_split(entry, l, &s, &k) < 0)
+        return -1 ;
+
+    return iniparser_set_val(ini, s, k, val) ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Delete an entry in a dictionary
+  @param    ini     Dictionary to modify
+  @param    entry   Entry to delete (entry name)
+  @return   void
+
+  If the given entry can be found, it is deleted from the dictionary.
+ */
+/*--------------------------------------------------------------------------*/
+void iniparser_unset(dictionary * ini, char * entry)
+{
+    dictionary   * sd;
+    char         * s, * k ;
+    char           l[ASCIILINESZ+1] ;
+
+    if (ini==NULL || entry==NULL || iniparser_split(entry, l, &s, &k) < 0)
+        return ;
+
+    if (ini_flat(ini)) {
+        /* Undo the split: l holds the lowercased entry */
+        k[-1] = ':' ;
+        dictionary_unset(ini, l);
+        return ;
+    }
+    if((sd = iniparser_getsec(ini, s, strlen(s),
+                              dictionary_hashn(ini, s, strlen(s)))) != NULL &&
+       iniparser_layer_find(sd, k, strlen(k)) != NULL &&
+       (sd = iniparser_modsec(ini, s, strlen(s))) != NULL) {
+        iniparser_remove(sd, k);
+    }
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Scan a single line from an INI file
+  @param    line        Input line, may be concatenated multi-line input
+  @param    len         Number of characters in line
+  @param    section     Span to fill with the section name
+  @param    key         Span to fill with the key
+  @param    value       Span to fill with the value
+  @return   line_status value
+
+  This function classifies a line in a single pass without copying
+  anything: the returned spans point into the line and are neither
+  lowercased nor NUL-terminated. The section span is only set for LINE_SECTION and
+  has a NULL pointer for an empty "[]" header, which does not change
+  the current section. Key and value spans are only set for LINE_VALUE.
+ */
+/*--------------------------------------------------------------------------*/
+static line_status iniparser_scan(
+    char     * line,
+    int        len,
+    ini_span * section,
+    ini_span * key,
+    ini_span * value)
+{
+    ini_span    l ;
+    char      * p, * q, * end ;
+
+    l.s = line ;
+    l.n = len ;
+    span_strip(&l);
+    end = l.s + l.n ;
+
+    if (l.n<1) {
+        /* Empty line */
+        return LINE_EMPTY ;
+    }
+    if (l.s[0]=='#' || l.s[0]==';') {
+        /* Comment line */
+        return LINE_COMMENT ;
+    }
+    if (l.s[0]=='[' && end[-1]==']') {
+        /* Section name, up to the first closing bracket */
+        section->s = NULL ;
+        section->n = 0 ;
+        if (l.s[1]!=']') {
+            section->s = l.s + 1 ;
+            section->n = (int)(ini_find(section->s, end, ']') - section->s);
+            span_strip(section);
+        }
+        return LINE_SECTION ;
+    }
+
+    /* Key is everything before the first equal sign */
+    if ((q = ini_find(l.s, end, '='))==end || q==l.s) {
+        return LINE_ERROR ;
+    }
+    key->s = l.s ;
+    key->n = (int)(q - l.s) ;
+    span_strip(key);
+
+    p = (char *)iniscan_ops_get()->skipws(q+1, end);
+    value->s = p ;
+    value->n = 0 ;
+    if (p<end && (*p=='"' || *p=='\'')) {
+        /* Quoted value, the closing quote is optional */
+        value->s = p + 1 ;
+        value->n = (int)(ini_find(value->s, end, *p) - value->s);
+    }
+    if (value->n==0 && p<end && *p!=';' && *p!='#') {
+        /* Unquoted value, up to the first comment character */
+        value->s = p ;
+        value->n = (int)(ini_find2(p, end, ';', '#') - p) ;
+    }
+    span_strip(value);
+    if (value->n==2 && value->s[0]==value->s[1] &&
+        (value->s[0]=='"' || value->s[0]=='\'')) {
+        /* '' and "" are empty values */
+        value->n = 0 ;
+    }
+    return LINE_VALUE ;
+}
+
+/* Returns the section dictionary called name, creating it if needed, */
+/* with room for size more keys. With ref set, a newly created section */
+/* does not copy its name. */
+static dictionary * iniparser_section(dictionary * ini, char * name,
+                                      int ref, int size)
+{
+    dictionary * sd ;
+
+    sd = ini_layer(ini) ? iniparser_modsec(ini, name, strlen(name))
+                        : (dictionary *)dictionary_get(ini, name, NULL) ;
+    if (sd == NULL) {
+        if ((sd = dictionary_new_child(ini, size)) == NULL) {
+            return NULL ;
+        }
+        if ((ref ? dictionary_setref(ini, name, sd)
+                 : dictionary_set(ini, name, sd)) != 0) {
+            dictionary_del(sd);
+            return NULL ;
+        }
+    } else if (size > 0 && dictionary_reserve(sd, sd->n + size) != 0) {
+        return NULL ;
+    }
+    return sd ;
+}
+
+/* Returns the number of keys counted after the next section line */
+#define ini_count_next(c) \
+    ((c) && (c)->next < (c)->n ? (c)->keys[(c)->next++] : 0)
+
+/* Returns the number of sections counted, the "" section only */
+/* counts if keys precede the first section line */
+#define ini_count_sections(c) ((c)->n - ((c)->keys[0] == 0))
+
+/* Counts the line ended in a first pass, returns 0 if Ok */
+static int iniparser_count_line(ini_count * c)
+{
+    int         * k ;
+    int           cont = c->cont ;
+
+    c->cont = c->last == '\\' ;
+    if (cont || c->first == 0 || c->first == '#' || c->first == ';') {
+        /* Continued, empty or comment line */
+        return 0 ;
+    }
+    if (c->first != '[' || c->last != ']') {
+        /* Lines that are neither sections nor keys are rare enough */
+        c->keys[c->n - 1]++ ;
+        return 0 ;
+    }
+    if (c->n == c->sz) {
+        if ((k = (int *)realloc(c->keys, 2 * c->sz * sizeof(int))) == NULL) {
+            return -1 ;
+        }
+        c->keys = k ;
+        c->sz *= 2 ;
+    }
+    c->keys[c->n++] = 0 ;
+    return 0 ;
+}
+
+/* Counts the lines of [p, end) in a first pass, returns 0 if Ok. */
+/* The last line goes on in the next call, unless final is set. */
+static int iniparser_count(ini_count * c, const char * p, const char * end,
+                           int final)
+{
+    const char  * eol, * q ;
+
+    for ( ; p < end || final ; p = eol + 1) {
+        eol = ini_find(p, end, '\n');
+        if ((q = iniscan_ops_get()->skipws(p, eol)) < eol) {
+            if (c->first == 0) {
+                c->first = *q ;
+            }
+            c->last = iniscan_ops_get()->rskipws(q, eol)[-1] ;
+        }
+        if (eol == end && !final) {
+            break ;
+        }
+        if (iniparser_count_line(c) != 0) {
+            return -1 ;
+        }
+        c->first = c->last = 0 ;
+        if (eol == end) {
+            break ;
+        }
+    }
+    return 0 ;
+}
+
+/* Counts the lines of a file in a first pass and rewinds it, */
+/* returns -1 if nothing was read, 1 on later failures, 0 if Ok */
+static int iniparser_count_file(ini_count * c, FILE * in)
+{
+    char    buf[INI_READSZ] ;
+    size_t  n ;
+
+    /* Streams that cannot be rewound are not counted */
+    if (fseek(in, 0L, SEEK_SET) != 0) {
+        return -1 ;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0 &&
+           iniparser_count(c, buf, buf + n, 0) == 0)
+        ;
+    iniparser_count(c, buf, buf, 1);
+    return fseek(in, 0L, SEEK_SET) != 0 ? 1 : 0 ;
+}
+
+/* Calls the callback of h matching a complete line of an ini file, */
+/* returns the status of the callback, 0 if it is NULL */
+static int iniparser_line(const ini_handler * h, void * ctx, char * line,
+                          int len, int lineno)
+{
+    ini_span    sec, key, val ;
+    line_status st = iniparser_scan(line, len, &sec, &key, &val) ;
+
+    ini_stat(lines[st], 1);
+    switch (st) {
+        case LINE_SECTION:
+        return h->section ? h->section(ctx, sec.s, sec.n, lineno) : 0 ;
+
+        case LINE_VALUE:
+        return h->value ? h->value(ctx, key.s, key.n, val.s, val.n, lineno)
+                        : 0 ;
+
+        case LINE_ERROR:
+        return h->error ? h->error(ctx, line, len, lineno) : 0 ;
+
+        default:
+        return 0 ;
+    }
+}
+
+/* Returns non-zero if s lies in the input l stores by reference */
+#define ini_load_ref(l, s)  ((l)->p != NULL && (s) >= (l)->p && (s) < (l)->end)
+
+/* Loader callback for section lines, see ini_load */
+static int iniparser_load_section(void * ctx, char * name, int len,
+                                  int lineno)
+{
+    ini_load    * l = (ini_load *)ctx ;
+    ini_span      sec ;
+    int           size = ini_count_next(l->hints) ;
+
+    (void)lineno ;
+    if (name != NULL) {
+        sec.s = name ;
+        sec.n = len ;
+        l->cur = iniparser_section(l->dict, span_lwc(&sec),
+                                   ini_load_ref(l, name), size);
+    } else if (l->cur == NULL) {
+        l->cur = iniparser_section(l->dict, "", 1, size);
+    } else if (size > 0 && dictionary_reserve(l->cur, l->cur->n + size)) {
+        l->cur = NULL ;
+    }
+    l->errs = l->cur ? 0 : -1 ;
+    return l->errs < 0 ? -1 : 0 ;
+}
+
+/* Loader callback for key lines, see ini_load */
+static int iniparser_load_value(void * ctx, char * key, int klen,
+                                char * val, int vlen, int lineno)
+{
+    ini_load    * l = (ini_load *)ctx ;
+    ini_span      k ;
+
+    (void)lineno ;
+    if (l->cur == NULL &&
+        (l->cur = iniparser_section(l->dict, "", 1,
+                                    l->hints ? l->hints->keys[0] : 0))
+        == NULL) {
+        l->errs = -1 ;
+        return -1 ;
+    }
+    k.s = key ;
+    k.n = klen ;
+    span_lwc(&k);
+    if (vlen > 0) {
+        val[vlen] = (char)0 ;
+    } else {
+        val = "" ;
+    }
+    l->errs = ini_load_ref(l, key) ? dictionary_setref(l->cur, key, val)
+                                   : dictionary_set(l->cur, key, val);
+    return l->errs < 0 ? -1 : 0 ;
+}
+
+/* Loader callback for syntax errors, see ini_load */
+static int iniparser_load_error(void * ctx, char * line, int len,
+                                int lineno)
+{
+    ini_load    * l = (ini_load *)ctx ;
+
+    fprintf(stderr, "iniparser: syntax error in %s (%d):\n",
+            l->ininame,
+            lineno);
+    fprintf(stderr, "-> %.*s\n", len, line);
+    l->errs++ ;
+    return 0 ;
+}
+
+/* Callbacks storing lines into a dictionary, with an ini_load context */
+static const ini_handler iniparser_loader = {
+    iniparser_load_section,
+    iniparser_load_value,
+    iniparser_load_error
+} ;
+
+/* Sets the fkey of l to name followed by a colon, returns 0 if Ok */
+static int iniparser_load_prefix(ini_load * l, char * name, size_t len)
+{
+    char        * p ;
+    size_t        sz ;
+
+    if (len + 2 > l->fsz) {
+        sz = 2 * len + ASCIILINESZ ;
+        if ((p = (char *)realloc(l->fkey, sz)) == NULL) {
+            return -1 ;
+        }
+        l->fkey = p ;
+        l->fsz = sz ;
+    }
+    memcpy(l->fkey, name, len) ;
+    l->fkey[len] = ':' ;
+    l->flen = len + 1 ;
+    return 0 ;
+}
+
+/* Starts the section called name in a flat load: the section is added */
+/* to the directory, and its name followed by a colon to fkey. Returns */
+/* 0 if Ok. */
+static int iniparser_flat_begin(ini_load * l, char * name, size_t len)
+{
+    if (iniparser_flat_add(l->dict, name, len) != 0) {
+        return -1 ;
+    }
+    return iniparser_load_prefix(l, name, len) ;
+}
+
+/* Flat loader callback for section lines, see INI_LOAD_FLAT */
+static int iniparser_load_flat_section(void * ctx, char * name, int len,
+                                       int lineno)
+{
+    ini_load    * l = (ini_load *)ctx ;
+    ini_span      sec ;
+
+    if (name != NULL) {
+        sec.s = name ;
+        sec.n = len ;
+        span_lwc(&sec);
+    } else if (l->flen > 0 || l->skip) {
+        return 0 ;
+    } else {
+        name = "" ;
+        len = 0 ;
+    }
+    l->skip = memchr(name, ':', (size_t)len) != NULL ;
+    if (l->skip) {
+        /* Flat dictionaries cannot hold it, see iniparser_flat_add() */
+        return iniparser_load_error(ctx, name, len, lineno) ;
+    }
+    l->errs = iniparser_flat_begin(l, name, (size_t)len) ;
+    return l->errs < 0 ? -1 : 0 ;
+}
+
+/* Flat loader callback for key lines: keys and values are copied */
+static int iniparser_load_flat_value(void * ctx, char * key, int klen,
+                                     char * val, int vlen, int lineno)
+{
+    ini_load    * l = (ini_load *)ctx ;
+    ini_span      k ;
+    char        * p ;
+    size_t        sz ;
+
+    (void)lineno ;
+    if (l->skip) {
+        return 0 ;
+    }
+    if (l->flen == 0 && iniparser_flat_begin(l, "", 0) != 0) {
+        l->errs = -1 ;
+        return -1 ;
+    }
+    if (l->flen + klen + 1 > l->fsz) {
+        sz = 2 * (l->flen + klen + 1) ;
+        if ((p = (char *)realloc(l->fkey, sz)) == NULL) {
+            l->errs = -1 ;
+            return -1 ;
+        }
+        l->fkey = p ;
+        l->fsz = sz ;
+    }
+    k.s = key ;
+    k.n = klen ;
+    span_lwc(&k);
+    memcpy(l->fkey + l->flen, key, klen + 1) ;
+    if (vlen > 0) {
+        val[vlen] = (char)0 ;
+    } else {
+        val = "" ;
+    }
+    l->errs = dictionary_set(l->dict, l->fkey, val);
+    return l->errs < 0 ? -1 : 0 ;
+}
+
+/* Callbacks storing lines into a flat dictionary, with an ini_load */
+/* context */
+static const ini_handler iniparser_flat_loader = {
+    iniparser_load_flat_section,
+    iniparser_load_flat_value,
+    iniparser_load_error
+} ;
+
+/* Returns the loader callbacks for dict */
+#define ini_loader(dict) \
+    (ini_flat(dict) ? &iniparser_flat_loader : &iniparser_loader)
+
+/* Prepares a loader context for dict, starting from error status errs */
+static void iniparser_load_init(ini_load * l, dictionary * dict,
+                                char * ininame, int errs, ini_count * hints)
+{
+    l->dict = dict ;
+    l->cur = NULL ;
+    l->ininame = ininame ;
+    l->p = l->end = NULL ;
+    l->errs = errs ;
+    l->hints = hints ;
+    l->fkey = NULL ;
+    l->flen = l->fsz = 0 ;
+    l->skip = 0 ;
+}
+
+/* Prepares a push parser calling h with ctx */
+static void iniparser_parser_init(ini_parser * ps, const ini_handler * h,
+                                  void * ctx)
+{
+    ps->h = *h ;
+    ps->ctx = ctx ;
+    ps->join = NULL ;
+    ps->jlen = ps->plen = ps->jsz = 0 ;
+    ps->pending = 0 ;
+    ps->lineno = 0 ;
+    ps->status = 0 ;
+}
+
+/* Appends [p, end) to the partial line of ps, returns 0 if Ok. One */
+/* character is kept spare, for callbacks to NUL-terminate a value. */
+static int iniparser_parser_append(ini_parser * ps, char * p, char * end)
+{
+    size_t      n = (size_t)ps->jlen + ps->plen + (end - p) ;
+    char      * q ;
+
+    if (n >= ps->jsz) {
+        if ((q = (char *)realloc(ps->join, 2 * n + 1)) == NULL) {
+            ps->status = -1 ;
+            return -1 ;
+        }
+        ps->join = q ;
+        ps->jsz = 2 * n + 1 ;
+    }
+    memcpy(ps->join + ps->jlen + ps->plen, p, end - p);
+    ps->plen += end - p ;
+    return 0 ;
+}
+
+/* Ends the physical line held in the partial line of ps: it is either */
+/* joined with the next one or completes a line for the callbacks */
+static void iniparser_parser_join(ini_parser * ps)
+{
+    ps->jlen = (size_t)(iniscan_ops_get()->rskipws(ps->join,
+                                        ps->join + ps->jlen + ps->plen)
+                        - ps->join) ;
+    ps->plen = 0 ;
+    if (ps->jlen > 0 && ps->join[ps->jlen-1] == '\\') {
+        /* Multi-line value */
+        ps->jlen-- ;
+        ps->pending = 1 ;
+        return ;
+    }
+    ps->status = iniparser_line(&ps->h, ps->ctx, ps->join, (int)ps->jlen,
+                                ps->lineno);
+    ps->jlen = 0 ;
+    ps->pending = 0 ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Create a streaming ini parser.
+  @param    h       Callbacks to call for the lines of the input.
+  @param    ctx     Pointer passed to each callback.
+  @return   Allocated parser, or NULL on memory failure.
+
+  The parser reads ini input pushed in chunks of any size with
+  iniparser_parser_feed(), as read from a socket or a decompressor, and
+  calls the callbacks of h for each line without building a dictionary.
+  It only keeps the line that goes on in the next chunk, so its memory
+  does not depend on the size of the input.
+
+  Any callback may be NULL. Callbacks get spans that are neither
+  lowercased nor NUL-terminated, with their length and the number of
+  the line, the last one of multi-line input:
+
+  - section(ctx, name, len, lineno) for section lines, with a NULL
+    name for an empty "[]" header.
+  - value(ctx, key, klen, val, vlen, lineno) for key lines, with
+    quotes and comments removed from the value.
+  - error(ctx, line, len, lineno) for lines that cannot be parsed.
+
+  Spans are only valid during the callback, which may modify their
+  characters and the one following each of them. A callback returning
+  non-zero stops parsing. The handler is copied, h may be freed.
+
+  The parser must be freed with iniparser_parser_free().
+ */
+/*--------------------------------------------------------------------------*/
+ini_parser * iniparser_parser_new(const ini_handler * h, void * ctx)
+{
+    ini_parser * ps ;
+
+    if (h == NULL || (ps = (ini_parser *)malloc(sizeof(ini_parser))) == NULL)
+        return NULL ;
+    iniparser_parser_init(ps, h, ctx);
+    return ps ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Push a chunk of ini input to a streaming parser.
+  @param    ps      Parser to feed.
+  @param    buf     Chunk of input.
+  @param    len     Number of characters in buf.
+  @return   int 0 if Ok, the status of the callback that stopped parsing,
+            -1 on memory failure.
+
+  Callbacks are called for each line the chunk completes. Lines ending
+  in the chunk are passed to them in place, spans then point into buf;
+  a line that goes on in the next chunk is kept by the parser. Once
+  parsing stopped, the chunks fed are ignored and this function returns
+  the status that stopped it.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_parser_feed(ini_parser * ps, char * buf, size_t len)
+{
+    char       * p, * end, * line, * eol, * q ;
+    ini_clock_t  t ;
+
+    if (ps == NULL || (buf == NULL && len > 0))
+        return -1 ;
+
+    ini_stat_begin(t);
+    ini_stat(bytes, len);
+    for (p = buf, end = buf + len ; p < end && ps->status == 0 ; ) {
+        line = p ;
+        if ((eol = ini_find(line, end, '\n')) == end) {
+            /* The line goes on in the next chunk */
+            iniparser_parser_append(ps, line, end);
+            break ;
+        }
+        p = eol + 1 ;
+        ps->lineno++ ;
+
+        if (!ps->pending && ps->plen == 0) {
+            /* Usual case: pass the line in place */
+            q = (char *)iniscan_ops_get()->rskipws(line, eol);
+            if (q == line || q[-1] != '\\') {
+                ps->status = iniparser_line(&ps->h, ps->ctx, line,
+                                            (int)(q - line), ps->lineno);
+                continue ;
+            }
+        }
+
+        /* Multi-line input or line started in a previous chunk */
+        if (iniparser_parser_append(ps, line, eol) == 0) {
+            iniparser_parser_join(ps);
+        }
+    }
+    ini_stat_end(t);
+    return ps->status ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    End the input of a streaming parser.
+  @param    ps      Parser to finish.
+  @return   int 0 if Ok, the status of the callback that stopped parsing,
+            -1 on memory failure.
+
+  This function passes the last line of the input to the callbacks when
+  it has no final newline. Multi-line input still waiting for its next
+  line is dropped, as the loaders do. The parser is then ready for a
+  new input, with line numbers starting over.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_parser_end(ini_parser * ps)
+{
+    int         status ;
+    ini_clock_t t ;
+
+    if (ps == NULL)
+        return -1 ;
+    if (ps->status == 0 && ps->plen > 0) {
+        /* Unterminated last line */
+        ini_stat_begin(t);
+        ps->lineno++ ;
+        iniparser_parser_join(ps);
+        ini_stat_end(t);
+    }
+    status = ps->status ;
+    ps->jlen = ps->plen = 0 ;
+    ps->pending = 0 ;
+    ps->lineno = 0 ;
+    ps->status = 0 ;
+    return status ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Free a streaming parser.
+  @param    ps      Parser to free, may be NULL.
+  @return   void
+
+  Input fed since the last iniparser_parser_end() is discarded.
+ */
+/*--------------------------------------------------------------------------*/
+void iniparser_parser_free(ini_parser * ps)
+{
+    if (ps == NULL)
+        return ;
+    free(ps->join);
+    free(ps);
+}
+
+/* Ends the input of a loader parser, returns the error status of l */
+/* given the status of the last feed */
+static int iniparser_done(ini_load * l, ini_parser * ps, int status)
+{
+    if (status == 0) {
+        status = iniparser_parser_end(ps);
+    }
+    free(ps->join);
+    free(l->fkey);
+    if (status < 0 && l->errs >= 0) {
+        /* The parser itself ran out of memory */
+        l->errs = -1 ;
+    }
+
+    if (l->errs<0) {
+        fprintf(stderr, "iniparser: memory allocation failure\n");
+    }
+    return l->errs ;
+}
+
+/* Presizes dict for the sections counted in hints, or for all their */
+/* keys if it is flat */
+static void iniparser_presize(dictionary * dict, ini_count * hints)
+{
+    int     i, n = 0 ;
+
+    dictionary_reserve(ini_flat(dict) ? ini_flat_dir(dict) : dict,
+                       ini_count_sections(hints)) ;
+    if (ini_flat(dict)) {
+        for (i=0 ; i<hints->n ; i++) {
+            n += hints->keys[i] ;
+        }
+        dictionary_reserve(dict, n) ;
+    }
+}
+
+/* Feeds ps the blocks of in, then ends the input of l. Returns the */
+/* error status of l, 1 if in cannot be read. */
+static int iniparser_feed_file(ini_load * l, ini_parser * ps, FILE * in)
+{
+    char         buf[INI_READSZ] ;
+    size_t       n ;
+    int          status = 0 ;
+
+    while (status == 0 && (n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        status = iniparser_parser_feed(ps, buf, n);
+    }
+    if (status == 0 && ferror(in)) {
+        fprintf(stderr, "iniparser: cannot read %s\n", l->ininame);
+        free(ps->join);
+        free(l->fkey);
+        return 1 ;
+    }
+    return iniparser_done(l, ps, status) ;
+}
+
+/* Reads an ini file by blocks into dict, returns the error status. */
+/* Lines within a block are parsed in place, only lines that cross */
+/* blocks or go on over several lines are copied, to a buffer that */
+/* grows as needed. With hints set, the file is counted first to */
+/* presize dict. */
+static int iniparser_read(dictionary * dict, FILE * in, char * ininame,
+                          ini_count * hints)
+{
+    ini_load     l ;
+    ini_parser   ps ;
+
+    if (hints) {
+        switch (iniparser_count_file(hints, in)) {
+            case 0:
+            iniparser_presize(dict, hints) ;
+            break ;
+
+            case 1:
+            fprintf(stderr, "iniparser: cannot read %s\n", ininame);
+            return 1 ;
+
+            default:
+            hints = NULL ;
+            break ;
+        }
+    }
+    iniparser_load_init(&l, dict, ininame, 0, hints);
+    iniparser_parser_init(&ps, ini_loader(dict), &l);
+    return iniparser_feed_file(&l, &ps, in) ;
+}
+
+/* Parses the lines of [p, end) into dict with the callbacks of h, which */
+/* take an ini_load context, numbering them from lineno plus one. */
+/* Returns the error status, starting from errs. Lines are tokenized */
+/* in place and stored by reference, but multi-line input. */
+static int iniparser_parse(dictionary * dict, const ini_handler * h,
+                           char * p, char * end, char * ininame,
+                           int lineno, int errs, ini_count * hints)
+{
+    ini_load     l ;
+    ini_parser   ps ;
+
+    iniparser_load_init(&l, dict, ininame, errs, hints);
+    l.p = p ;
+    l.end = end ;
+    iniparser_parser_init(&ps, h, &l);
+    ps.lineno = lineno ;
+    return iniparser_done(&l, &ps, iniparser_parser_feed(&ps, p, end - p)) ;
+}
+
+/* Maps an ini file of size bytes for dict, which releases the mapping */
+/* Returns the mapping, or NULL if size is 0 or on failure. */
+static char * iniparser_mmap(dictionary * dict, int fd, size_t size,
+                             char * ininame)
+{
+    char       * p ;
+
+    if (size == 0) {
+        return NULL ;
+    }
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "iniparser: cannot map %s\n", ininame);
+        return NULL ;
+    }
+    dict->map = p ;
+    dict->mapsz = size ;
+    posix_madvise(p, size, POSIX_MADV_SEQUENTIAL);
+    return p ;
+}
+
+/* Maps an ini file of size bytes into dict, returns the error status */
+/* With hints set, the mapping is counted first to presize dict. */
+static int iniparser_map(dictionary * dict, int fd, size_t size,
+                         char * ininame, ini_count * hints)
+{
+    char       * p ;
+
+    if (size == 0) {
+        return 0 ;
+    }
+    if ((p = iniparser_mmap(dict, fd, size, ininame)) == NULL) {
+        return 1 ;
+    }
+    if (hints) {
+        iniparser_count(hints, p, p + size, 1);
+        iniparser_presize(dict, hints) ;
+    }
+    return iniparser_parse(dict, ini_loader(dict), p, p + size, ininame,
+                           0, 0, hints) ;
+}
+
+/* Releases the section index of a lazy load */
+static void iniparser_lazy_free(void * p)
+{
+    ini_lazy    * lz = (ini_lazy *)p ;
+    ini_map     * m ;
+
+    while ((m = lz->maps) != NULL) {
+        lz->maps = m->next ;
+        munmap(m->p, m->size);
+        free(m);
+    }
+    free(lz->r);
+    free(lz);
+}
+
+/* Indexes the named section line name starts the current line of x */
+/* with, returns 0 if Ok */
+static int iniparser_index_add(ini_index * x, char * name, int len)
+{
+    ini_lazy    * lz = x->lz ;
+    ini_range   * r ;
+    entry_t     * e ;
+    char          buf[ASCIILINESZ+1], * l ;
+    unsigned      hash ;
+    int           i ;
+
+    if (lz->n == lz->sz) {
+        i = lz->sz ? 2 * lz->sz : 64 ;
+        if ((r = (ini_range *)realloc(lz->r, i * sizeof(ini_range))) == NULL) {
+            return -1 ;
+        }
+        lz->r = r ;
+        lz->sz = i ;
+    }
+    r = &lz->r[lz->n] ;
+    r->start = (size_t)(x->line - x->l.p) ;
+    r->end = (size_t)(x->l.end - x->l.p) ;
+    r->lineno = x->lineno ;
+    r->next = 0 ;
+    r->last = lz->n ;
+    if (lz->n > 0) {
+        lz->r[lz->n - 1].end = r->start ;
+    }
+
+    /* The name is lowercased as the loader does, into a copy: the */
+    /* mapping stays as it is until the section is parsed */
+    if ((l = len < (int)sizeof(buf) ? buf : (char *)malloc(len + 1)) == NULL) {
+        return -1 ;
+    }
+    for (i = 0 ; i < len ; i++) {
+        l[i] = (char)tolower((int)(unsigned char)name[i]);
+    }
+    l[len] = (char)0 ;
+    hash = dictionary_hashn(x->l.dict, l, len) ;
+    if ((e = dictionary_find_h(x->l.dict, l, len, hash)) == NULL &&
+        dictionary_set(x->l.dict, l, NULL) == 0) {
+        e = dictionary_find_h(x->l.dict, l, len, hash) ;
+    }
+    if (l != buf) {
+        free(l);
+    }
+    if (e == NULL) {
+        return -1 ;
+    }
+    if (e->flags & INI_SECTION_LAZY) {
+        /* Repeated section */
+        i = (int)e->num - 1 ;
+        lz->r[lz->r[i].last].next = lz->n + 1 ;
+        lz->r[i].last = lz->n ;
+    } else {
+        e->flags |= INI_SECTION_LAZY | INI_SECTION_INDEXED ;
+        e->num = (uint64_t)lz->n + 1 ;
+    }
+    lz->n++ ;
+    return 0 ;
+}
+
+/* Indexer callback for section lines, see ini_index */
+static int iniparser_index_section(void * ctx, char * name, int len,
+                                   int lineno)
+{
+    ini_index   * x = (ini_index *)ctx ;
+
+    if (!x->lazy && name == NULL) {
+        return iniparser_load_section(&x->l, name, len, lineno) ;
+    }
+    if (name != NULL) {
+        x->lazy = 1 ;
+        if (iniparser_index_add(x, name, len) != 0) {
+            x->l.errs = -1 ;
+            return -1 ;
+        }
+    }
+    x->l.errs = 0 ;
+    return 0 ;
+}
+
+/* Indexer callback for key lines, see ini_index */
+static int iniparser_index_value(void * ctx, char * key, int klen,
+                                 char * val, int vlen, int lineno)
+{
+    ini_index   * x = (ini_index *)ctx ;
+
+    if (!x->lazy) {
+        return iniparser_load_value(&x->l, key, klen, val, vlen, lineno) ;
+    }
+    x->l.errs = 0 ;
+    return 0 ;
+}
+
+/* Callbacks of the first pass of lazy loads, with an ini_index context */
+/* which starts with its ini_load */
+static const ini_handler iniparser_indexer = {
+    iniparser_index_section,
+    iniparser_index_value,
+    iniparser_load_error
+} ;
+
+/* Callbacks parsing a pending section, whose errors were reported by */
+/* the first pass */
+static const ini_handler iniparser_lazy_loader = {
+    iniparser_load_section,
+    iniparser_load_value,
+    NULL
+} ;
+
+/* Loads the lines of [p, end) before the first named section line into */
+/* dict and indexes the others, returns the error status. The lines are */
+/* fed one by one, to know where each section line starts. */
+static int iniparser_index(dictionary * dict, char * p, char * end,
+                           char * ininame)
+{
+    ini_index    x ;
+    ini_parser   ps ;
+    ini_range  * r ;
+    char       * eol ;
+    int          status = 0, i ;
+
+    if ((x.lz = (ini_lazy *)calloc(1, sizeof(ini_lazy))) == NULL) {
+        fprintf(stderr, "iniparser: memory allocation failure\n");
+        return -1 ;
+    }
+    x.lz->p = p ;
+    dict->aux = x.lz ;
+    dict->aux_free = iniparser_lazy_free ;
+    iniparser_load_init(&x.l, dict, ininame, 0, NULL);
+    x.l.p = p ;
+    x.l.end = end ;
+    x.lazy = 0 ;
+    iniparser_parser_init(&ps, &iniparser_indexer, &x);
+
+    for ( ; p < end && status == 0 ; p = eol + 1) {
+        if (!ps.pending) {
+            x.line = p ;
+            x.lineno = ps.lineno ;
+        }
+        eol = ini_find(p, end, '\n');
+        status = iniparser_parser_feed(&ps, p, (eol < end ? eol + 1 : end) - p);
+        if (eol == end) {
+            break ;
+        }
+    }
+    /* Sections are told apart from their raw lines on reload */
+    for (i = 0 ; i < x.lz->n ; i++) {
+        r = &x.lz->r[i] ;
+        r->hash = dictionary_hash_wy(x.l.p + r->start, r->end - r->start, 0);
+    }
+    return iniparser_done(&x.l, &ps, status) ;
+}
+
+/* Maps an ini file of size bytes into dict and indexes its sections, */
+/* returns the error status */
+static int iniparser_map_lazy(dictionary * dict, int fd, size_t size,
+                              char * ininame)
+{
+    char       * p = NULL ;
+    int          errs ;
+
+    /* Empty files are indexed too, so that they can be reloaded */
+    if (size > 0 && (p = iniparser_mmap(dict, fd, size, ininame)) == NULL) {
+        return 1 ;
+    }
+    errs = iniparser_index(dict, p, p ? p + size : p, ininame) ;
+    if (p) {
+        /* Sections are parsed in any order from now on */
+        posix_madvise(p, size, POSIX_MADV_NORMAL);
+    }
+    return errs ;
+}
+
+/* Parses the pending section of entry e of d, returns its dictionary */
+static dictionary * iniparser_lazy_section(dictionary * d, entry_t * e)
+{
+    ini_lazy    * lz = (ini_lazy *)d->aux ;
+    ini_range   * r ;
+    int           i = (int)e->num ;
+
+    /* Lines are tokenized in place: they can only be parsed once */
+    e->flags &= ~INI_SECTION_LAZY ;
+    for ( ; i > 0 ; i = r->next) {
+        r = &lz->r[i - 1] ;
+        if (iniparser_parse(d, &iniparser_lazy_loader, lz->p + r->start,
+                            lz->p + r->end, NULL, r->lineno, 0, NULL) < 0) {
+            break ;
+        }
+    }
+    /* Storing the section dictionary reset the flags of e */
+    e->flags |= INI_SECTION_INDEXED ;
+    return (dictionary *)e->val ;
+}
+
+/* Parses the pending sections of d, if it was loaded lazily */
+static void iniparser_lazy_all(dictionary * d)
+{
+    entry_t     * e ;
+    int           i ;
+
+    if (d == NULL || d->aux_free != iniparser_lazy_free) {
+        return ;
+    }
+    for (i=0 ; (e = dictionary_next(d, &i)) != NULL ; ) {
+        ini_section(d, e);
+    }
+}
+
+/* Returns the start of the first line of [p, end) where parsing can */
+/* restart afresh, or end: a named section line, after which the last */
+/* line that is not blank is complete. start is the beginning of the */
+/* file. */
+static char * iniparser_boundary(char * start, char * p, char * end)
+{
+    char        * q, * eol, * prev, * pend ;
+    ini_span      sec, key, val ;
+
+    for (;;) {
+        if ((q = ini_find(p, end, '\n')) == end || q + 1 == end) {
+            return end ;
+        }
+        p = q + 1 ;
+        if (*p != '[') {
+            continue ;
+        }
+        /* Blank lines end continued ones: the last line that is not */
+        /* blank must not be continued */
+        for (pend = q ; ; pend = prev - 1) {
+            for (prev = pend ; prev > start && prev[-1] != '\n' ; prev--)
+                ;
+            pend = (char *)iniscan_ops_get()->rskipws(prev, pend) ;
+            if (pend > prev || prev == start) {
+                break ;
+            }
+        }
+        if (pend > prev && pend[-1] == '\\') {
+            continue ;
+        }
+        if ((eol = ini_find(p, end, '\n')) == end) {
+            return end ;
+        }
+        eol = (char *)iniscan_ops_get()->rskipws(p, eol) ;
+        if (eol[-1] != '\\' &&
+            iniparser_scan(p, (int)(eol - p), &sec, &key, &val)
+                == LINE_SECTION && sec.s != NULL) {
+            return p ;
+        }
+    }
+}
+
+/* Counts the lines of a chunk, thread function */
+static void * iniparser_chunk_lines(void * arg)
+{
+    ini_chunk   * c = (ini_chunk *)arg ;
+    char        * p ;
+
+    c->lineno = 0 ;
+    for (p = c->p ; (p = ini_find(p, c->end, '\n')) < c->end ; p++) {
+        c->lineno++ ;
+    }
+    return NULL ;
+}
+
+/* Parses a chunk into its dictionary, thread function */
+static void * iniparser_chunk_parse(void * arg)
+{
+    ini_chunk   * c = (ini_chunk *)arg ;
+
+    c->errs = iniparser_parse(c->dict, &iniparser_loader, c->p, c->end,
+                              c->ininame, c->lineno, INI_ERRS_KEEP, NULL);
+    return NULL ;
+}
+
+/* Runs fn on the n chunks, each on its own thread but the first one, */
+/* and waits for all of them. Chunks get no thread if none can start. */
+static void iniparser_chunk_run(void * (* fn)(void *), ini_chunk * c,
+                                pthread_t * tid, int n)
+{
+    int           i, started ;
+
+    for (i=1 ; i<n && pthread_create(&tid[i], NULL, fn, &c[i]) == 0 ; i++)
+        ;
+    started = i ;
+    fn(&c[0]);
+    for (i=1 ; i<started ; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    for ( ; i<n ; i++) {
+        fn(&c[i]);
+    }
+}
+
+/* Moves the sections of src into dict, in order, as if their lines */
+/* followed those of dict in the file. Returns 0 if Ok. */
+static int iniparser_merge(dictionary * dict, dictionary * src)
+{
+    dictionary  * sd, * dst ;
+    entry_t     * s, * k ;
+    int           i, j ;
+
+    for (i=0 ; (s = dictionary_next(src, &i)) != NULL ; ) {
+        sd = (dictionary *)s->val ;
+        if ((dst = (dictionary *)dictionary_get(dict, s->key, NULL)) == NULL) {
+            /* New section: take it over as a whole */
+            if (((s->flags & DICT_KEYREF) ? dictionary_setref(dict, s->key, sd)
+                                          : dictionary_set(dict, s->key, sd))) {
+                return -1 ;
+            }
+            s->val = NULL ;
+            continue ;
+        }
+        /* Repeated section: later keys win, new ones come last. Strings */
+        /* the chunk owns are copied. */
+        for (j=0 ; (k = dictionary_next(sd, &j)) != NULL ; ) {
+            if ((k->flags & (DICT_KEYREF | DICT_VALREF)) ==
+                    (DICT_KEYREF | DICT_VALREF) ?
+                dictionary_setref(dst, k->key, k->val) :
+                dictionary_set(dst, k->key, k->val)) {
+                return -1 ;
+            }
+        }
+    }
+    return 0 ;
+}
+
+/* Maps an ini file of size bytes into dict, parsing chunks of it on up */
+/* to n threads. Returns the error status. */
+static int iniparser_map_parallel(dictionary * dict, int fd, size_t size,
+                                  char * ininame, int n)
+{
+    ini_chunk   * c ;
+    pthread_t   * tid ;
+    char        * p, * end ;
+    int           i, k, lineno, errs ;
+
+    if ((size_t)n > size / INI_CHUNK_MIN) {
+        n = (int)(size / INI_CHUNK_MIN) ;
+    }
+    if (n <= 1) {
+        return iniparser_map(dict, fd, size, ininame, NULL) ;
+    }
+    if ((p = iniparser_mmap(dict, fd, size, ininame)) == NULL) {
+        return 1 ;
+    }
+    c = (ini_chunk *)calloc(n, sizeof(ini_chunk)) ;
+    tid = (pthread_t *)calloc(n, sizeof(pthread_t)) ;
+    if (c == NULL || tid == NULL) {
+        free(c);
+        free(tid);
+        return iniparser_parse(dict, &iniparser_loader, p, p + size,
+                               ininame, 0, 0, NULL) ;
+    }
+
+    /* Cut the file at sections near each n-th of it */
+    end = p + size ;
+    c[0].p = p ;
+    c[0].dict = dict ;
+    for (i=1, k=1 ; i<n ; i++) {
+        c[k].p = iniparser_boundary(p, p + i * (size / n) - 1, end) ;
+        if (c[k].p == end) {
+            break ;
+        }
+        if (c[k].p > c[k-1].p) {
+            k++ ;
+        }
+    }
+    n = k ;
+    for (i=0, errs=0 ; i<n ; i++) {
+        c[i].end = i+1 < n ? c[i+1].p : end ;
+        c[i].ininame = ininame ;
+        if (i > 0 && (c[i].dict = dictionary_new_child(dict, 0)) == NULL) {
+            errs = -1 ;
+        }
+        dictionary_policy(c[i].dict, 1) ;
+    }
+
+    if (errs == 0) {
+        ini_stat(chunks, n);
+        iniparser_chunk_run(iniparser_chunk_lines, c, tid, n) ;
+        for (i=0, lineno=0 ; i<n ; i++) {
+            k = c[i].lineno ;
+            c[i].lineno = lineno ;
+            lineno += k ;
+        }
+        iniparser_chunk_run(iniparser_chunk_parse, c, tid, n) ;
+
+        /* Chain the error statuses as a sequential load would */
+        for (i=0 ; i<n && errs >= 0 ; i++) {
+            if (c[i].errs < 0) {
+                errs = -1 ;
+            } else if (c[i].errs >= INI_ERRS_KEEP) {
+                errs += c[i].errs - INI_ERRS_KEEP ;
+            } else {
+                errs = c[i].errs ;
+            }
+            if (i > 0 && errs >= 0 && iniparser_merge(dict, c[i].dict)) {
+                fprintf(stderr, "iniparser: memory allocation failure\n");
+                errs = -1 ;
+            }
+        }
+    }
+    for (i=1 ; i<n ; i++) {
+        dictionary_del(c[i].dict);
+    }
+    free(c);
+    free(tid);
+    return errs ;
+}
+
+/* Creates an empty dictionary to load a file into with flags, returns */
+/* NULL on allocation failure */
+static dictionary * iniparser_new(int flags)
+{
+    dictionary  * dict ;
+
+    dict = (flags & INI_LOAD_ARENA) ? dictionary_new_arena(0)
+                                    : dictionary_new(0) ;
+    if (dict && (flags & INI_LOAD_INTERN) && dictionary_intern(dict) != 0) {
+        dictionary_del(dict);
+        dict = NULL ;
+    }
+    if (dict && (flags & INI_LOAD_FLAT) && iniparser_flat_new(dict) != 0) {
+        dictionary_del(dict);
+        dict = NULL ;
+    }
+    if (dict) {
+        dictionary_policy(dict, !(flags & INI_LOAD_FLAT)) ;
+    }
+    return dict ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Parse an ini file with options
+  @param    ininame Name of the ini file to read.
+  @param    flags   Bitwise or of INI_LOAD_* options, or 0.
+  @return   Pointer to newly allocated dictionary
+
+  This function is equivalent to iniparser_load(), with the loading
+  strategy selected by flags:
+
+  - INI_LOAD_MMAP loads the file as iniparser_load_mmap() does.
+  - INI_LOAD_ARENA allocates the dictionary, its sections and all the
+    strings they copy from a few large blocks, which makes loading and
+    iniparser_freedict() much cheaper. Memory of entries removed or
+    replaced later on is only reclaimed when the dictionary is freed.
+  - INI_LOAD_PRESIZE counts the sections and keys of the file in a
+    cheap first pass, then creates the dictionary and each section with
+    the exact size they need, so that none of them grows during the
+    load. Streams that cannot be rewound are loaded without counting.
+  - INI_LOAD_LAZY maps the file and only indexes its sections in a
+    first pass: the lines of a section are parsed the first time a
+    getter or setter looks the section up. Section names can be listed
+    without parsing any. Syntax errors are still reported by the first
+    pass, and INI_LOAD_PRESIZE is ignored. Looking keys up modifies a
+    lazily loaded dictionary, so it must not be read by several threads
+    at once; iniparser_config_new() and iniparser_config_publish() parse
+    the remaining sections first, as do iniparser_dump_ini() and
+    iniparser_save_binary().
+  - INI_LOAD_INTERN makes all the sections share one copy of identical
+    keys and values, see dictionary_intern(). Only strings that are
+    copied are shared: short keys are stored in their entry, and with
+    INI_LOAD_MMAP or INI_LOAD_LAZY most are references to the mapping.
+  - INI_LOAD_FLAT stores all the keys in the dictionary itself, as
+    "section:key", and the section names in a directory of their own:
+    a key is found in a single probe, without copying it for getters
+    taking "section:key", and sections cost no table each. Keys and
+    values are copied, even with INI_LOAD_MMAP, and INI_LOAD_LAZY is
+    ignored. Iterating over the keys of a section scans the whole
+    dictionary, and flat dictionaries cannot be saved as images. Keys
+    are split from their section at the first colon, so section names
+    cannot contain colons: such section lines are reported as syntax
+    errors and their keys are skipped. Keys may contain colons.
+
+  The returned dictionary must be freed using iniparser_freedict().
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_load_flags(char * ininame, int flags)
+{
+    FILE       * in = NULL ;
+    struct stat  st ;
+    int          fd = -1 ;
+    int          errs ;
+
+    dictionary * dict ;
+    ini_count    count ;
+    ini_count  * hints = NULL ;
+
+    if (flags & INI_LOAD_FLAT) {
+        flags &= ~INI_LOAD_LAZY ;
+    }
+    if (flags & (INI_LOAD_MMAP | INI_LOAD_LAZY)) {
+        if ((fd = open(ininame, O_RDONLY))<0 || fstat(fd, &st)<0) {
+            fprintf(stderr, "iniparser: cannot open %s\n", ininame);
+            if (fd>=0) close(fd);
+            return NULL ;
+        }
+    } else if ((in=fopen(ininame, "r"))==NULL) {
+        fprintf(stderr, "iniparser: cannot open %s\n", ininame);
+        return NULL ;
+    }
+
+    dict = iniparser_new(flags) ;
+    if (dict && (flags & INI_LOAD_PRESIZE) && !(flags & INI_LOAD_LAZY)) {
+        count.n = 1 ;
+        count.sz = 16 ;
+        count.next = 1 ;
+        count.cont = 0 ;
+        count.first = count.last = 0 ;
+        if ((count.keys = (int *)calloc(count.sz, sizeof(int))) != NULL) {
+            hints = &count ;
+        }
+    }
+    if (dict) {
+        if (in) {
+            errs = iniparser_read(dict, in, ininame, hints);
+        } else if (flags & INI_LOAD_LAZY) {
+            errs = iniparser_map_lazy(dict, fd, (size_t)st.st_size, ininame);
+        } else {
+            errs = iniparser_map(dict, fd, (size_t)st.st_size, ininame,
+                                 hints);
+        }
+        if (errs) {
+            dictionary_del(dict);
+            dict = NULL ;
+        }
+    }
+    if (hints) {
+        free(count.keys);
+    }
+    if (in) {
+        fclose(in);
+    } else {
+        close(fd);
+    }
+    return dict ;
+}
+
+/* Asynchronous load, see iniparser_load_async() */
+typedef struct _ini_async_ {
+    ini_load_fn     done ;          /* Completion callback */
+    void        *   ctx ;           /* Context passed to done */
+    int             flags ;         /* INI_LOAD_* options */
+    char            ininame[1] ;    /* Copy of the file name */
+} ini_async ;
+
+/* Reads ininame by chunks into dict, parsing each one while the next */
+/* ones are read. Returns the error status, 1 if the file cannot be */
+/* opened or read. */
+static int iniparser_read_chunks(dictionary * dict, char * ininame)
+{
+    ini_load     l ;
+    ini_parser   ps ;
+    ini_readahead * r ;
+    char       * buf ;
+    size_t       n ;
+    int          fd, status = 0, failed = 0 ;
+
+    if ((fd = open(ininame, O_RDONLY)) < 0) {
+        fprintf(stderr, "iniparser: cannot open %s\n", ininame);
+        return 1 ;
+    }
+    if ((r = iniparser_readahead_open(fd)) == NULL) {
+        fprintf(stderr, "iniparser: memory allocation failure\n");
+        close(fd);
+        return -1 ;
+    }
+    iniparser_load_init(&l, dict, ininame, 0, NULL);
+    iniparser_parser_init(&ps, ini_loader(dict), &l);
+    while (status == 0 && !(failed = iniparser_readahead_next(r, &buf, &n)) && n > 0) {
+        status = iniparser_parser_feed(&ps, buf, n);
+    }
+    iniparser_readahead_close(r);
+    close(fd);
+    if (failed) {
+        fprintf(stderr, "iniparser: cannot read %s\n", ininame);
+        free(ps.join);
+        free(l.fkey);
+        return 1 ;
+    }
+    return iniparser_done(&l, &ps, status) ;
+}
+
+/* Loads the file of an ini_async, then reports it */
+static void * iniparser_async_main(void * arg)
+{
+    ini_async   * a = (ini_async *)arg ;
+    dictionary  * dict ;
+
+    dict = iniparser_new(a->flags) ;
+    if (dict && iniparser_read_chunks(dict, a->ininame) != 0) {
+        dictionary_del(dict);
+        dict = NULL ;
+    }
+    a->done(a->ctx, dict);
+    free(a);
+    return NULL ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Parse an ini file without blocking the caller
+  @param    ininame Name of the ini file to read.
+  @param    flags   Bitwise or of INI_LOAD_* options, or 0.
+  @param    done    Function to call with the dictionary loaded.
+  @param    ctx     Context passed to done.
+  @return   int 0 if the load started, -1 otherwise.
+
+  This function returns at once: the file is opened, read and parsed
+  by a thread of its own, which then calls done with the newly
+  allocated dictionary, or NULL if the file cannot be loaded, and
+  exits. done is called exactly once if the load started, never
+  otherwise; the caller owns the dictionary it gets, which must be
+  freed using iniparser_freedict().
+
+  The file is read in large chunks, each one parsed as the following
+  ones are read: on Linux, through an io_uring that keeps several reads
+  in flight, elsewhere or if the kernel has no io_uring, by a second
+  thread calling read() for the chunks ahead. The result is the same as iniparser_load_flags()
+  with flags, but INI_LOAD_MMAP, INI_LOAD_PRESIZE and INI_LOAD_LAZY are
+  ignored.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_load_async(char * ininame, int flags, ini_load_fn done,
+                         void * ctx)
+{
+    ini_async       * a ;
+    pthread_attr_t    attr ;
+    pthread_t         t ;
+    int               status ;
+
+    if (ininame==NULL || done==NULL) return -1 ;
+
+    a = (ini_async *)malloc(sizeof(ini_async) + strlen(ininame)) ;
+    if (a == NULL) {
+        return -1 ;
+    }
+    a->done = done ;
+    a->ctx = ctx ;
+    a->flags = flags & (INI_LOAD_ARENA | INI_LOAD_INTERN | INI_LOAD_FLAT) ;
+    strcpy(a->ininame, ininame);
+    if (pthread_attr_init(&attr) != 0) {
+        free(a);
+        return -1 ;
+    }
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    status = pthread_create(&t, &attr, iniparser_async_main, a) ;
+    pthread_attr_destroy(&attr);
+    if (status != 0) {
+        free(a);
+        return -1 ;
+    }
+    return 0 ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Create an overlay of a dictionary
+  @param    base    Dictionary to overlay, not loaded with INI_LOAD_FLAT.
+  @return   Pointer to newly allocated dictionary, NULL on error
+
+  An overlay is a copy-on-write clone of base: it starts with the
+  sections and keys of base, which it falls through to instead of
+  copying them, so that creating one takes constant time and memory
+  whatever the size of base. Getters, iterators and dumps see the keys
+  of the overlay first, then those of base. iniparser_set() and
+  iniparser_unset() only modify the overlay: the first time a section
+  of base is modified, the overlay gets a section of its own that only
+  holds the keys set or removed in it. Sections and keys keep the order
+  of base, followed by those the overlay adds; a key of base removed
+  then set again keeps its place.
+
+  base must neither be modified nor freed while overlays of it exist.
+  It may be read by overlays used in different threads, as long as
+  each one is only used by one thread at a time. An overlay can be the
+  base of other overlays. base has its pending sections parsed first if
+  it was loaded with INI_LOAD_LAZY. In overlays, iniparser_getsecname()
+  takes time proportional to the section number, and overlays cannot be
+  saved with iniparser_save_binary().
+
+  The returned dictionary must be freed using iniparser_freedict(),
+  which leaves base untouched.
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_overlay(dictionary * base)
+{
+    dictionary * dict ;
+
+    if (base==NULL || ini_flat(base) || (!base->dict && base->n > 0))
+        return NULL ;
+
+    iniparser_lazy_all(base);
+    if ((dict = dictionary_new(0)) == NULL) {
+        return NULL ;
+    }
+    dictionary_policy(dict, 1) ;
+    dict->aux = base ;
+    dict->aux_free = iniparser_layer_free ;
+    return dict ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Parse an ini file over a dictionary
+  @param    base    Dictionary to overlay, see iniparser_overlay().
+  @param    ininame Name of the ini file to read.
+  @return   Pointer to newly allocated dictionary, NULL on error
+
+  This function loads ininame as iniparser_load() does, into an overlay
+  of base: the keys of the file are added to those of base, replacing
+  the ones with the same name. Only the keys of the file are stored in
+  the returned dictionary, which must be freed using
+  iniparser_freedict() before base is.
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_load_overlay(dictionary * base, char * ininame)
+{
+    FILE       * in ;
+    dictionary * dict ;
+
+    if ((in=fopen(ininame, "r"))==NULL) {
+        fprintf(stderr, "iniparser: cannot open %s\n", ininame);
+        return NULL ;
+    }
+    if ((dict = iniparser_overlay(base)) != NULL &&
+        iniparser_read(dict, in, ininame, NULL) != 0) {
+        dictionary_del(dict);
+        dict = NULL ;
+    }
+    fclose(in);
+    return dict ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Parse an ini file and return an allocated dictionary object
+  @param    ininame Name of the ini file to read.
+  @return   Pointer to newly allocated dictionary
+
+  This is the parser for ini files. This function is called, providing
+  the name of the file to be read. It returns a dictionary object that
+  should not be accessed directly, but through accessor functions
+  instead.
+
+  The returned dictionary must be freed using iniparser_freedict().
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_load(char * ininame)
+{
+    return iniparser_load_flags(ininame, 0) ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Parse a memory-mapped ini file into a dictionary object
+  @param    ininame Name of the ini file to read.
+  @return   Pointer to newly allocated dictionary
+
+  This function is equivalent to iniparser_load(), but maps the file in
+  memory instead of reading it line by line. Lines are tokenized in the
+  private mapping and the dictionary stores pointers into it rather
+  than copies of each section name, key and value: only multi-line
+  inputs are copied. The mapping is released together with the
+  dictionary, and since there is no line buffer, lines are not limited
+  in length.
+
+  The returned dictionary must be freed using iniparser_freedict().
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_load_mmap(char * ininame)
+{
+    return iniparser_load_flags(ininame, INI_LOAD_MMAP) ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Parse a large ini file on several threads
+  @param    ininame     Name of the ini file to read.
+  @param    nthreads    Number of threads to use, 0 for one per CPU.
+  @return   Pointer to newly allocated dictionary
+
+  This function is equivalent to iniparser_load_mmap(), for files of
+  several megabytes. The mapping is cut into chunks starting at section
+  lines, which are parsed on up to nthreads threads into dictionaries
+  of their own. Those are then merged in file order: sections and keys
+  keep the order they first appear in, repeated keys keep the last
+  value, and the error status is the same as for a sequential load.
+  Only syntax error messages of different chunks may come in another
+  order. Small files are loaded on the calling thread only.
+
+  The returned dictionary must be freed using iniparser_freedict().
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_load_parallel(char * ininame, int nthreads)
+{
+    struct stat  st ;
+    int          fd ;
+    int          errs ;
+
+    dictionary * dict ;
+
+    if ((fd = open(ininame, O_RDONLY))<0 || fstat(fd, &st)<0) {
+        fprintf(stderr, "iniparser: cannot open %s\n", ininame);
+        if (fd>=0) close(fd);
+        return NULL ;
+    }
+    if (nthreads <= 0) {
+        nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN) ;
+    }
+    if ((dict = dictionary_new(0)) != NULL) {
+        dictionary_policy(dict, 1) ;
+        errs = iniparser_map_parallel(dict, fd, (size_t)st.st_size, ininame,
+                                      nthreads);
+        if (errs) {
+            dictionary_del(dict);
+            dict = NULL ;
+        }
+    }
+    close(fd);
+    return dict ;
+}
+
+/* Final mix of the FNV-1a hash of a schema key */
+__inline__ static uint64_t ini_schema_mix(uint64_t h)
+{
+    h ^= h >> 32 ;
+    h *= INI_U64(0xd6e8feb8, 0x6659fd93) ;
+    h ^= h >> 32 ;
+    h *= INI_U64(0xd6e8feb8, 0x6659fd93) ;
+    return h ^ (h >> 32) ;
+}
+
+/* Extends the schema hash h with the lowercase character c */
+#define ini_schema_step(h, c)   (((h) ^ (unsigned char)(c)) * INI_FNV_PRIME)
+
+__inline__ static int ini_schema_find(const ini_schema * sc, uint64_t hash)
+{
+    uint32_t    x ;
+
+    if (sc->n <= 0 || sc->nb <= 0) {
+        return -1 ;
+    }
+    x = (uint32_t)hash ^
+        (uint32_t)sc->disp[(uint32_t)(hash >> 32) % (uint32_t)sc->nb] *
+        0x9e3779b9u ;
+    x ^= x >> 16 ;
+    x *= 0x85ebca6bu ;
+    x ^= x >> 13 ;
+    return (int)(x % (uint32_t)sc->n) ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Hash a key for a configuration schema
+  @param    key     Key to hash, as "section:key"
+  @param    len     Length of key
+  @param    seed    Seed of the schema
+  @return   Hash of the lowercased key
+
+  This is the hash iniparser_load_schema() computes for each key line,
+  for generators of schemas: see iniparser_schema_slot().
+ */
+/*--------------------------------------------------------------------------*/
+uint64_t iniparser_schema_hash(const char * key, size_t len,
+                               unsigned long seed)
+{
+    uint64_t    h = INI_FNV_BASIS ^ (uint64_t)seed ;
+    size_t      i ;
+
+    for (i=0 ; i<len ; i++) {
+        h = ini_schema_step(h, tolower((int)(unsigned char)key[i])) ;
+    }
+    return ini_schema_mix(h) ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find the slot of a key in a configuration schema
+  @param    sc      Schema to search
+  @param    hash    Hash of the key, see iniparser_schema_hash()
+  @return   Slot of the key, from 0 to sc->n - 1, or -1 if sc has no field.
+
+  Keys are spread over the sc->nb buckets by the high bits of their
+  hash, then over the slots by the low bits mixed with the displacement
+  of their bucket. Keys that are not in the schema get a slot as well:
+  the key of the field found there must be compared.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_schema_slot(const ini_schema * sc, uint64_t hash)
+{
+    if (sc==NULL) return -1 ;
+    return ini_schema_find(sc, hash) ;
+}
+
+/* Releases the strings of a schema load */
+static void iniparser_schema_free(void * p)
+{
+    ini_str     * x ;
+
+    while ((x = (ini_str *)p) != NULL) {
+        p = x->next ;
+        free(x);
+    }
+}
+
+/* Sets the fields of dest to their default, or to 0 */
+static void iniparser_schema_defaults(const ini_schema * sc, void * dest)
+{
+    ini_setting     s ;
+    int             i ;
+
+    memset(dest, 0, sc->size);
+    for (i=0 ; i<sc->n ; i++) {
+        s.key = sc->fields[i].key ;
+        s.type = sc->fields[i].type ;
+        s.def = sc->fields[i].def ;
+        s.dest = (char *)dest + sc->fields[i].offset ;
+        iniparser_store(&s, NULL);
+    }
+}
+
+/* Makes fkey, the current section of a schema load, name followed by */
+/* a colon. Returns 0 if Ok. */
+static int iniparser_schema_begin(ini_schema_load * x, char * name,
+                                  size_t len)
+{
+    size_t      i ;
+
+    if (iniparser_load_prefix(&x->l, name, len) != 0) {
+        return -1 ;
+    }
+    x->h = INI_FNV_BASIS ^ (uint64_t)x->sc->seed ;
+    for (i=0 ; i<x->l.flen ; i++) {
+        x->h = ini_schema_step(x->h, x->l.fkey[i]) ;
+    }
+    return 0 ;
+}
+
+/* Schema loader callback for section lines, see ini_schema_load */
+static int iniparser_load_schema_section(void * ctx, char * name, int len,
+                                         int lineno)
+{
+    ini_schema_load * x = (ini_schema_load *)ctx ;
+
+    if (iniparser_load_section(ctx, name, len, lineno) != 0) {
+        return -1 ;
+    }
+    /* An empty header keeps the current section */
+    if (name != NULL && iniparser_schema_begin(x, name, (size_t)len) != 0) {
+        x->l.errs = -1 ;
+        return -1 ;
+    }
+    return 0 ;
+}
+
+/* Schema loader callback for key lines, see ini_schema_load */
+static int iniparser_load_schema_value(void * ctx, char * key, int klen,
+                                       char * val, int vlen, int lineno)
+{
+    ini_schema_load * x = (ini_schema_load *)ctx ;
+    const ini_field * f ;
+    ini_setting       s ;
+    entry_t           e ;
+    ini_str         * str ;
+    uint64_t          h = x->h ;
+    int               i ;
+
+    for (i=0 ; i<klen ; i++) {
+        key[i] = (char)tolower((int)(unsigned char)key[i]);
+        h = ini_schema_step(h, key[i]) ;
+    }
+    if ((i = ini_schema_find(x->sc, ini_schema_mix(h))) < 0 ||
+        (f = &x->sc->fields[i])->len != x->l.flen + klen ||
+        memcmp(f->key, x->l.fkey, x->l.flen) ||
+        memcmp(f->key + x->l.flen, key, klen)) {
+        return iniparser_load_value(ctx, key, klen, val, vlen, lineno) ;
+    }
+    if (vlen > 0) {
+        val[vlen] = (char)0 ;
+    } else {
+        val = "" ;
+    }
+    if (f->type == INI_TYPE_STRING) {
+        /* Lines do not outlive the load: keep a copy */
+        if ((str = (ini_str *)malloc(sizeof(ini_str) + vlen + 1)) == NULL) {
+            x->l.errs = -1 ;
+            return -1 ;
+        }
+        val = memcpy(str + 1, val, vlen + 1) ;
+        str->next = (ini_str *)x->l.dict->aux ;
+        x->l.dict->aux = str ;
+    }
+    memset(&e, 0, sizeof(e));
+    e.val = val ;
+    s.key = f->key ;
+    s.type = f->type ;
+    s.def = NULL ;
+    s.dest = x->dest + f->offset ;
+    iniparser_store(&s, &e);
+    x->l.errs = 0 ;
+    return 0 ;
+}
+
+/* Callbacks of schema loads, with an ini_schema_load context */
+static const ini_handler iniparser_schema_loader = {
+    iniparser_load_schema_section,
+    iniparser_load_schema_value,
+    iniparser_load_error
+} ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Load an ini file into a structure described by a schema
+  @param    ininame Name of the ini file to read.
+  @param    sc      Schema of the structure, as written by inigen.
+  @param    dest    Structure to fill.
+  @return   Dictionary of the keys sc does not describe, NULL on error.
+
+  This function sets each field of dest to its default value, or to 0
+  without default, then reads ininame as iniparser_load() does. The
+  value of each key of the schema is converted to the type of its
+  field as iniparser_lookup() does, and stored in dest: reading a
+  setting is then a structure member access. The field of a key is
+  found by a perfect hash of its name, computed as the line is scanned,
+  and a single comparison: these keys are not stored in any dictionary.
+
+  The other keys are stored in the returned dictionary, with all the
+  sections of the file, where the usual getters find them. String
+  fields point to the defaults of the schema or to copies released with
+  the dictionary, which must be freed using iniparser_freedict(). On
+  error, the fields of dest are left to their defaults.
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_load_schema(char * ininame, const ini_schema * sc,
+                                   void * dest)
+{
+    FILE            * in ;
+    dictionary      * dict ;
+    ini_schema_load   x ;
+    ini_parser        ps ;
+    int               errs ;
+
+    if (sc==NULL || dest==NULL) return NULL ;
+    iniparser_schema_defaults(sc, dest);
+    if ((in=fopen(ininame, "r"))==NULL) {
+        fprintf(stderr, "iniparser: cannot open %s\n", ininame);
+        return NULL ;
+    }
+    if ((dict = dictionary_new(0)) == NULL) {
+        fclose(in);
+        return NULL ;
+    }
+    dictionary_policy(dict, 1);
+    dict->aux_free = iniparser_schema_free ;
+
+    iniparser_load_init(&x.l, dict, ininame, 0, NULL);
+    x.sc = sc ;
+    x.dest = (char *)dest ;
+    /* Keys before any section line are in the section "" */
+    if (iniparser_schema_begin(&x, "", 0) != 0) {
+        errs = -1 ;
+    } else {
+        iniparser_parser_init(&ps, &iniparser_schema_loader, &x);
+        errs = iniparser_feed_file(&x.l, &ps, in) ;
+    }
+    fclose(in);
+    if (errs) {
+        /* Strings read so far go with the dictionary */
+        dictionary_del(dict);
+        iniparser_schema_defaults(sc, dest);
+        return NULL ;
+    }
+    return dict ;
+}
+
+/* Returns non-zero if the lines of the sections held by entries o of */
+/* lazy index a and e of b are the same */
+static int iniparser_same_ranges(ini_lazy * a, entry_t * o,
+                                 ini_lazy * b, entry_t * e)
+{
+    ini_range   * r, * s ;
+    int           i, j ;
+
+    if (!(o->flags & INI_SECTION_INDEXED) || o->key[0] == (char)0) {
+        /* Sections set by the caller and lines before the first */
+        /* section line are always compared key by key */
+        return 0 ;
+    }
+    for (i = (int)o->num, j = (int)e->num ; i > 0 && j > 0 ;
+         i = r->next, j = s->next) {
+        r = &a->r[i - 1] ;
+        s = &b->r[j - 1] ;
+        if (r->end - r->start != s->end - s->start || r->hash != s->hash) {
+            return 0 ;
+        }
+    }
+    return i == j ;
+}
+
+/* Updates section dictionary od of section name to the keys of sd, */
+/* reporting each key added, changed or removed. Returns the number of */
+/* keys reported, or -1. */
+static int iniparser_diff(char * name, dictionary * od, dictionary * sd,
+                          ini_change_fn changed, void * ctx)
+{
+    entry_t     * k, * o ;
+    size_t        len ;
+    int           i, n = 0 ;
+
+    for (i=0 ; (k = dictionary_next(sd, &i)) != NULL ; ) {
+        len = strlen(k->key) ;
+        o = dictionary_find_h(od, k->key, len,
+                              dictionary_hashn(od, k->key, len)) ;
+        if (o != NULL && (o->val == k->val ||
+            (o->val && k->val && !strcmp(o->val, k->val)))) {
+            continue ;
+        }
+        /* Changed keys are copied, so that a few of them do not keep */
+        /* the whole version of the file they come from mapped */
+        if (dictionary_set(od, k->key, k->val)) {
+            return -1 ;
+        }
+        if (changed) {
+            changed(ctx, name, k->key);
+        }
+        n++ ;
+    }
+    for (i=0 ; (o = dictionary_next(od, &i)) != NULL ; ) {
+        len = strlen(o->key) ;
+        if (dictionary_find_h(sd, o->key, len,
+                              dictionary_hashn(sd, o->key, len)) == NULL) {
+            if (changed) {
+                changed(ctx, name, o->key);
+            }
+            dictionary_unset(od, o->key);
+            n++ ;
+        }
+    }
+    return n ;
+}
+
+/* Updates d to the sections of nd, indexed from another version of */
+/* the same file, then takes the index of nd over. Returns the number */
+/* of changes reported, or -1: d then still uses its own index. */
+static int iniparser_update(dictionary * d, dictionary * nd,
+                            ini_change_fn changed, void * ctx)
+{
+    ini_lazy    * lz = (ini_lazy *)d->aux, * nz = (ini_lazy *)nd->aux ;
+    dictionary  * sd ;
+    entry_t     * e, * o, * k ;
+    char        * name ;
+    size_t        len ;
+    int           i, j, m, n = 0 ;
+
+    for (i=0 ; (e = dictionary_next(nd, &i)) != NULL ; ) {
+        len = strlen(e->key) ;
+        o = dictionary_find_h(d, e->key, len, dictionary_hashn(d, e->key, len));
+        if (o != NULL && iniparser_same_ranges(lz, o, nz, e)) {
+            /* Same lines: the section is left as it is, pending or not */
+            continue ;
+        }
+        if ((sd = ini_section(nd, e)) == NULL) {
+            return -1 ;
+        }
+        if (o == NULL) {
+            /* New section: take it over as a whole */
+            if (dictionary_set(d, e->key, sd) != 0) {
+                return -1 ;
+            }
+            e->val = NULL ;
+            if (changed) {
+                changed(ctx, e->key, NULL);
+                for (j=0 ; (k = dictionary_next(sd, &j)) != NULL ; ) {
+                    changed(ctx, e->key, k->key);
+                }
+            }
+            n += 1 + sd->n ;
+        } else {
+            if ((m = iniparser_diff(o->key, ini_section(d, o), sd,
+                                    changed, ctx)) < 0) {
+                return -1 ;
+            }
+            n += m ;
+        }
+    }
+
+    /* Sections gone from the file, parsed to report their keys */
+    for (i=0 ; (o = dictionary_next(d, &i)) != NULL ; ) {
+        len = strlen(o->key) ;
+        if (dictionary_find_h(nd, o->key, len,
+                              dictionary_hashn(nd, o->key, len)) != NULL) {
+            continue ;
+        }
+        if ((sd = ini_section(d, o)) == NULL ||
+            (name = (char *)malloc(len + 1)) == NULL) {
+            return -1 ;
+        }
+        memcpy(name, o->key, len + 1);
+        if (changed) {
+            for (j=0 ; (k = dictionary_next(sd, &j)) != NULL ; ) {
+                changed(ctx, name, k->key);
+            }
+            changed(ctx, name, NULL);
+        }
+        n += 1 + sd->n ;
+        dictionary_unset(d, name);
+        free(name);
+    }
+
+    /* Nothing fails from here on: sections now refer to the new index */
+    for (i=0 ; (e = dictionary_next(nd, &i)) != NULL ; ) {
+        len = strlen(e->key) ;
+        o = dictionary_find_h(d, e->key, len, dictionary_hashn(d, e->key, len));
+        o->flags |= INI_SECTION_INDEXED ;
+        o->num = e->num ;
+    }
+    /* The mappings of both indexes stay until no string refers to them */
+    nz->maps = lz->maps ;
+    lz->maps = NULL ;
+    iniparser_lazy_free(lz);
+    d->aux = nz ;
+    nd->aux = NULL ;
+    nd->aux_free = NULL ;
+    return n ;
+}
+
+/* Non-zero if s points into the size bytes mapped at p */
+#define ini_in_map(s, p, size) \
+    ((char *)(s) >= (char *)(p) && (char *)(s) < (char *)(p) + (size))
+
+/* Returns non-zero if a key or value of d or of its parsed sections */
+/* refers to the size bytes mapped at p */
+static int iniparser_refers(dictionary * d, void * p, size_t size)
+{
+    dictionary  * sd ;
+    entry_t     * e, * k ;
+    int           i, j ;
+
+    for (i=0 ; (e = dictionary_next(d, &i)) != NULL ; ) {
+        if ((e->flags & DICT_KEYREF) && ini_in_map(e->key, p, size)) {
+            return 1 ;
+        }
+        if ((e->flags & INI_SECTION_LAZY) || (sd = e->val) == NULL) {
+            /* Pending sections only refer to the current index */
+            continue ;
+        }
+        for (j=0 ; (k = dictionary_next(sd, &j)) != NULL ; ) {
+            if (((k->flags & DICT_KEYREF) && ini_in_map(k->key, p, size)) ||
+                ((k->flags & DICT_VALREF) && ini_in_map(k->val, p, size))) {
+                return 1 ;
+            }
+        }
+    }
+    return 0 ;
+}
+
+/* Releases the mappings of the versions of the file d was loaded and */
+/* reloaded from that neither its index nor its strings refer to */
+static void iniparser_unmap_stale(dictionary * d)
+{
+    ini_lazy    * lz = (ini_lazy *)d->aux ;
+    ini_map     * m, ** pm ;
+
+    for (pm = &lz->maps ; (m = *pm) != NULL ; ) {
+        if (ini_in_map(lz->p, m->p, m->size) ||
+            iniparser_refers(d, m->p, m->size)) {
+            pm = &m->next ;
+            continue ;
+        }
+        *pm = m->next ;
+        munmap(m->p, m->size);
+        free(m);
+    }
+    if (d->map != NULL && !ini_in_map(lz->p, d->map, d->mapsz) &&
+        !iniparser_refers(d, d->map, d->mapsz)) {
+        munmap(d->map, d->mapsz);
+        d->map = NULL ;
+    }
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Reload the changed sections of a lazily loaded ini file
+  @param    d       Dictionary loaded with INI_LOAD_LAZY.
+  @param    ininame Name of the ini file to read again.
+  @param    changed Function to report each change to, or NULL.
+  @param    ctx     Context passed to changed.
+  @return   int Number of changes, or -1 on failure.
+
+  This function indexes the new version of the file as
+  iniparser_load_flags() does with INI_LOAD_LAZY, then only parses the
+  sections whose lines differ from the ones d was loaded from, as told
+  by their length and hash. Those are updated in place, key by key:
+  other sections, their entries and handles are left as they are,
+  parsed or still pending. Sections set by the caller are compared
+  key by key, as are the keys preceding the first section line.
+
+  Each key added, changed or removed is reported by a call to changed
+  with its section and key names. Sections that appear or disappear are
+  reported as a whole with a NULL key, along with each of their keys.
+  The callback must not modify d.
+
+  If the file cannot be read or holds syntax errors, d is left
+  unchanged and -1 is returned. Dictionaries that were not loaded
+  lazily cannot be reloaded. Keys changed by a reload are copied, but
+  unchanged sections and the sections parsed from the new version
+  refer to the file: the mapping of a version is released once d no
+  longer holds any of its strings, so that values returned earlier stay
+  valid until their key changes. The file must be replaced, e.g. by
+  renaming a new version over it, rather than rewritten in place.
+ */
 /*--------------------------------------------------------------------------*/
-int iniparser_set(dictionary * ini, char * entry, char * val)
+int iniparser_reload(dictionary * d, char * ininame,
+                     ini_change_fn changed, void * ctx)
 {
-    char       * s, * k ;
+    struct stat  st ;
+    dictionary * nd ;
+    ini_lazy   * lz ;
+    ini_map    * m = NULL ;
+    int          fd ;
+    int          n = -1 ;
 
-    if (ini==NULL || entry==NULL || iniparser_split(entry, &s, &k) < 0)
+    if (d == NULL || d->aux_free != iniparser_lazy_free) {
+        return -1 ;
+    }
+    if ((fd = open(ininame, O_RDONLY))<0 || fstat(fd, &st)<0) {
+        fprintf(stderr, "iniparser: cannot open %s\n", ininame);
+        if (fd>=0) close(fd);
         return -1 ;
+    }
+    if ((nd = dictionary_new_child(d, 0)) != NULL &&
+        (st.st_size == 0 ||
+         (m = (ini_map *)malloc(sizeof(ini_map))) != NULL)) {
+        dictionary_policy(nd, 1) ;
+        if (iniparser_map_lazy(nd, fd, (size_t)st.st_size, ininame) == 0) {
+            if (m != NULL) {
+                /* The new mapping belongs to d as soon as its sections */
+                /* may refer to it */
+                lz = (ini_lazy *)d->aux ;
+                m->p = nd->map ;
+                m->size = nd->mapsz ;
+                m->next = lz->maps ;
+                lz->maps = m ;
+                nd->map = NULL ;
+                m = NULL ;
+            }
+            if ((n = iniparser_update(d, nd, changed, ctx)) >= 0) {
+                iniparser_unmap_stale(d);
+            }
+        }
+    }
+    free(m);
+    if (nd != NULL) {
+        /* Children of arenas are not freed on their own */
+        if (nd->aux_free != NULL) {
+            nd->aux_free(nd->aux);
+            nd->aux_free = NULL ;
+        }
+        if (nd->map != NULL) {
+            munmap(nd->map, nd->mapsz);
+            nd->map = NULL ;
+        }
+        dictionary_del(nd);
+    }
+    close(fd);
+    return n ;
+}
 
-    return iniparser_set_val(ini, s, k, val) ;
+/* Writes a binary image of d to binname through a temporary file, */
+/* stamped with the ini file status st if any. Returns 0 if Ok. */
+static int iniparser_save_image(dictionary * d, char * binname,
+                                struct stat * st)
+{
+    char         hdr[INI_BINARY_HDR] ;
+    ini_binary   b ;
+    FILE       * out ;
+    char       * tmp ;
+    void       * img ;
+    size_t       size ;
+    int          ok ;
+
+    if ((img = dictionary_image(d, &size)) == NULL) {
+        return -1 ;
+    }
+    memset(&b, 0, sizeof(b));
+    memcpy(b.magic, INI_BINARY_MAGIC, sizeof(b.magic));
+    b.version = INI_BINARY_VERSION ;
+    b.check = dictionary_hash_wy((char *)img, size, INI_BINARY_VERSION) ;
+    b.size = (unsigned long)size ;
+    b.isize = st ? (long)st->st_size : -1L ;
+    b.mtime = st ? (long)st->st_mtime : 0L ;
+    b.ino = st ? (unsigned long)st->st_ino : 0UL ;
+    memset(hdr, 0, sizeof(hdr));
+    memcpy(hdr, &b, sizeof(b));
+
+    /* Readers see either the previous image or the new one */
+    if ((tmp = (char *)malloc(strlen(binname) + 24)) == NULL) {
+        free(img);
+        return -1 ;
+    }
+    sprintf(tmp, "%s.%ld", binname, (long)getpid());
+    ok = (out = fopen(tmp, "wb")) != NULL ;
+    if (ok) {
+        ok = fwrite(hdr, sizeof(hdr), 1, out) == 1 &&
+             fwrite(img, size, 1, out) == 1 ;
+        ok = fclose(out) == 0 && ok ;
+        ok = ok && rename(tmp, binname) == 0 ;
+        if (!ok) {
+            remove(tmp);
+        }
+    }
+    free(tmp);
+    free(img);
+    if (!ok) {
+        fprintf(stderr, "iniparser: cannot write %s\n", binname);
+        return -1 ;
+    }
+    return 0 ;
+}
+
+/* Returns non-zero if the size bytes at p are a valid binary image, */
+/* made from an ini file that still has status st if st is set */
+static int iniparser_check_image(char * p, size_t size, struct stat * st)
+{
+    ini_binary   b ;
+
+    if (size <= INI_BINARY_HDR) {
+        return 0 ;
+    }
+    memcpy(&b, p, sizeof(b));
+    if (memcmp(b.magic, INI_BINARY_MAGIC, sizeof(b.magic)) != 0 ||
+        b.version != INI_BINARY_VERSION ||
+        b.size != size - INI_BINARY_HDR) {
+        return 0 ;
+    }
+    if (st != NULL && (b.isize != (long)st->st_size ||
+                       b.mtime != (long)st->st_mtime ||
+                       b.ino != (unsigned long)st->st_ino)) {
+        /* Stale image */
+        return 0 ;
+    }
+    return b.check == dictionary_hash_wy(p + INI_BINARY_HDR, b.size,
+                                         INI_BINARY_VERSION) ;
 }
 
 /*-------------------------------------------------------------------------*/
 /**
-  @brief    Delete an entry in a dictionary
-  @param    ini     Dictionary to modify
-  @param    entry   Entry to delete (entry name)
-  @return   void
+  @brief    Save a dictionary as a binary image.
+  @param    d       Dictionary to save.
+  @param    binname Name of the image file to write.
+  @param    ininame Name of the ini file d was loaded from, or NULL.
+  @return   int 0 if Ok, -1 otherwise.
 
-  If the given entry can be found, it is deleted from the dictionary.
+  This function writes d in a position-independent format that
+  iniparser_load_binary() maps without parsing: the sections, their
+  entries and hash tables with the hash of each key, and the strings,
+  with offsets instead of pointers. The image holds a version and a
+  checksum, and the size, modification time and inode of ininame if it
+  is given, so that the image is known to be stale once the ini file
+  changes. The image is written to a temporary file first, then renamed
+  to binname.
+
+  Images only work with the build of the library that wrote them.
+  Dictionaries with their own hash function, loaded with
+  INI_LOAD_FLAT or overlays cannot be saved. The entries of d are
+  packed first, which moves them as dictionary_set() can.
  */
 /*--------------------------------------------------------------------------*/
-void iniparser_unset(dictionary * ini, char * entry)
+int iniparser_save_binary(dictionary * d, char * binname, char * ininame)
 {
-    dictionary   * sd;
-    char         * s, * k ;
-
-    if (ini==NULL || entry==NULL || iniparser_split(entry, &s, &k) < 0)
-        return ;
+    struct stat  st ;
 
-    if((sd = (dictionary *)dictionary_get(ini, s, NULL)) != NULL) {
-        dictionary_unset(sd, k);
+    if (d==NULL || binname==NULL || ini_flat(d) || ini_layer(d)) return -1 ;
+    if (ininame != NULL && stat(ininame, &st) != 0) {
+        fprintf(stderr, "iniparser: cannot open %s\n", ininame);
+        return -1 ;
     }
+    iniparser_lazy_all(d);
+    return iniparser_save_image(d, binname, ininame ? &st : NULL) ;
 }
 
 /*-------------------------------------------------------------------------*/
 /**
-  @brief    Load a single line from an INI file
-  @param    input_line  Input line, may be concatenated multi-line input
-  @param    section     Output space to store section
-  @param    key         Output space to store key
-  @param    value       Output space to store value
-  @return   line_status value
+  @brief    Load a binary image of an ini file.
+  @param    binname Name of the image file, see iniparser_save_binary().
+  @param    ininame Name of the ini file to rebuild the image from, or
+                    NULL.
+  @return   Pointer to newly allocated dictionary, or NULL.
+
+  This function maps the image in memory and looks keys up right in
+  it: nothing is parsed, hashed or copied, only the pointers of the
+  image are set. Images that are missing, damaged, of another version
+  or, when ininame is given, stale are rejected. With ininame, a
+  rejected image is then rebuilt: the ini file is loaded as by
+  iniparser_load() and saved to binname, and its dictionary returned.
+
+  The returned dictionary can be modified, changes are not written to
+  the image. It must be freed using iniparser_freedict().
  */
 /*--------------------------------------------------------------------------*/
-static line_status iniparser_line(
-    char * input_line,
-    char * section,
-    char * key,
-    char * value)
-{   
-    line_status sta ;
-    char        line[ASCIILINESZ+1];
-    int         len ;
+dictionary * iniparser_load_binary(char * binname, char * ininame)
+{
+    struct stat  st, ist ;
+    int          fd ;
+    char       * p ;
 
-    strcpy(line, strstrip(input_line));
-    len = (int)strlen(line);
+    dictionary * dict = NULL ;
 
-    sta = LINE_UNPROCESSED ;
-    if (len<1) {
-        /* Empty line */
-        sta = LINE_EMPTY ;
-    } else if (line[0]=='#' || line[0]==';') {
-        /* Comment line */
-        sta = LINE_COMMENT ; 
-    } else if (line[0]=='[' && line[len-1]==']') {
-        /* Section name */
-        sscanf(line, "[%[^]]", section);
-        strcpy(section, strstrip(section));
-        strcpy(section, strlwc(section));
-        sta = LINE_SECTION ;
-    } else if (sscanf (line, "%[^=] = \"%[^\"]\"", key, value) == 2
-           ||  sscanf (line, "%[^=] = '%[^\']'",   key, value) == 2
-           ||  sscanf (line, "%[^=] = %[^;#]",     key, value) == 2) {
-        /* Usual key=value, with or without comments */
-        strcpy(key, strstrip(key));
-        strcpy(key, strlwc(key));
-        strcpy(value, strstrip(value));
-        /*
-         * sscanf cannot handle '' or "" as empty values
-         * this is done here
-         */
-        if (!strcmp(value, "\"\"") || (!strcmp(value, "''"))) {
-            value[0]=0 ;
-        }
-        sta = LINE_VALUE ;
-    } else if (sscanf(line, "%[^=] = %[;#]", key, value)==2
-           ||  sscanf(line, "%[^=] %[=]", key, value) == 2) {
-        /*
-         * Special cases:
-         * key=
-         * key=;
-         * key=#
-         */
-        strcpy(key, strstrip(key));
-        strcpy(key, strlwc(key));
-        value[0]=0 ;
-        sta = LINE_VALUE ;
-    } else {
-        /* Generate syntax error */
-        sta = LINE_ERROR ;
+    if (binname == NULL) return NULL ;
+    if (ininame != NULL && stat(ininame, &ist) != 0) {
+        fprintf(stderr, "iniparser: cannot open %s\n", ininame);
+        return NULL ;
     }
-    return sta ;
+    if ((fd = open(binname, O_RDONLY)) >= 0) {
+        p = fstat(fd, &st) == 0 && st.st_size > INI_BINARY_HDR ?
+            mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE, fd, 0) : MAP_FAILED ;
+        if (p != MAP_FAILED) {
+            if (iniparser_check_image(p, (size_t)st.st_size,
+                                      ininame ? &ist : NULL) &&
+                (dict = dictionary_map_image(p + INI_BINARY_HDR,
+                                             (size_t)st.st_size -
+                                             INI_BINARY_HDR)) != NULL) {
+                dict->map = p ;
+                dict->mapsz = (size_t)st.st_size ;
+            } else {
+                munmap(p, (size_t)st.st_size);
+            }
+        }
+        close(fd);
+    }
+    if (dict == NULL && ininame != NULL &&
+        (dict = iniparser_load(ininame)) != NULL) {
+        /* The file status is the one before loading: an ini file */
+        /* changed meanwhile makes the new image stale */
+        iniparser_save_image(dict, binname, &ist);
+    }
+    return dict ;
 }
 
 /*-------------------------------------------------------------------------*/
 /**
-  @brief    Parse an ini file and return an allocated dictionary object
-  @param    ininame Name of the ini file to read.
-  @return   Pointer to newly allocated dictionary
-
-  This is the parser for ini files. This function is called, providing
-  the name of the file to be read. It returns a dictionary object that
-  should not be accessed directly, but through accessor functions
-  instead.
+  @brief    Free all memory associated to an ini dictionary
+  @param    d Dictionary to free
+  @return   void
 
-  The returned dictionary must be freed using iniparser_freedict().
+  Free all memory associated to an ini dictionary.
+  It is mandatory to call this function before the dictionary object
+  gets out of the current context.
  */
 /*--------------------------------------------------------------------------*/
-dictionary * iniparser_load(char * ininame)
+void iniparser_freedict(dictionary * d)
 {
-    FILE * in ;
+    dictionary_del(d);
+}
 
-    char line    [ASCIILINESZ+1] ;
-    char section [ASCIILINESZ+1] ;
-    char key     [ASCIILINESZ+1] ;
-    char val     [ASCIILINESZ+1] ;
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Create a published configuration
+  @param    d       Dictionary to publish first, or NULL
+  @param    readers Maximal number of concurrent readers, 0 for 64
+  @return   Pointer to a newly allocated configuration, NULL on error
 
-    int  last=0 ;
-    int  len ;
-    int  lineno=0 ;
-    int  errs=0;
+  A published configuration holds a dictionary that any number of
+  threads may read while another one replaces it. Readers never take a
+  lock: iniparser_config_acquire() returns the current dictionary,
+  which stays valid and unchanged until iniparser_config_release(),
+  even if a new one is published meanwhile with iniparser_config_reload()
+  or iniparser_config_publish(). The configuration owns d from now on.
 
-    dictionary * dict ;
+  At most readers dictionaries can be acquired at a time: further
+  readers spin until one is released, so this should be at least the
+  number of reading threads. The returned configuration must be freed
+  using iniparser_config_free().
+ */
+/*--------------------------------------------------------------------------*/
+ini_config * iniparser_config_new(dictionary * d, int readers)
+{
+    ini_config * c ;
 
-    if ((in=fopen(ininame, "r"))==NULL) {
-        fprintf(stderr, "iniparser: cannot open %s\n", ininame);
+    if (readers <= 0) readers = INI_READERS ;
+    if ((c = (ini_config *)calloc(1, sizeof(ini_config))) == NULL) {
         return NULL ;
     }
-
-    dict = dictionary_new(0) ;
-    dictionary_policy(dict, 1) ;
-    if (!dict) {
-        fclose(in);
+    c->readers = (ini_reader *)calloc(readers, sizeof(ini_reader)) ;
+    if (c->readers == NULL) {
+        free(c);
         return NULL ;
     }
+    c->nreaders = readers ;
+    /* Readers must not parse sections concurrently */
+    iniparser_lazy_all(d);
+    c->cur = d ;
+    return c ;
+}
 
-    memset(line,    0, ASCIILINESZ);
-    memset(section, 0, ASCIILINESZ);
-    memset(key,     0, ASCIILINESZ);
-    memset(val,     0, ASCIILINESZ);
-    last=0 ;
-
-    while (fgets(line+last, ASCIILINESZ-last, in)!=NULL) {
-        lineno++ ;
-        len = (int)strlen(line)-1;
-        if (len==0)
-            continue;
-        /* Safety check against buffer overflows */
-        if (line[len]!='\n') {
-            fprintf(stderr,
-                    "iniparser: input line too long in %s (%d)\n",
-                    ininame,
-                    lineno);
-            dictionary_del(dict);
-            fclose(in);
-            return NULL ;
-        }
-        /* Get rid of \n and spaces at end of line */
-        while ((len>=0) &&
-                ((line[len]=='\n') || (isspace(line[len])))) {
-            line[len]=0 ;
-            len-- ;
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Start reading a published configuration
+  @param    c       Configuration to read
+  @param    ticket  Where to store the ticket to release the dictionary
+  @return   Current dictionary of c, or NULL if none was published
+
+  This function returns the dictionary currently published in c. The
+  dictionary may be read with all the getters of this module until it
+  is released by iniparser_config_release(), passing the same ticket.
+  It must not be modified. This function takes no lock, and is
+  usually cheaper than a single iniparser_getstring().
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_config_acquire(ini_config * c, int * ticket)
+{
+    ini_reader  * r ;
+    dictionary  * d ;
+    int           i ;
+
+    if (c==NULL || ticket==NULL) return NULL ;
+
+    /* Threads start looking for a free slot at different places, */
+    /* depending on where their stack is */
+    i = (int)(((size_t)&i / 4096) % (size_t)c->nreaders) ;
+    for (;;) {
+        r = &c->readers[i] ;
+        if (ini_atomic_load(&r->p) == NULL &&
+            __sync_bool_compare_and_swap(&r->p, NULL, (void *)c)) {
+            break ;
         }
-        /* Detect multi-line */
-        if (line[len]=='\\') {
-            /* Multi-line value */
-            last=len ;
-            continue ;
-        } else {
-            last=0 ;
+        if (++i == c->nreaders) {
+            i = 0 ;
+            sched_yield();
         }
-        switch (iniparser_line(line, section, key, val)) {
-            case LINE_EMPTY:
-            case LINE_COMMENT:
-            break ;
+    }
+    /* Announce the dictionary, then check it is still the published */
+    /* one: otherwise its publisher may not have seen the slot */
+    do {
+        d = ini_atomic_load(&c->cur) ;
+        ini_atomic_store(&r->p, d ? (void *)d : (void *)c) ;
+    } while (d != ini_atomic_load(&c->cur)) ;
 
-            case LINE_SECTION:
-            errs = iniparser_set_val(dict, section, NULL, NULL);
-            break ;
+    if (d == NULL) {
+        ini_atomic_store(&r->p, NULL) ;
+        *ticket = -1 ;
+        return NULL ;
+    }
+    *ticket = i ;
+    return d ;
+}
 
-            case LINE_VALUE:
-            errs = iniparser_set_val(dict, section, key, val) ;
-            break ;
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Stop reading a published configuration
+  @param    c       Configuration read
+  @param    ticket  Ticket set by iniparser_config_acquire()
+  @return   void
+
+  This function releases the dictionary returned by the matching
+  iniparser_config_acquire(), which must not be used afterwards.
+ */
+/*--------------------------------------------------------------------------*/
+void iniparser_config_release(ini_config * c, int ticket)
+{
+    if (c==NULL || ticket<0 || ticket>=c->nreaders) return ;
+    ini_atomic_store(&c->readers[ticket].p, NULL) ;
+}
 
-            case LINE_ERROR:
-            fprintf(stderr, "iniparser: syntax error in %s (%d):\n",
-                    ininame,
-                    lineno);
-            fprintf(stderr, "-> %s\n", line);
-            errs++ ;
-            break;
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Publish a new dictionary in a configuration
+  @param    c   Configuration to update
+  @param    d   Dictionary to publish, or NULL
+  @return   int 0 if Ok, -1 otherwise.
 
-            default:
-            break ;
-        }
-        memset(line, 0, ASCIILINESZ);
-        last=0;
-        if (errs<0) {
-            fprintf(stderr, "iniparser: memory allocation failure\n");
-            break ;
+  This function atomically replaces the dictionary of c by d: readers
+  acquiring the configuration afterwards get d, those still holding
+  the previous dictionary keep reading it unchanged. The previous
+  dictionary is freed as soon as all of them released it, which this
+  function waits for. The configuration owns d from now on.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_config_publish(ini_config * c, dictionary * d)
+{
+    dictionary  * old ;
+    int           i ;
+
+    if (c==NULL) return -1 ;
+
+    iniparser_lazy_all(d);
+    old = __atomic_exchange_n(&c->cur, d, __ATOMIC_SEQ_CST) ;
+    if (old == NULL) {
+        return 0 ;
+    }
+    /* Wait for the readers of old, new readers cannot get it */
+    for (i=0 ; i<c->nreaders ; i++) {
+        while (ini_atomic_load(&c->readers[i].p) == (void *)old) {
+            sched_yield();
         }
     }
-    if (errs) {
-        dictionary_del(dict);
-        dict = NULL ;
+    dictionary_del(old);
+    return 0 ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Load an ini file and publish it in a configuration
+  @param    c       Configuration to update
+  @param    ininame Name of the ini file to read.
+  @param    flags   Bitwise or of INI_LOAD_* options, or 0.
+  @return   int 0 if Ok, -1 otherwise.
+
+  This function loads ininame as iniparser_load_flags() does, off to
+  the side, then publishes it with iniparser_config_publish(). If the
+  file cannot be loaded, the current dictionary stays published.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_config_reload(ini_config * c, char * ininame, int flags)
+{
+    dictionary  * d ;
+
+    if (c==NULL || (d = iniparser_load_flags(ininame, flags)) == NULL) {
+        return -1 ;
     }
-    fclose(in);
-    return dict ;
+    return iniparser_config_publish(c, d) ;
 }
 
 /*-------------------------------------------------------------------------*/
 /**
-  @brief    Free all memory associated to an ini dictionary
-  @param    d Dictionary to free
+  @brief    Free a published configuration
+  @param    c   Configuration to free
   @return   void
 
-  Free all memory associated to an ini dictionary.
-  It is mandatory to call this function before the dictionary object
-  gets out of the current context.
+  This function frees a configuration and its current dictionary. No
+  reader may hold it any more.
  */
 /*--------------------------------------------------------------------------*/
-void iniparser_freedict(dictionary * d)
+void iniparser_config_free(ini_config * c)
 {
-    dictionary_del(d);
+    if (c==NULL) return ;
+    dictionary_del(c->cur);
+    free(c->readers);
+    free(c);
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the counters of the parsers and dictionaries
+  @param    s   Set to the counters
+  @return   int 0 if Ok, -1 if s is NULL or the library was compiled
+            without INIPARSER_STATS.
+
+  The counters cover every parser and dictionary of the process since
+  it started, or since iniparser_stats_reset(): the table searches and
+  allocations of the dictionaries (see dictionary_stats()), the bytes
+  parsed, the lines of each kind, the chunks iniparser_load_parallel()
+  cut files into and the time spent parsing, summed over threads,
+  callbacks included. Counters are only kept when the library is
+  compiled with INIPARSER_STATS defined, otherwise s is zeroed and the
+  library does no counting at all.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_stats(ini_stats * s)
+{
+    int     status ;
+
+    if (s==NULL) return -1 ;
+    memset(s, 0, sizeof(ini_stats));
+    status = dictionary_stats(&s->dict) ;
+#ifdef INIPARSER_STATS
+    s->bytes = __atomic_load_n(&ini_counters.bytes, __ATOMIC_RELAXED) ;
+    s->empty = __atomic_load_n(&ini_counters.lines[LINE_EMPTY],
+                               __ATOMIC_RELAXED) ;
+    s->comments = __atomic_load_n(&ini_counters.lines[LINE_COMMENT],
+                                  __ATOMIC_RELAXED) ;
+    s->sections = __atomic_load_n(&ini_counters.lines[LINE_SECTION],
+                                  __ATOMIC_RELAXED) ;
+    s->values = __atomic_load_n(&ini_counters.lines[LINE_VALUE],
+                                __ATOMIC_RELAXED) ;
+    s->errors = __atomic_load_n(&ini_counters.lines[LINE_ERROR],
+                                __ATOMIC_RELAXED) ;
+    s->chunks = __atomic_load_n(&ini_counters.chunks, __ATOMIC_RELAXED) ;
+    s->parse_ns = __atomic_load_n(&ini_counters.ns, __ATOMIC_RELAXED) ;
+#endif
+    return status ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Reset the counters of the parsers and dictionaries
+  @return   void
+
+  Sets to zero the counters iniparser_stats() returns.
+ */
+/*--------------------------------------------------------------------------*/
+void iniparser_stats_reset(void)
+{
+#ifdef INIPARSER_STATS
+    int     i ;
+
+    __atomic_store_n(&ini_counters.bytes, 0UL, __ATOMIC_RELAXED);
+    for (i=0 ; i<=LINE_VALUE ; i++) {
+        __atomic_store_n(&ini_counters.lines[i], 0UL, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&ini_counters.chunks, 0UL, __ATOMIC_RELAXED);
+    __atomic_store_n(&ini_counters.ns, (uint64_t)0, __ATOMIC_RELAXED);
+#endif
+    dictionary_stats_reset();
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Dump counters to an opened file pointer
+  @param    s   Counters to dump, NULL for the current ones
+  @param    f   Opened file pointer to dump to
+  @return   void
+
+  This function prints the counters in ini format, one section for the
+  dictionaries and one for the parsers, so that they can be loaded back
+  with iniparser_load() or read by a metrics collector. The number of
+  removed entries still holding storage is printed as "tombstones".
+ */
+/*--------------------------------------------------------------------------*/
+void iniparser_dump_stats(ini_stats * s, FILE * f)
+{
+    ini_stats   cur ;
+    int         i ;
+
+    if (f==NULL) return ;
+    if (s==NULL) {
+        iniparser_stats(&cur);
+        s = &cur ;
+    }
+    fprintf(f, "[dictionary]\n");
+    fprintf(f, "lookups = %lu\n", s->dict.lookups);
+    for (i=0 ; i<DICT_STATS_PROBES ; i++) {
+        fprintf(f, "probes_%d%s = %lu\n", i + 1,
+                i == DICT_STATS_PROBES - 1 ? "_more" : "", s->dict.probes[i]);
+    }
+    fprintf(f, "grows = %lu\n", s->dict.grows);
+    fprintf(f, "rehashed = %lu\n", s->dict.rehashed);
+    fprintf(f, "packs = %lu\n", s->dict.packs);
+    fprintf(f, "removed = %lu\n", s->dict.removed);
+    fprintf(f, "tombstones = %lu\n", s->dict.removed > s->dict.reclaimed ?
+            s->dict.removed - s->dict.reclaimed : 0UL);
+    fprintf(f, "allocs = %lu\n", s->dict.allocs);
+    fprintf(f, "bytes = %lu\n", s->dict.bytes);
+    fprintf(f, "\n[parser]\n");
+    fprintf(f, "bytes = %lu\n", s->bytes);
+    fprintf(f, "empty_lines = %lu\n", s->empty);
+    fprintf(f, "comment_lines = %lu\n", s->comments);
+    fprintf(f, "section_lines = %lu\n", s->sections);
+    fprintf(f, "value_lines = %lu\n", s->values);
+    fprintf(f, "error_lines = %lu\n", s->errors);
+    fprintf(f, "chunks = %lu\n", s->chunks);
+    fprintf(f, "parse_seconds = %.9f\n", (double)s->parse_ns / 1e9);
 }
 
 /* vim: set ts=4 et sw=4 tw=75 */
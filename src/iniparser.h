@@ -7,6 +7,17 @@
    @date    Apr 2011
    @version 4.0
    @brief   Parser for ini files.
+
+   All functions are re-entrant: different dictionaries may be loaded
+   and used from different threads at the same time. Any number of
+   threads may call the getters, including those taking handles and
+   batches, iniparser_getnsec(), iniparser_getsecname(), the iterators
+   and the dump functions on the same dictionary as long as no thread
+   modifies it meanwhile. iniparser_save_binary() packs the dictionary
+   it writes and counts as a modification. This does not hold for
+   dictionaries loaded with INI_LOAD_LAZY, whose pending sections are
+   parsed by the first lookup: share them through iniparser_config_new(),
+   which parses them first.
 */
 /*--------------------------------------------------------------------------*/
 
@@ -30,6 +41,142 @@
 
 #include "dictionary.h"
 
+/*---------------------------------------------------------------------------
+                                Defines
+ ---------------------------------------------------------------------------*/
+
+/** iniparser_load_flags(): map the file instead of reading it */
+#define INI_LOAD_MMAP   0x01
+/** iniparser_load_flags(): allocate the dictionary from an arena */
+#define INI_LOAD_ARENA  0x02
+/** iniparser_load_flags(): count the file first to presize sections */
+#define INI_LOAD_PRESIZE 0x04
+/** iniparser_load_flags(): parse sections the first time they are used */
+#define INI_LOAD_LAZY   0x08
+/** iniparser_load_flags(): share identical keys and values */
+#define INI_LOAD_INTERN 0x10
+/** iniparser_load_flags(): store keys as "section:key" in one table */
+#define INI_LOAD_FLAT   0x20
+
+/*---------------------------------------------------------------------------
+                                New types
+ ---------------------------------------------------------------------------*/
+
+/** Compiled "section:key" string, see iniparser_key_new() */
+typedef struct _ini_key_ ini_key ;
+
+/** Published configuration, see iniparser_config_new() */
+typedef struct _ini_config_ ini_config ;
+
+/** Types of settings, see iniparser_lookup() */
+typedef enum _ini_type_ {
+    INI_TYPE_STRING,    /** char *, as iniparser_getstring() returns */
+    INI_TYPE_INT,       /** int, as iniparser_getint() converts */
+    INI_TYPE_DOUBLE,    /** double, as iniparser_getdouble() converts */
+    INI_TYPE_BOOLEAN,   /** int, as iniparser_getboolean() converts */
+    INI_TYPE_INT64,     /** int64_t, as iniparser_getint64() converts */
+    INI_TYPE_UINT64     /** uint64_t, as iniparser_getuint64() converts */
+} ini_type ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Setting to look up, see iniparser_lookup()
+
+  Settings can be written as static tables, with a default value given
+  as in an ini file and the address of the variable to set.
+ */
+/*-------------------------------------------------------------------------*/
+typedef struct _ini_setting_ {
+    char        *   key ;   /** Key to look up, as "section:key" */
+    ini_type        type ;  /** Type of the value */
+    char        *   def ;   /** Default value, or NULL */
+    void        *   dest ;  /** Variable of the type to store the value in */
+} ini_setting ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Field of a configuration schema, see iniparser_load_schema()
+
+  A field is a typed member of a structure, found at offset, that holds
+  the value of a "section:key" setting.
+ */
+/*-------------------------------------------------------------------------*/
+typedef struct _ini_field_ {
+    char        *   key ;   /** Lowercased "section:key" */
+    size_t          len ;   /** Length of key */
+    ini_type        type ;  /** Type of the field */
+    char        *   def ;   /** Default value, or NULL */
+    size_t          offset ;/** Offset of the field in the structure */
+} ini_field ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Configuration schema, see iniparser_load_schema()
+
+  A schema describes the structure a configuration is loaded into. Its
+  fields are placed by a minimal perfect hash of their keys: the field
+  of a key is at the slot iniparser_schema_slot() returns for it, and
+  the n fields fill all the slots. Schemas are tables written by inigen,
+  which finds the seed and the displacement of each bucket of keys.
+ */
+/*-------------------------------------------------------------------------*/
+typedef struct _ini_schema_ {
+    const ini_field       * fields ;  /** Fields, each at its slot */
+    int                     n ;       /** Number of fields */
+    const unsigned short  * disp ;    /** Displacement of each bucket */
+    int                     nb ;      /** Number of buckets */
+    unsigned long           seed ;    /** Hash seed */
+    size_t                  size ;    /** Size of the structure */
+} ini_schema ;
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Callbacks of a streaming parser, see iniparser_parser_new()
+
+  Each callback gets the context given to the parser, spans of the line
+  with their length, and the line number. It returns non-zero to stop
+  parsing. Any callback may be NULL.
+ */
+/*-------------------------------------------------------------------------*/
+typedef struct _ini_handler_ {
+    /** Section line, name is NULL for an empty "[]" header */
+    int (* section)(void * ctx, char * name, int len, int lineno);
+    /** Key line */
+    int (* value)(void * ctx, char * key, int klen, char * val, int vlen,
+                  int lineno);
+    /** Line that cannot be parsed */
+    int (* error)(void * ctx, char * line, int len, int lineno);
+} ini_handler ;
+
+/** Streaming parser, see iniparser_parser_new() */
+typedef struct _ini_parser_ ini_parser ;
+
+/** Change reported by iniparser_reload(), key is NULL for a section */
+typedef void (* ini_change_fn)(void * ctx, char * section, char * key);
+
+/** Completion of iniparser_load_async(), d is NULL on failure */
+typedef void (* ini_load_fn)(void * ctx, dictionary * d);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Parser and dictionary counters
+
+  Counters of all the parsers and dictionaries of a process, see
+  iniparser_stats().
+ */
+/*-------------------------------------------------------------------------*/
+typedef struct _ini_stats_ {
+    dict_stats      dict ;      /** Counters of the dictionaries */
+    unsigned long   bytes ;     /** Bytes parsed */
+    unsigned long   empty ;     /** Empty lines */
+    unsigned long   comments ;  /** Comment lines */
+    unsigned long   sections ;  /** Section lines */
+    unsigned long   values ;    /** Key lines */
+    unsigned long   errors ;    /** Lines that cannot be parsed */
+    unsigned long   chunks ;    /** Chunks of parallel loads */
+    uint64_t        parse_ns ;  /** Nanoseconds spent parsing */
+} ini_stats ;
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Get number of sections in a dictionary
@@ -61,7 +208,9 @@ int iniparser_getnsec(dictionary * d);
 
   This function locates the n-th section in a dictionary and returns
   its name as a pointer to a string statically allocated inside the
-  dictionary. Do not free or modify the returned string!
+  dictionary. Do not free or modify the returned string! Sections are
+  numbered in the order they were added in, and each call takes
+  constant time without modifying the dictionary.
 
   This function returns NULL in case of error.
  */
@@ -69,6 +218,52 @@ int iniparser_getnsec(dictionary * d);
 
 char * iniparser_getsecname(dictionary * d, int n);
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Iterate over the sections of a dictionary.
+  @param    d   Dictionary to examine
+  @param    it  Iterator, to set to 0 before the first call
+  @return   Name of the next section, or NULL at the end
+
+  This function returns the section names of a dictionary in the
+  order they were added in, one per call:
+
+  @code
+  int    it = 0 ;
+  char * sec ;
+
+  while ((sec = iniparser_sec_iter(d, &it)) != NULL) {
+      printf("[%s]\n", sec);
+  }
+  @endcode
+
+  Only live sections are visited and the dictionary is not modified.
+  Do not free or modify the returned string!
+ */
+/*--------------------------------------------------------------------------*/
+char * iniparser_sec_iter(dictionary * d, int * it);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Iterate over the keys of a section.
+  @param    d       Dictionary to examine
+  @param    section Section name
+  @param    it      Iterator, to set to 0 before the first call
+  @param    val     Where to store the value of the key, or NULL
+  @return   Name of the next key in section, or NULL at the end
+
+  This function returns the key names of a section in the order they
+  were added in, one per call, as iniparser_sec_iter() does for
+  sections. Keys are returned without the section name, and their
+  value is stored in val when it is not NULL. Do not free or modify
+  the returned strings!
+
+  This function returns NULL if the section cannot be found.
+ */
+/*--------------------------------------------------------------------------*/
+char * iniparser_key_iter(dictionary * d, char * section, int * it,
+                          char ** val);
+
 
 /*-------------------------------------------------------------------------*/
 /**
@@ -79,11 +274,45 @@ char * iniparser_getsecname(dictionary * d, int n);
 
   This function dumps a given dictionary into a loadable ini file.
   It is Ok to specify @c stderr or @c stdout as output files.
+  The output is formatted in a buffer of its own and handed to the
+  stream by blocks.
  */
 /*--------------------------------------------------------------------------*/
 
 void iniparser_dump_ini(dictionary * d, FILE * f);
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Save a dictionary to a file descriptor
+  @param    d   Dictionary to dump
+  @param    fd  File descriptor to write to
+  @return   int 0 if Ok, -1 on write error.
+
+  This function writes the same output as iniparser_dump_ini(), with
+  write() calls of 16 kB blocks, without going through stdio.
+  The descriptor may be a socket or a pipe: short writes are resumed.
+ */
+/*--------------------------------------------------------------------------*/
+
+int iniparser_dump_ini_fd(dictionary * d, int fd);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Save a dictionary to a memory buffer
+  @param    d       Dictionary to dump
+  @param    buf     Buffer to write to, may be NULL if size is 0
+  @param    size    Size of buf
+  @return   Length of the whole output, not counting the final NUL.
+
+  This function writes the same output as iniparser_dump_ini() to buf,
+  as snprintf() does: at most size-1 characters are stored, followed by
+  a NUL character. A return value of size or more means the output was
+  truncated; calling the function with a size of 0 measures it.
+ */
+/*--------------------------------------------------------------------------*/
+
+size_t iniparser_dump_ini_to_buffer(dictionary * d, char * buf, size_t size);
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Dump a dictionary to an opened file pointer.
@@ -111,11 +340,28 @@ void iniparser_dump(dictionary * d, FILE * f);
   ini file is given as "section:key". If the key cannot be found,
   the pointer passed as 'def' is returned.
   The returned char pointer is pointing to a string allocated in
-  the dictionary, do not free or modify it.
+  the dictionary, do not free or modify it. It stays valid until the
+  key is set again or removed, or the dictionary is freed.
  */
 /*--------------------------------------------------------------------------*/
 char * iniparser_getstring(dictionary * d, char * key, char * def);
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a key in a section
+  @param    d       Dictionary to search
+  @param    section Section name
+  @param    key     Key name in section
+  @return   Pointer to the value, or NULL if the key cannot be found.
+
+  This function is equivalent to iniparser_getstring() with the key
+  given as section and key names instead of "section:key", and NULL as
+  default. Both names are matched ignoring case. They are not copied:
+  this is the fastest way to look up a key without a handle.
+ */
+/*--------------------------------------------------------------------------*/
+char * iniparser_get(dictionary * d, const char * section, const char * key);
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Get the string associated to a key, convert to an int
@@ -136,9 +382,12 @@ char * iniparser_getstring(dictionary * d, char * key, char * def);
   - "042"     ->  34 (octal -> decimal)
   - "0x42"    ->  66 (hexa  -> decimal)
 
-  Warning: the conversion may overflow in various ways. Conversion is
-  totally outsourced to strtol(), see the associated man page for overflow
-  handling.
+  Warning: the conversion may overflow in various ways. Values are
+  converted as by strtol(), see the associated man page for overflow
+  handling, then cast to an int. iniparser_getint64() reports overflows
+  instead.
+
+  The converted value is cached in the entry, until the value changes.
 
   Credits: Thanks to A. Becker for suggesting strtol()
  */
@@ -156,6 +405,9 @@ int iniparser_getint(dictionary * d, char * key, int notfound);
   This function queries a dictionary for a key. A key as read from an
   ini file is given as "section:key". If the key cannot be found,
   the notfound value is returned.
+
+  Values are converted as by atof(). The converted value is cached in
+  the entry, until the value changes.
  */
 /*--------------------------------------------------------------------------*/
 double iniparser_getdouble(dictionary * d, char * key, double notfound);
@@ -194,6 +446,86 @@ double iniparser_getdouble(dictionary * d, char * key, double notfound);
 /*--------------------------------------------------------------------------*/
 int iniparser_getboolean(dictionary * d, char * key, int notfound);
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a key, convert to a 64-bit int
+  @param    d Dictionary to search
+  @param    key Key string to look for
+  @param    notfound Value to return in case of error
+  @param    error Set to an error code, or NULL
+  @return   64-bit integer
+
+  This function converts values as iniparser_getint() does, in decimal,
+  octal or hexadecimal, and reports what it could not convert. error is
+  set to:
+
+  - 0 if the value is an integer in range.
+  - EINVAL if the value holds no integer, or characters after it. The
+    integer it starts with is returned, or 0.
+  - ERANGE if the integer does not fit an int64_t. The nearest limit
+    is returned.
+  - ENOENT if the key cannot be found. notfound is returned.
+
+  The converted value is cached in the entry, until the value changes.
+ */
+/*--------------------------------------------------------------------------*/
+int64_t iniparser_getint64(dictionary * d, char * key, int64_t notfound,
+                           int * error);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a key, convert to an unsigned
+            64-bit int
+  @param    d Dictionary to search
+  @param    key Key string to look for
+  @param    notfound Value to return in case of error
+  @param    error Set to an error code, or NULL
+  @return   Unsigned 64-bit integer
+
+  This function is equivalent to iniparser_getint64() for unsigned
+  values: error is set to ERANGE for negative values, for which 0 is
+  returned, and for values above UINT64_MAX.
+ */
+/*--------------------------------------------------------------------------*/
+uint64_t iniparser_getuint64(dictionary * d, char * key, uint64_t notfound,
+                             int * error);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Look up many keys at once.
+  @param    d   Dictionary to search
+  @param    s   Settings to resolve
+  @param    n   Number of settings
+  @return   Number of settings found in d, or -1 on error.
+
+  This function stores the value of each "section:key" setting at its
+  destination, converted to its type as by the matching getter. When
+  the key cannot be found, the default of the setting is converted
+  instead; without default, the destination is left as it was. So is a
+  boolean destination when the value is neither true nor false.
+  Strings are not copied.
+
+  Settings are resolved by batches of consecutive settings of the same
+  section: the section is looked up once for the whole batch, and the
+  lookups of its keys are interleaved to hide memory latency. Tables
+  sorted by section, as ini files usually are, are resolved fastest.
+  Conversion errors are not reported, see iniparser_getint64() for this.
+
+  @code
+  static int    port ;
+  static char * host ;
+
+  static const ini_setting settings[] = {
+      { "server:port", INI_TYPE_INT,    "8080",      &port },
+      { "server:host", INI_TYPE_STRING, "localhost", &host }
+  };
+
+  iniparser_lookup(ini, settings, 2);
+  @endcode
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_lookup(dictionary * d, const ini_setting * s, int n);
+
 
 /*-------------------------------------------------------------------------*/
 /**
@@ -237,6 +569,134 @@ void iniparser_unset(dictionary * ini, char * entry);
 /*--------------------------------------------------------------------------*/
 int iniparser_find_entry(dictionary * ini, char * entry) ;
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Compile a key for repeated lookups
+  @param    key     Key string to compile, as "section:key"
+  @return   Pointer to a newly allocated handle, NULL on error
+
+  This function normalizes and hashes a key once, so that the *_h
+  getters below can look it up without lowercasing, splitting or
+  hashing it again. A handle does not depend on any dictionary and can
+  be used with all of them, though dictionaries whose hashing was
+  changed by dictionary_hashing() need the names to be hashed again.
+  NULL is returned if key does not contain a colon or memory cannot be
+  allocated.
+
+  The returned handle must be freed using iniparser_key_free().
+ */
+/*--------------------------------------------------------------------------*/
+ini_key * iniparser_key_new(char * key);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Free a key handle
+  @param    h   Handle returned by iniparser_key_new(), or NULL
+  @return   void
+ */
+/*--------------------------------------------------------------------------*/
+void iniparser_key_free(ini_key * h);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a compiled key
+  @param    d       Dictionary to search
+  @param    h       Key handle returned by iniparser_key_new()
+  @param    def     Default value to return if key not found.
+  @return   pointer to statically allocated character string
+
+  This function is equivalent to iniparser_getstring() for the key h
+  was compiled from.
+ */
+/*--------------------------------------------------------------------------*/
+char * iniparser_getstring_h(dictionary * d, ini_key * h, char * def);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a compiled key, convert to an int
+  @param    d Dictionary to search
+  @param    h Key handle returned by iniparser_key_new()
+  @param    notfound Value to return in case of error
+  @return   integer
+
+  This function is equivalent to iniparser_getint() for the key h was
+  compiled from.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_getint_h(dictionary * d, ini_key * h, int notfound);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a compiled key, convert to a double
+  @param    d Dictionary to search
+  @param    h Key handle returned by iniparser_key_new()
+  @param    notfound Value to return in case of error
+  @return   double
+
+  This function is equivalent to iniparser_getdouble() for the key h
+  was compiled from.
+ */
+/*--------------------------------------------------------------------------*/
+double iniparser_getdouble_h(dictionary * d, ini_key * h, double notfound);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a compiled key, convert to a boolean
+  @param    d Dictionary to search
+  @param    h Key handle returned by iniparser_key_new()
+  @param    notfound Value to return in case of error
+  @return   integer
+
+  This function is equivalent to iniparser_getboolean() for the key h
+  was compiled from.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_getboolean_h(dictionary * d, ini_key * h, int notfound);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a compiled key, convert to a
+            64-bit int
+  @param    d Dictionary to search
+  @param    h Key handle returned by iniparser_key_new()
+  @param    notfound Value to return in case of error
+  @param    error Set to an error code, or NULL
+  @return   64-bit integer
+
+  This function is equivalent to iniparser_getint64() for the key h
+  was compiled from.
+ */
+/*--------------------------------------------------------------------------*/
+int64_t iniparser_getint64_h(dictionary * d, ini_key * h, int64_t notfound,
+                             int * error);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the string associated to a compiled key, convert to an
+            unsigned 64-bit int
+  @param    d Dictionary to search
+  @param    h Key handle returned by iniparser_key_new()
+  @param    notfound Value to return in case of error
+  @param    error Set to an error code, or NULL
+  @return   Unsigned 64-bit integer
+
+  This function is equivalent to iniparser_getuint64() for the key h
+  was compiled from.
+ */
+/*--------------------------------------------------------------------------*/
+uint64_t iniparser_getuint64_h(dictionary * d, ini_key * h,
+                               uint64_t notfound, int * error);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Finds out if a compiled key exists in a dictionary
+  @param    ini     Dictionary to search
+  @param    h       Key handle returned by iniparser_key_new()
+  @return   integer 1 if entry exists, 0 otherwise
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_find_entry_h(dictionary * ini, ini_key * h);
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Parse an ini file and return an allocated dictionary object
@@ -253,6 +713,305 @@ int iniparser_find_entry(dictionary * ini, char * entry) ;
 /*--------------------------------------------------------------------------*/
 dictionary * iniparser_load(char * ininame);
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Parse a memory-mapped ini file into a dictionary object
+  @param    ininame Name of the ini file to read.
+  @return   Pointer to newly allocated dictionary
+
+  This function is equivalent to iniparser_load(), but maps the file in
+  memory instead of reading it line by line. Lines are tokenized in the
+  private mapping and the dictionary stores pointers into it rather
+  than copies of each section name, key and value: only multi-line
+  inputs are copied. The mapping is released together with the
+  dictionary, and since there is no line buffer, lines are not limited
+  in length.
+
+  The returned dictionary must be freed using iniparser_freedict().
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_load_mmap(char * ininame);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Parse a large ini file on several threads
+  @param    ininame     Name of the ini file to read.
+  @param    nthreads    Number of threads to use, 0 for one per CPU.
+  @return   Pointer to newly allocated dictionary
+
+  This function is equivalent to iniparser_load_mmap(), for files of
+  several megabytes. The mapping is cut into chunks starting at section
+  lines, which are parsed on up to nthreads threads into dictionaries
+  of their own. Those are then merged in file order: sections and keys
+  keep the order they first appear in, repeated keys keep the last
+  value, and the error status is the same as for a sequential load.
+  Only syntax error messages of different chunks may come in another
+  order. Small files are loaded on the calling thread only.
+
+  The returned dictionary must be freed using iniparser_freedict().
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_load_parallel(char * ininame, int nthreads);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Load an ini file into a structure described by a schema
+  @param    ininame Name of the ini file to read.
+  @param    sc      Schema of the structure, as written by inigen.
+  @param    dest    Structure to fill.
+  @return   Dictionary of the keys sc does not describe, NULL on error.
+
+  This function sets each field of dest to its default value, or to 0
+  without default, then reads ininame as iniparser_load() does. The
+  value of each key of the schema is converted to the type of its
+  field as iniparser_lookup() does, and stored in dest: reading a
+  setting is then a structure member access. The field of a key is
+  found by a perfect hash of its name, computed as the line is scanned,
+  and a single comparison: these keys are not stored in any dictionary.
+
+  The other keys are stored in the returned dictionary, with all the
+  sections of the file, where the usual getters find them. String
+  fields point to the defaults of the schema or to copies released with
+  the dictionary, which must be freed using iniparser_freedict(). On
+  error, the fields of dest are left to their defaults.
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_load_schema(char * ininame, const ini_schema * sc,
+                                   void * dest);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Hash a key for a configuration schema
+  @param    key     Key to hash, as "section:key"
+  @param    len     Length of key
+  @param    seed    Seed of the schema
+  @return   Hash of the lowercased key
+
+  This is the hash iniparser_load_schema() computes for each key line,
+  for generators of schemas: see iniparser_schema_slot().
+ */
+/*--------------------------------------------------------------------------*/
+uint64_t iniparser_schema_hash(const char * key, size_t len,
+                               unsigned long seed);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Find the slot of a key in a configuration schema
+  @param    sc      Schema to search
+  @param    hash    Hash of the key, see iniparser_schema_hash()
+  @return   Slot of the key, from 0 to sc->n - 1, or -1 if sc has no field.
+
+  Keys are spread over the sc->nb buckets by the high bits of their
+  hash, then over the slots by the low bits mixed with the displacement
+  of their bucket. Keys that are not in the schema get a slot as well:
+  the key of the field found there must be compared.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_schema_slot(const ini_schema * sc, uint64_t hash);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Parse an ini file with options
+  @param    ininame Name of the ini file to read.
+  @param    flags   Bitwise or of INI_LOAD_* options, or 0.
+  @return   Pointer to newly allocated dictionary
+
+  This function is equivalent to iniparser_load(), with the loading
+  strategy selected by flags:
+
+  - INI_LOAD_MMAP loads the file as iniparser_load_mmap() does.
+  - INI_LOAD_ARENA allocates the dictionary, its sections and all the
+    strings they copy from a few large blocks, which makes loading and
+    iniparser_freedict() much cheaper. Memory of entries removed or
+    replaced later on is only reclaimed when the dictionary is freed.
+  - INI_LOAD_PRESIZE counts the sections and keys of the file in a
+    cheap first pass, then creates the dictionary and each section with
+    the exact size they need, so that none of them grows during the
+    load. Streams that cannot be rewound are loaded without counting.
+  - INI_LOAD_LAZY maps the file and only indexes its sections in a
+    first pass: the lines of a section are parsed the first time a
+    getter or setter looks the section up. Section names can be listed
+    without parsing any. Syntax errors are still reported by the first
+    pass, and INI_LOAD_PRESIZE is ignored. Looking keys up modifies a
+    lazily loaded dictionary, so it must not be read by several threads
+    at once; iniparser_config_new() and iniparser_config_publish() parse
+    the remaining sections first, as do iniparser_dump_ini() and
+    iniparser_save_binary().
+  - INI_LOAD_INTERN makes all the sections share one copy of identical
+    keys and values, see dictionary_intern(). Only strings that are
+    copied are shared: short keys are stored in their entry, and with
+    INI_LOAD_MMAP or INI_LOAD_LAZY most are references to the mapping.
+  - INI_LOAD_FLAT stores all the keys in the dictionary itself, as
+    "section:key", and the section names in a directory of their own:
+    a key is found in a single probe, without copying it for getters
+    taking "section:key", and sections cost no table each. Keys and
+    values are copied, even with INI_LOAD_MMAP, and INI_LOAD_LAZY is
+    ignored. Iterating over the keys of a section scans the whole
+    dictionary, and flat dictionaries cannot be saved as images. Keys
+    are split from their section at the first colon, so section names
+    cannot contain colons: such section lines are reported as syntax
+    errors and their keys are skipped. Keys may contain colons.
+
+  The returned dictionary must be freed using iniparser_freedict().
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_load_flags(char * ininame, int flags);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Parse an ini file without blocking the caller
+  @param    ininame Name of the ini file to read.
+  @param    flags   Bitwise or of INI_LOAD_* options, or 0.
+  @param    done    Function to call with the dictionary loaded.
+  @param    ctx     Context passed to done.
+  @return   int 0 if the load started, -1 otherwise.
+
+  This function returns at once: the file is opened, read and parsed
+  by a thread of its own, which then calls done with the newly
+  allocated dictionary, or NULL if the file cannot be loaded, and
+  exits. done is called exactly once if the load started, never
+  otherwise; the caller owns the dictionary it gets, which must be
+  freed using iniparser_freedict().
+
+  The file is read in large chunks, each one parsed as the following
+  ones are read: on Linux, through an io_uring that keeps several reads
+  in flight, elsewhere or if the kernel has no io_uring, by a second
+  thread calling read() for the chunks ahead. The result is the same as iniparser_load_flags()
+  with flags, but INI_LOAD_MMAP, INI_LOAD_PRESIZE and INI_LOAD_LAZY are
+  ignored.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_load_async(char * ininame, int flags, ini_load_fn done,
+                         void * ctx);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Create an overlay of a dictionary
+  @param    base    Dictionary to overlay, not loaded with INI_LOAD_FLAT.
+  @return   Pointer to newly allocated dictionary, NULL on error
+
+  An overlay is a copy-on-write clone of base: it starts with the
+  sections and keys of base, which it falls through to instead of
+  copying them, so that creating one takes constant time and memory
+  whatever the size of base. Getters, iterators and dumps see the keys
+  of the overlay first, then those of base. iniparser_set() and
+  iniparser_unset() only modify the overlay: the first time a section
+  of base is modified, the overlay gets a section of its own that only
+  holds the keys set or removed in it. Sections and keys keep the order
+  of base, followed by those the overlay adds; a key of base removed
+  then set again keeps its place.
+
+  base must neither be modified nor freed while overlays of it exist.
+  It may be read by overlays used in different threads, as long as
+  each one is only used by one thread at a time. An overlay can be the
+  base of other overlays. base has its pending sections parsed first if
+  it was loaded with INI_LOAD_LAZY. In overlays, iniparser_getsecname()
+  takes time proportional to the section number, and overlays cannot be
+  saved with iniparser_save_binary().
+
+  The returned dictionary must be freed using iniparser_freedict(),
+  which leaves base untouched.
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_overlay(dictionary * base);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Parse an ini file over a dictionary
+  @param    base    Dictionary to overlay, see iniparser_overlay().
+  @param    ininame Name of the ini file to read.
+  @return   Pointer to newly allocated dictionary, NULL on error
+
+  This function loads ininame as iniparser_load() does, into an overlay
+  of base: the keys of the file are added to those of base, replacing
+  the ones with the same name. Only the keys of the file are stored in
+  the returned dictionary, which must be freed using
+  iniparser_freedict() before base is.
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_load_overlay(dictionary * base, char * ininame);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Reload the changed sections of a lazily loaded ini file
+  @param    d       Dictionary loaded with INI_LOAD_LAZY.
+  @param    ininame Name of the ini file to read again.
+  @param    changed Function to report each change to, or NULL.
+  @param    ctx     Context passed to changed.
+  @return   int Number of changes, or -1 on failure.
+
+  This function indexes the new version of the file as
+  iniparser_load_flags() does with INI_LOAD_LAZY, then only parses the
+  sections whose lines differ from the ones d was loaded from, as told
+  by their length and hash. Those are updated in place, key by key:
+  other sections, their entries and handles are left as they are,
+  parsed or still pending. Sections set by the caller are compared
+  key by key, as are the keys preceding the first section line.
+
+  Each key added, changed or removed is reported by a call to changed
+  with its section and key names. Sections that appear or disappear are
+  reported as a whole with a NULL key, along with each of their keys.
+  The callback must not modify d.
+
+  If the file cannot be read or holds syntax errors, d is left
+  unchanged and -1 is returned. Dictionaries that were not loaded
+  lazily cannot be reloaded. Keys changed by a reload are copied, but
+  unchanged sections and the sections parsed from the new version
+  refer to the file: the mapping of a version is released once d no
+  longer holds any of its strings, so that values returned earlier stay
+  valid until their key changes. The file must be replaced, e.g. by
+  renaming a new version over it, rather than rewritten in place.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_reload(dictionary * d, char * ininame,
+                     ini_change_fn changed, void * ctx);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Save a dictionary as a binary image.
+  @param    d       Dictionary to save.
+  @param    binname Name of the image file to write.
+  @param    ininame Name of the ini file d was loaded from, or NULL.
+  @return   int 0 if Ok, -1 otherwise.
+
+  This function writes d in a position-independent format that
+  iniparser_load_binary() maps without parsing: the sections, their
+  entries and hash tables with the hash of each key, and the strings,
+  with offsets instead of pointers. The image holds a version and a
+  checksum, and the size, modification time and inode of ininame if it
+  is given, so that the image is known to be stale once the ini file
+  changes. The image is written to a temporary file first, then renamed
+  to binname.
+
+  Images only work with the build of the library that wrote them.
+  Dictionaries with their own hash function, loaded with
+  INI_LOAD_FLAT or overlays cannot be saved. The entries of d are
+  packed first, which moves them as dictionary_set() can.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_save_binary(dictionary * d, char * binname, char * ininame);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Load a binary image of an ini file.
+  @param    binname Name of the image file, see iniparser_save_binary().
+  @param    ininame Name of the ini file to rebuild the image from, or
+                    NULL.
+  @return   Pointer to newly allocated dictionary, or NULL.
+
+  This function maps the image in memory and looks keys up right in
+  it: nothing is parsed, hashed or copied, only the pointers of the
+  image are set. Images that are missing, damaged, of another version
+  or, when ininame is given, stale are rejected. With ininame, a
+  rejected image is then rebuilt: the ini file is loaded as by
+  iniparser_load() and saved to binname, and its dictionary returned.
+
+  The returned dictionary can be modified, changes are not written to
+  the image. It must be freed using iniparser_freedict().
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_load_binary(char * binname, char * ininame);
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Free all memory associated to an ini dictionary
@@ -266,4 +1025,218 @@ dictionary * iniparser_load(char * ininame);
 /*--------------------------------------------------------------------------*/
 void iniparser_freedict(dictionary * d);
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Create a streaming ini parser.
+  @param    h       Callbacks to call for the lines of the input.
+  @param    ctx     Pointer passed to each callback.
+  @return   Allocated parser, or NULL on memory failure.
+
+  The parser reads ini input pushed in chunks of any size with
+  iniparser_parser_feed(), as read from a socket or a decompressor, and
+  calls the callbacks of h for each line without building a dictionary.
+  It only keeps the line that goes on in the next chunk, so its memory
+  does not depend on the size of the input.
+
+  Any callback may be NULL. Callbacks get spans that are neither
+  lowercased nor NUL-terminated, with their length and the number of
+  the line, the last one of multi-line input:
+
+  - section(ctx, name, len, lineno) for section lines, with a NULL
+    name for an empty "[]" header.
+  - value(ctx, key, klen, val, vlen, lineno) for key lines, with
+    quotes and comments removed from the value.
+  - error(ctx, line, len, lineno) for lines that cannot be parsed.
+
+  Spans are only valid during the callback, which may modify their
+  characters and the one following each of them. A callback returning
+  non-zero stops parsing. The handler is copied, h may be freed.
+
+  The parser must be freed with iniparser_parser_free().
+ */
+/*--------------------------------------------------------------------------*/
+ini_parser * iniparser_parser_new(const ini_handler * h, void * ctx);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Push a chunk of ini input to a streaming parser.
+  @param    ps      Parser to feed.
+  @param    buf     Chunk of input.
+  @param    len     Number of characters in buf.
+  @return   int 0 if Ok, the status of the callback that stopped parsing,
+            -1 on memory failure.
+
+  Callbacks are called for each line the chunk completes. Lines ending
+  in the chunk are passed to them in place, spans then point into buf;
+  a line that goes on in the next chunk is kept by the parser. Once
+  parsing stopped, the chunks fed are ignored and this function returns
+  the status that stopped it.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_parser_feed(ini_parser * ps, char * buf, size_t len);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    End the input of a streaming parser.
+  @param    ps      Parser to finish.
+  @return   int 0 if Ok, the status of the callback that stopped parsing,
+            -1 on memory failure.
+
+  This function passes the last line of the input to the callbacks when
+  it has no final newline. Multi-line input still waiting for its next
+  line is dropped, as the loaders do. The parser is then ready for a
+  new input, with line numbers starting over.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_parser_end(ini_parser * ps);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Free a streaming parser.
+  @param    ps      Parser to free, may be NULL.
+  @return   void
+
+  Input fed since the last iniparser_parser_end() is discarded.
+ */
+/*--------------------------------------------------------------------------*/
+void iniparser_parser_free(ini_parser * ps);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Create a published configuration
+  @param    d       Dictionary to publish first, or NULL
+  @param    readers Maximal number of concurrent readers, 0 for 64
+  @return   Pointer to a newly allocated configuration, NULL on error
+
+  A published configuration holds a dictionary that any number of
+  threads may read while another one replaces it. Readers never take a
+  lock: iniparser_config_acquire() returns the current dictionary,
+  which stays valid and unchanged until iniparser_config_release(),
+  even if a new one is published meanwhile with iniparser_config_reload()
+  or iniparser_config_publish(). The configuration owns d from now on.
+
+  At most readers dictionaries can be acquired at a time: further
+  readers spin until one is released, so this should be at least the
+  number of reading threads. The returned configuration must be freed
+  using iniparser_config_free().
+ */
+/*--------------------------------------------------------------------------*/
+ini_config * iniparser_config_new(dictionary * d, int readers);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Start reading a published configuration
+  @param    c       Configuration to read
+  @param    ticket  Where to store the ticket to release the dictionary
+  @return   Current dictionary of c, or NULL if none was published
+
+  This function returns the dictionary currently published in c. The
+  dictionary may be read with all the getters of this module until it
+  is released by iniparser_config_release(), passing the same ticket.
+  It must not be modified. This function takes no lock, and is
+  usually cheaper than a single iniparser_getstring().
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_config_acquire(ini_config * c, int * ticket);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Stop reading a published configuration
+  @param    c       Configuration read
+  @param    ticket  Ticket set by iniparser_config_acquire()
+  @return   void
+
+  This function releases the dictionary returned by the matching
+  iniparser_config_acquire(), which must not be used afterwards.
+ */
+/*--------------------------------------------------------------------------*/
+void iniparser_config_release(ini_config * c, int ticket);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Publish a new dictionary in a configuration
+  @param    c   Configuration to update
+  @param    d   Dictionary to publish, or NULL
+  @return   int 0 if Ok, -1 otherwise.
+
+  This function atomically replaces the dictionary of c by d: readers
+  acquiring the configuration afterwards get d, those still holding
+  the previous dictionary keep reading it unchanged. The previous
+  dictionary is freed as soon as all of them released it, which this
+  function waits for. The configuration owns d from now on.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_config_publish(ini_config * c, dictionary * d);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Load an ini file and publish it in a configuration
+  @param    c       Configuration to update
+  @param    ininame Name of the ini file to read.
+  @param    flags   Bitwise or of INI_LOAD_* options, or 0.
+  @return   int 0 if Ok, -1 otherwise.
+
+  This function loads ininame as iniparser_load_flags() does, off to
+  the side, then publishes it with iniparser_config_publish(). If the
+  file cannot be loaded, the current dictionary stays published.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_config_reload(ini_config * c, char * ininame, int flags);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Free a published configuration
+  @param    c   Configuration to free
+  @return   void
+
+  This function frees a configuration and its current dictionary. No
+  reader may hold it any more.
+ */
+/*--------------------------------------------------------------------------*/
+void iniparser_config_free(ini_config * c);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the counters of the parsers and dictionaries
+  @param    s   Set to the counters
+  @return   int 0 if Ok, -1 if s is NULL or the library was compiled
+            without INIPARSER_STATS.
+
+  The counters cover every parser and dictionary of the process since
+  it started, or since iniparser_stats_reset(): the table searches and
+  allocations of the dictionaries (see dictionary_stats()), the bytes
+  parsed, the lines of each kind, the chunks iniparser_load_parallel()
+  cut files into and the time spent parsing, summed over threads,
+  callbacks included. Counters are only kept when the library is
+  compiled with INIPARSER_STATS defined, otherwise s is zeroed and the
+  library does no counting at all.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_stats(ini_stats * s);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Reset the counters of the parsers and dictionaries
+  @return   void
+
+  Sets to zero the counters iniparser_stats() returns.
+ */
+/*--------------------------------------------------------------------------*/
+void iniparser_stats_reset(void);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Dump counters to an opened file pointer
+  @param    s   Counters to dump, NULL for the current ones
+  @param    f   Opened file pointer to dump to
+  @return   void
+
+  This function prints the counters in ini format, one section for the
+  dictionaries and one for the parsers, so that they can be loaded back
+  with iniparser_load() or read by a metrics collector. The number of
+  removed entries still holding storage is printed as "tombstones".
+ */
+/*--------------------------------------------------------------------------*/
+void iniparser_dump_stats(ini_stats * s, FILE * f);
+
 #endif
@@ -0,0 +1,612 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    iniread.c
+   @date    Oct 2026
+   @version 4.0
+   @brief   Pipelined file reads for the asynchronous loader.
+
+   The io_uring is driven through its system calls and the queues the
+   kernel maps, which needs no library. Each buffer has at most one read
+   in flight, tagged with the buffer index. The reads are submitted for
+   consecutive full chunks: when one returns less, the reads after it
+   are waited for, dropped, and submitted again from where it ended.
+
+   Without a ring, a thread fills the buffers in turn while the caller
+   parses, and waits when all of them hold chunks not parsed yet. The
+   buffers are a queue: the chunk returned last, then the chunks read
+   ahead, then the buffers the thread may fill.
+*/
+/*--------------------------------------------------------------------------*/
+
+/* syscall() */
+#define _GNU_SOURCE
+
+/*---------------------------------------------------------------------------
+                                Includes
+ ---------------------------------------------------------------------------*/
+#include "iniread.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#if defined(__linux__) && !defined(INIPARSER_NO_URING)
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define INIREAD_URING
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+/*---------------------------------------------------------------------------
+                                Private types
+ ---------------------------------------------------------------------------*/
+
+#ifdef INIREAD_URING
+/* Submission and completion queues of a ring, mapped from the kernel */
+typedef struct _iniread_ring_ {
+    int                     fd ;        /* Ring descriptor, -1 if none */
+    unsigned                pending ;   /* Entries queued, not submitted */
+    unsigned              * sq_tail ;
+    unsigned              * sq_mask ;
+    unsigned              * sq_array ;
+    unsigned              * cq_head ;
+    unsigned              * cq_tail ;
+    unsigned              * cq_mask ;
+    struct io_uring_sqe   * sqes ;
+    struct io_uring_cqe   * cqes ;
+    void                  * sq_map ;
+    void                  * cq_map ;
+    size_t                  sq_sz ;
+    size_t                  cq_sz ;
+    size_t                  sqes_sz ;
+} iniread_ring ;
+#endif
+
+/* Ways of reading, see iniparser_readahead_select() */
+#define INIREAD_ANY     0
+#define INIREAD_RING    1
+#define INIREAD_THREAD  2
+
+struct _ini_readahead_ {
+    int             fd ;                    /* File read */
+    char          * buf[INIREAD_DEPTH] ;    /* Chunk buffers */
+    off_t           off[INIREAD_DEPTH] ;    /* Offset read into each */
+    long            res[INIREAD_DEPTH] ;    /* Bytes read, or -errno */
+    int             busy[INIREAD_DEPTH] ;   /* A read is in flight */
+    off_t           next ;                  /* Offset of the next read */
+    int             cur ;                   /* Buffer of the next chunk */
+    int             held ;                  /* Buffer returned, or -1 */
+#ifdef INIREAD_URING
+    struct iovec    iov[INIREAD_DEPTH] ;
+    iniread_ring    ring ;
+#endif
+    int             threaded ;              /* The thread reads */
+    pthread_t       tid ;                   /* Reading thread */
+    pthread_mutex_t lock ;                  /* Guards the fields below */
+    pthread_cond_t  cond ;                  /* Signals their changes */
+    int             ready ;                 /* Chunks read, not returned */
+    int             done ;                  /* The thread read the end */
+    int             stop ;                  /* The thread must exit */
+} ;
+
+/* Way the readers opened next read */
+static int iniread_way = INIREAD_ANY ;
+
+/*---------------------------------------------------------------------------
+                            io_uring implementation
+ ---------------------------------------------------------------------------*/
+#ifdef INIREAD_URING
+
+/* Unmaps and closes a ring */
+static void iniread_ring_free(iniread_ring * q)
+{
+    if (q->sqes) {
+        munmap(q->sqes, q->sqes_sz);
+    }
+    if (q->cq_map && q->cq_map != q->sq_map) {
+        munmap(q->cq_map, q->cq_sz);
+    }
+    if (q->sq_map) {
+        munmap(q->sq_map, q->sq_sz);
+    }
+    close(q->fd);
+    q->fd = -1 ;
+}
+
+/* Maps a queue of a ring, returns NULL on failure */
+static void * iniread_ring_map(iniread_ring * q, size_t size, off_t off)
+{
+    void    * p ;
+
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, q->fd, off);
+    return p == MAP_FAILED ? NULL : p ;
+}
+
+/* Sets up a ring of entries, returns 0 if Ok, -1 otherwise */
+static int iniread_ring_init(iniread_ring * q, unsigned entries)
+{
+    struct io_uring_params  p ;
+    char                  * sq, * cq ;
+
+    memset(q, 0, sizeof(iniread_ring));
+    memset(&p, 0, sizeof(p));
+    if ((q->fd = (int)syscall(__NR_io_uring_setup, entries, &p)) < 0) {
+        q->fd = -1 ;
+        return -1 ;
+    }
+    q->sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned) ;
+    q->cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe) ;
+    q->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe) ;
+#ifdef IORING_FEAT_SINGLE_MMAP
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        /* Both queues share one mapping */
+        if (q->cq_sz > q->sq_sz) {
+            q->sq_sz = q->cq_sz ;
+        }
+        q->sq_map = iniread_ring_map(q, q->sq_sz, IORING_OFF_SQ_RING) ;
+        q->cq_map = q->sq_map ;
+    }
+#endif
+    if (q->sq_map == NULL) {
+        q->sq_map = iniread_ring_map(q, q->sq_sz, IORING_OFF_SQ_RING) ;
+        q->cq_map = iniread_ring_map(q, q->cq_sz, IORING_OFF_CQ_RING) ;
+    }
+    q->sqes = (struct io_uring_sqe *)iniread_ring_map(q, q->sqes_sz,
+                                                      IORING_OFF_SQES) ;
+    if (q->sq_map == NULL || q->cq_map == NULL || q->sqes == NULL) {
+        iniread_ring_free(q);
+        return -1 ;
+    }
+    sq = (char *)q->sq_map ;
+    cq = (char *)q->cq_map ;
+    q->sq_tail = (unsigned *)(sq + p.sq_off.tail) ;
+    q->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask) ;
+    q->sq_array = (unsigned *)(sq + p.sq_off.array) ;
+    q->cq_head = (unsigned *)(cq + p.cq_off.head) ;
+    q->cq_tail = (unsigned *)(cq + p.cq_off.tail) ;
+    q->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask) ;
+    q->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes) ;
+    return 0 ;
+}
+
+/* Submits the queued entries, and waits for a completion if wait is */
+/* set. Returns 0 if Ok, -1 otherwise. */
+static int iniread_ring_enter(iniread_ring * q, int wait)
+{
+    long    n ;
+
+    for (;;) {
+        n = syscall(__NR_io_uring_enter, q->fd, q->pending, wait ? 1 : 0,
+                    wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0) ;
+        if (n >= 0) {
+            q->pending -= (unsigned)n ;
+            return 0 ;
+        }
+        if (errno != EINTR) {
+            return -1 ;
+        }
+    }
+}
+
+/* Queues the read of the next chunk into buffer i */
+static void iniread_push(ini_readahead * r, int i)
+{
+    iniread_ring          * q = &r->ring ;
+    unsigned                tail = *q->sq_tail ;
+    unsigned                idx = tail & *q->sq_mask ;
+    struct io_uring_sqe   * sqe = &q->sqes[idx] ;
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = IORING_OP_READV ;
+    sqe->fd = r->fd ;
+    sqe->addr = (__u64)(unsigned long)&r->iov[i] ;
+    sqe->len = 1 ;
+    sqe->off = (__u64)r->next ;
+    sqe->user_data = (__u64)i ;
+    q->sq_array[idx] = idx ;
+    /* The kernel reads the entry once it sees the new tail */
+    __atomic_store_n(q->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    q->pending++ ;
+
+    r->off[i] = r->next ;
+    r->next += INIREAD_CHUNK ;
+    r->busy[i] = 1 ;
+}
+
+/* Records the completions posted by the kernel */
+static void iniread_reap(ini_readahead * r)
+{
+    iniread_ring          * q = &r->ring ;
+    unsigned                head = *q->cq_head ;
+    unsigned                tail = __atomic_load_n(q->cq_tail,
+                                                   __ATOMIC_ACQUIRE) ;
+    struct io_uring_cqe   * cqe ;
+
+    while (head != tail) {
+        cqe = &q->cqes[head & *q->cq_mask] ;
+        r->res[cqe->user_data] = cqe->res ;
+        r->busy[cqe->user_data] = 0 ;
+        head++ ;
+    }
+    /* The entries can be reused once the kernel sees the new head */
+    __atomic_store_n(q->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* Waits for the read into buffer i, returns 0 if Ok, -1 otherwise */
+static int iniread_wait(ini_readahead * r, int i)
+{
+    for (;;) {
+        iniread_reap(r);
+        if (!r->busy[i]) {
+            return 0 ;
+        }
+        if (iniread_ring_enter(&r->ring, 1) != 0) {
+            return -1 ;
+        }
+    }
+}
+
+/* Waits for all the reads in flight, returns 0 if Ok, -1 otherwise */
+static int iniread_drain(ini_readahead * r)
+{
+    int     i ;
+
+    for (i=0 ; i<INIREAD_DEPTH ; i++) {
+        if (iniread_wait(r, i) != 0) {
+            return -1 ;
+        }
+    }
+    return 0 ;
+}
+
+/* Sets up a ring for r and submits the first reads. Returns the */
+/* number of buffers r needs. */
+static int iniread_start(ini_readahead * r)
+{
+    off_t   off ;
+    int     i ;
+
+    r->ring.fd = -1 ;
+    /* Pipes and terminals have no offsets */
+    if (__atomic_load_n(&iniread_way, __ATOMIC_RELAXED) == INIREAD_THREAD ||
+        (off = lseek(r->fd, 0, SEEK_CUR)) < 0 ||
+        iniread_ring_init(&r->ring, INIREAD_DEPTH) != 0) {
+        return 1 ;
+    }
+    if ((r->buf[0] = (char *)malloc(INIREAD_DEPTH * INIREAD_CHUNK))
+        == NULL) {
+        iniread_ring_free(&r->ring);
+        return 1 ;
+    }
+    r->next = off ;
+    for (i=0 ; i<INIREAD_DEPTH ; i++) {
+        r->buf[i] = r->buf[0] + (size_t)i * INIREAD_CHUNK ;
+        r->iov[i].iov_base = r->buf[i] ;
+        r->iov[i].iov_len = INIREAD_CHUNK ;
+        iniread_push(r, i);
+    }
+    /* A failure shows when the first chunk is waited for */
+    iniread_ring_enter(&r->ring, 0);
+    return INIREAD_DEPTH ;
+}
+
+/* Gets the next chunk from the ring */
+static int iniread_ring_next(ini_readahead * r, char ** buf, size_t * len)
+{
+    int     i, k ;
+
+    if ((i = r->held) >= 0) {
+        r->held = -1 ;
+        if (r->res[i] < INIREAD_CHUNK) {
+            /* The reads that follow start at the wrong offset */
+            if (iniread_drain(r) != 0) {
+                return -1 ;
+            }
+            r->next = r->off[i] + r->res[i] ;
+            for (k=1 ; k<=INIREAD_DEPTH ; k++) {
+                iniread_push(r, (i + k) % INIREAD_DEPTH);
+            }
+        } else {
+            iniread_push(r, i);
+        }
+        if (iniread_ring_enter(&r->ring, 0) != 0) {
+            return -1 ;
+        }
+    }
+    i = r->cur ;
+    if (iniread_wait(r, i) != 0) {
+        return -1 ;
+    }
+    if (r->res[i] < 0) {
+        errno = (int)-r->res[i] ;
+        return -1 ;
+    }
+    r->held = i ;
+    r->cur = (i + 1) % INIREAD_DEPTH ;
+    *buf = r->buf[i] ;
+    *len = (size_t)r->res[i] ;
+    return 0 ;
+}
+
+#endif
+
+/*---------------------------------------------------------------------------
+                            Thread implementation
+ ---------------------------------------------------------------------------*/
+
+/* Reads chunks into the free buffers in turn, thread function */
+static void * iniread_thread(void * arg)
+{
+    ini_readahead * r = (ini_readahead *)arg ;
+    ssize_t         n ;
+    int             i ;
+
+    pthread_mutex_lock(&r->lock);
+    while (!r->done) {
+        /* The buffer returned last is not free either */
+        while (!r->stop && r->ready + (r->held >= 0) >= INIREAD_DEPTH) {
+            pthread_cond_wait(&r->cond, &r->lock);
+        }
+        if (r->stop) {
+            break ;
+        }
+        i = (r->cur + r->ready) % INIREAD_DEPTH ;
+        pthread_mutex_unlock(&r->lock);
+        while ((n = read(r->fd, r->buf[i], INIREAD_CHUNK)) < 0 &&
+               errno == EINTR)
+            ;
+        pthread_mutex_lock(&r->lock);
+        r->res[i] = n < 0 ? -(long)errno : (long)n ;
+        r->ready++ ;
+        /* Nothing follows the end of the file or an error */
+        r->done = n <= 0 ;
+        pthread_cond_broadcast(&r->cond);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL ;
+}
+
+/* Starts the thread of r. Returns the number of buffers r needs. */
+static int iniread_thread_start(ini_readahead * r)
+{
+    int     i ;
+
+    if ((r->buf[0] = (char *)malloc(INIREAD_DEPTH * INIREAD_CHUNK))
+        == NULL) {
+        return 1 ;
+    }
+    for (i=1 ; i<INIREAD_DEPTH ; i++) {
+        r->buf[i] = r->buf[0] + (size_t)i * INIREAD_CHUNK ;
+    }
+    if (pthread_mutex_init(&r->lock, NULL) != 0) {
+        free(r->buf[0]);
+        return 1 ;
+    }
+    if (pthread_cond_init(&r->cond, NULL) != 0) {
+        pthread_mutex_destroy(&r->lock);
+        free(r->buf[0]);
+        return 1 ;
+    }
+    if (pthread_create(&r->tid, NULL, iniread_thread, r) != 0) {
+        pthread_cond_destroy(&r->cond);
+        pthread_mutex_destroy(&r->lock);
+        free(r->buf[0]);
+        return 1 ;
+    }
+    r->threaded = 1 ;
+    return INIREAD_DEPTH ;
+}
+
+/* Gets the next chunk read by the thread */
+static int iniread_thread_next(ini_readahead * r, char ** buf, size_t * len)
+{
+    long    res ;
+    int     i ;
+
+    pthread_mutex_lock(&r->lock);
+    if (r->held >= 0) {
+        /* The thread may fill the buffer again */
+        r->held = -1 ;
+        pthread_cond_broadcast(&r->cond);
+    }
+    while (r->ready == 0 && !r->done) {
+        pthread_cond_wait(&r->cond, &r->lock);
+    }
+    if (r->ready == 0) {
+        /* The end was returned already */
+        pthread_mutex_unlock(&r->lock);
+        *len = 0 ;
+        return 0 ;
+    }
+    i = r->cur ;
+    r->cur = (i + 1) % INIREAD_DEPTH ;
+    r->ready-- ;
+    r->held = i ;
+    res = r->res[i] ;
+    pthread_mutex_unlock(&r->lock);
+    if (res < 0) {
+        errno = (int)-res ;
+        return -1 ;
+    }
+    *buf = r->buf[i] ;
+    *len = (size_t)res ;
+    return 0 ;
+}
+
+/* Stops the thread of r */
+static void iniread_thread_stop(ini_readahead * r)
+{
+    pthread_mutex_lock(&r->lock);
+    r->stop = 1 ;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->tid, NULL);
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->lock);
+}
+
+/*---------------------------------------------------------------------------
+                            Function codes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Start reading a file
+  @param    fd      Descriptor of the file, open for reading
+  @return   Allocated reader, or NULL on allocation failure.
+
+  The reads start at the current offset of fd and may be submitted
+  before this function returns. The reader does not close fd.
+ */
+/*--------------------------------------------------------------------------*/
+ini_readahead * iniparser_readahead_open(int fd)
+{
+    ini_readahead * r ;
+
+    if ((r = (ini_readahead *)calloc(1, sizeof(ini_readahead))) == NULL) {
+        return NULL ;
+    }
+    r->fd = fd ;
+    r->held = -1 ;
+#ifdef INIREAD_URING
+    if (iniread_start(r) > 1) {
+        return r ;
+    }
+#endif
+    if (iniread_thread_start(r) > 1) {
+        return r ;
+    }
+    if ((r->buf[0] = (char *)malloc(INIREAD_CHUNK)) == NULL) {
+        free(r);
+        return NULL ;
+    }
+    return r ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the next chunk of a file
+  @param    r       Reader
+  @param    buf     Set to the chunk
+  @param    len     Set to the size of the chunk, 0 at end of file
+  @return   int 0 if Ok, -1 if the file cannot be read.
+
+  The previous chunk returned is released. Chunks follow each other
+  without gaps or overlaps, they may be shorter than INIREAD_CHUNK.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_readahead_next(ini_readahead * r, char ** buf, size_t * len)
+{
+    ssize_t     n ;
+
+#ifdef INIREAD_URING
+    if (r->ring.fd >= 0) {
+        return iniread_ring_next(r, buf, len) ;
+    }
+#endif
+    if (r->threaded) {
+        return iniread_thread_next(r, buf, len) ;
+    }
+    while ((n = read(r->fd, r->buf[0], INIREAD_CHUNK)) < 0) {
+        if (errno != EINTR) {
+            return -1 ;
+        }
+    }
+    *buf = r->buf[0] ;
+    *len = (size_t)n ;
+    return 0 ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the way a reader reads
+  @param    r       Reader
+  @return   "io_uring", "thread" or "read".
+ */
+/*--------------------------------------------------------------------------*/
+const char * iniparser_readahead_name(ini_readahead * r)
+{
+#ifdef INIREAD_URING
+    if (r->ring.fd >= 0) {
+        return "io_uring" ;
+    }
+#endif
+    return r->threaded ? "thread" : "read" ;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Stop reading a file
+  @param    r       Reader, or NULL
+  @return   void
+
+  Waits for the reads in flight, then frees the reader.
+ */
+/*--------------------------------------------------------------------------*/
+void iniparser_readahead_close(ini_readahead * r)
+{
+    if (r == NULL) return ;
+#ifdef INIREAD_URING
+    if (r->ring.fd >= 0) {
+        if (iniread_drain(r) != 0) {
+            /* The kernel may still write to the buffers: leak them */
+            r->buf[0] = NULL ;
+        }
+        iniread_ring_free(&r->ring);
+    }
+#endif
+    if (r->threaded) {
+        iniread_thread_stop(r);
+    }
+    free(r->buf[0]);
+    free(r);
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Force the way readers read.
+  @param    name    "io_uring", "thread", or NULL for the best one
+                    available.
+  @return   int 0 if Ok, -1 if the way is not available.
+
+  This function is meant for benchmarks and tests. It applies to the
+  readers opened afterwards. Files without offsets, such as pipes, are
+  never read through an io_uring.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_readahead_select(const char * name)
+{
+    int             way ;
+#ifdef INIREAD_URING
+    iniread_ring    q ;
+#endif
+
+    if (name == NULL) {
+        way = INIREAD_ANY ;
+    } else if (!strcmp(name, "thread")) {
+        way = INIREAD_THREAD ;
+    } else if (!strcmp(name, "io_uring")) {
+#ifdef INIREAD_URING
+        /* The kernel may refuse rings */
+        if (iniread_ring_init(&q, INIREAD_DEPTH) != 0) {
+            return -1 ;
+        }
+        iniread_ring_free(&q);
+        way = INIREAD_RING ;
+#else
+        return -1 ;
+#endif
+    } else {
+        return -1 ;
+    }
+    __atomic_store_n(&iniread_way, way, __ATOMIC_RELAXED);
+    return 0 ;
+}
+
+/* vim: set ts=4 et sw=4 tw=75 */
@@ -0,0 +1,109 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    iniread.h
+   @date    Oct 2026
+   @version 4.0
+   @brief   Pipelined file reads for the asynchronous loader.
+
+   This module reads a file sequentially in large chunks, several of
+   them ahead of the one the caller parses, so that parsing overlaps
+   with the latency of the file system. On Linux, the chunks are read
+   through an io_uring that keeps several reads in flight. Elsewhere,
+   when the kernel refuses to set up a ring, for files without offsets
+   or with INIPARSER_NO_URING defined, a thread of the reader reads the
+   chunks with read(). Without that thread, chunks are read one after
+   the other by the caller.
+*/
+/*--------------------------------------------------------------------------*/
+
+#ifndef _INIREAD_H_
+#define _INIREAD_H_
+
+#include <stddef.h>
+
+/*---------------------------------------------------------------------------
+                                New types
+ ---------------------------------------------------------------------------*/
+
+/** Size of the chunks read */
+#define INIREAD_CHUNK   (512*1024)
+
+/** Number of chunks read ahead, the one being parsed included */
+#define INIREAD_DEPTH   4
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Sequential reader of a file
+
+  The buffers of a reader are only valid until the next call to
+  iniparser_readahead_next() or iniparser_readahead_close().
+ */
+/*-------------------------------------------------------------------------*/
+typedef struct _ini_readahead_ ini_readahead ;
+
+/*---------------------------------------------------------------------------
+                            Function prototypes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Start reading a file
+  @param    fd      Descriptor of the file, open for reading
+  @return   Allocated reader, or NULL on allocation failure.
+
+  The reads start at the current offset of fd and may be submitted
+  before this function returns. The reader does not close fd.
+ */
+/*--------------------------------------------------------------------------*/
+ini_readahead * iniparser_readahead_open(int fd);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the next chunk of a file
+  @param    r       Reader
+  @param    buf     Set to the chunk
+  @param    len     Set to the size of the chunk, 0 at end of file
+  @return   int 0 if Ok, -1 if the file cannot be read.
+
+  The previous chunk returned is released. Chunks follow each other
+  without gaps or overlaps, they may be shorter than INIREAD_CHUNK.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_readahead_next(ini_readahead * r, char ** buf, size_t * len);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Get the way a reader reads
+  @param    r       Reader
+  @return   "io_uring", "thread" or "read".
+ */
+/*--------------------------------------------------------------------------*/
+const char * iniparser_readahead_name(ini_readahead * r);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Stop reading a file
+  @param    r       Reader, or NULL
+  @return   void
+
+  Waits for the reads in flight, then frees the reader.
+ */
+/*--------------------------------------------------------------------------*/
+void iniparser_readahead_close(ini_readahead * r);
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Force the way readers read.
+  @param    name    "io_uring", "thread", or NULL for the best one
+                    available.
+  @return   int 0 if Ok, -1 if the way is not available.
+
+  This function is meant for benchmarks and tests. It applies to the
+  readers opened afterwards. Files without offsets, such as pipes, are
+  never read through an io_uring.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_readahead_select(const char * name);
+
+#endif
+/* vim: set ts=4 et sw=4 tw=75 */
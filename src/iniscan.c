@@ -0,0 +1,427 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    iniscan.c
+   @date    Oct 2026
+   @version 4.0
+   @brief   Vectorized character search for the ini parser.
+
+   Vector implementations never read outside of [p, end): ranges shorter
+   than a vector go to the next narrower implementation, and the last
+   partial block of a range is loaded so that it ends at end, overlapping
+   bytes that were already checked.
+*/
+/*--------------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------------
+                                Includes
+ ---------------------------------------------------------------------------*/
+#include "iniscan.h"
+
+#include <string.h>
+#include <stdint.h>
+
+#if !defined(INIPARSER_NO_SIMD)
+#if defined(__SSE2__)
+#define INISCAN_SSE2
+#include <emmintrin.h>
+#if defined(__clang__) || (defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define INISCAN_AVX2
+#include <immintrin.h>
+#endif
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define INISCAN_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+/*---------------------------------------------------------------------------
+                            Scalar implementation
+ ---------------------------------------------------------------------------*/
+
+static const char * scalar_find2(const char * p, const char * end,
+                                 int a, int b)
+{
+    const char * q ;
+
+    if (a == b) {
+        q = (const char *)memchr(p, a, end - p);
+        return q ? q : end ;
+    }
+    while (p < end && *p != (char)a && *p != (char)b) {
+        p++ ;
+    }
+    return p ;
+}
+
+static const char * scalar_skipws(const char * p, const char * end)
+{
+    while (p < end && iniscan_isblank(*p)) {
+        p++ ;
+    }
+    return p ;
+}
+
+static const char * scalar_rskipws(const char * p, const char * end)
+{
+    while (end > p && iniscan_isblank(end[-1])) {
+        end-- ;
+    }
+    return end ;
+}
+
+/*---------------------------------------------------------------------------
+                            SSE2 implementation
+ ---------------------------------------------------------------------------*/
+#ifdef INISCAN_SSE2
+
+/* Mask of the blank bytes in x */
+__inline__ static int sse2_blank(__m128i x)
+{
+    __m128i t = _mm_sub_epi8(x, _mm_set1_epi8('\t'));
+    __m128i c = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t);
+
+    c = _mm_or_si128(c, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+    return _mm_movemask_epi8(c);
+}
+
+static const char * sse2_find2(const char * p, const char * end,
+                               int a, int b)
+{
+    __m128i     va, vb, x ;
+    int         m ;
+
+    if (end - p < 16) {
+        return scalar_find2(p, end, a, b);
+    }
+    va = _mm_set1_epi8((char)a);
+    vb = _mm_set1_epi8((char)b);
+    for (;;) {
+        if (end - p < 16) {
+            p = end - 16 ;
+        }
+        x = _mm_loadu_si128((const __m128i *)p);
+        m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, va),
+                                           _mm_cmpeq_epi8(x, vb)));
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+        if ((p += 16) >= end) {
+            return end ;
+        }
+    }
+}
+
+static const char * sse2_skipws(const char * p, const char * end)
+{
+    int     m ;
+
+    if (end - p < 16) {
+        return scalar_skipws(p, end);
+    }
+    for (;;) {
+        if (end - p < 16) {
+            p = end - 16 ;
+        }
+        m = ~sse2_blank(_mm_loadu_si128((const __m128i *)p)) & 0xffff ;
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+        if ((p += 16) >= end) {
+            return end ;
+        }
+    }
+}
+
+static const char * sse2_rskipws(const char * p, const char * end)
+{
+    int     m ;
+
+    if (end - p < 16) {
+        return scalar_rskipws(p, end);
+    }
+    for (;;) {
+        if (end - p < 16) {
+            end = p + 16 ;
+        }
+        m = ~sse2_blank(_mm_loadu_si128((const __m128i *)(end - 16))) & 0xffff ;
+        if (m) {
+            return end - 16 + (32 - __builtin_clz(m));
+        }
+        if ((end -= 16) <= p) {
+            return p ;
+        }
+    }
+}
+
+#endif
+
+/*---------------------------------------------------------------------------
+                            AVX2 implementation
+ ---------------------------------------------------------------------------*/
+#ifdef INISCAN_AVX2
+
+#define AVX2_FN __attribute__((target("avx2")))
+
+AVX2_FN __inline__ static unsigned avx2_blank(__m256i x)
+{
+    __m256i t = _mm256_sub_epi8(x, _mm256_set1_epi8('\t'));
+    __m256i c = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(4)), t);
+
+    c = _mm256_or_si256(c, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+    return (unsigned)_mm256_movemask_epi8(c);
+}
+
+AVX2_FN static const char * avx2_find2(const char * p, const char * end,
+                                       int a, int b)
+{
+    __m256i     va, vb, x ;
+    unsigned    m ;
+
+    if (end - p < 32) {
+        return sse2_find2(p, end, a, b);
+    }
+    va = _mm256_set1_epi8((char)a);
+    vb = _mm256_set1_epi8((char)b);
+    for (;;) {
+        if (end - p < 32) {
+            p = end - 32 ;
+        }
+        x = _mm256_loadu_si256((const __m256i *)p);
+        m = (unsigned)_mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_cmpeq_epi8(x, va),
+                                _mm256_cmpeq_epi8(x, vb)));
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+        if ((p += 32) >= end) {
+            return end ;
+        }
+    }
+}
+
+AVX2_FN static const char * avx2_skipws(const char * p, const char * end)
+{
+    unsigned    m ;
+
+    if (end - p < 32) {
+        return sse2_skipws(p, end);
+    }
+    for (;;) {
+        if (end - p < 32) {
+            p = end - 32 ;
+        }
+        m = ~avx2_blank(_mm256_loadu_si256((const __m256i *)p));
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+        if ((p += 32) >= end) {
+            return end ;
+        }
+    }
+}
+
+AVX2_FN static const char * avx2_rskipws(const char * p, const char * end)
+{
+    unsigned    m ;
+
+    if (end - p < 32) {
+        return sse2_rskipws(p, end);
+    }
+    for (;;) {
+        if (end - p < 32) {
+            end = p + 32 ;
+        }
+        m = ~avx2_blank(_mm256_loadu_si256((const __m256i *)(end - 32)));
+        if (m) {
+            return end - 32 + (32 - __builtin_clz(m));
+        }
+        if ((end -= 32) <= p) {
+            return p ;
+        }
+    }
+}
+
+#endif
+
+/*---------------------------------------------------------------------------
+                            NEON implementation
+ ---------------------------------------------------------------------------*/
+#ifdef INISCAN_NEON
+
+/* NEON has no movemask: narrow the comparison to 4 bits per byte */
+__inline__ static uint64_t neon_mask(uint8x16_t c)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(
+               vshrn_n_u16(vreinterpretq_u16_u8(c), 4)), 0);
+}
+
+__inline__ static uint8x16_t neon_blank(uint8x16_t x)
+{
+    uint8x16_t t = vsubq_u8(x, vdupq_n_u8('\t'));
+
+    return vorrq_u8(vcleq_u8(t, vdupq_n_u8(4)),
+                    vceqq_u8(x, vdupq_n_u8(' ')));
+}
+
+static const char * neon_find2(const char * p, const char * end,
+                               int a, int b)
+{
+    uint8x16_t  va, vb, x ;
+    uint64_t    m ;
+
+    if (end - p < 16) {
+        return scalar_find2(p, end, a, b);
+    }
+    va = vdupq_n_u8((uint8_t)a);
+    vb = vdupq_n_u8((uint8_t)b);
+    for (;;) {
+        if (end - p < 16) {
+            p = end - 16 ;
+        }
+        x = vld1q_u8((const uint8_t *)p);
+        m = neon_mask(vorrq_u8(vceqq_u8(x, va), vceqq_u8(x, vb)));
+        if (m) {
+            return p + (__builtin_ctzll(m) >> 2);
+        }
+        if ((p += 16) >= end) {
+            return end ;
+        }
+    }
+}
+
+static const char * neon_skipws(const char * p, const char * end)
+{
+    uint64_t    m ;
+
+    if (end - p < 16) {
+        return scalar_skipws(p, end);
+    }
+    for (;;) {
+        if (end - p < 16) {
+            p = end - 16 ;
+        }
+        m = neon_mask(vmvnq_u8(neon_blank(vld1q_u8((const uint8_t *)p))));
+        if (m) {
+            return p + (__builtin_ctzll(m) >> 2);
+        }
+        if ((p += 16) >= end) {
+            return end ;
+        }
+    }
+}
+
+static const char * neon_rskipws(const char * p, const char * end)
+{
+    uint64_t    m ;
+
+    if (end - p < 16) {
+        return scalar_rskipws(p, end);
+    }
+    for (;;) {
+        if (end - p < 16) {
+            end = p + 16 ;
+        }
+        m = neon_mask(vmvnq_u8(neon_blank(
+                vld1q_u8((const uint8_t *)(end - 16)))));
+        if (m) {
+            return end - 16 + ((63 - __builtin_clzll(m)) >> 2) + 1;
+        }
+        if ((end -= 16) <= p) {
+            return p ;
+        }
+    }
+}
+
+#endif
+
+/*---------------------------------------------------------------------------
+                            Runtime dispatch
+ ---------------------------------------------------------------------------*/
+
+static const iniscan_ops iniscan_impls[] = {
+#ifdef INISCAN_AVX2
+    { "avx2", avx2_find2, avx2_skipws, avx2_rskipws },
+#endif
+#ifdef INISCAN_SSE2
+    { "sse2", sse2_find2, sse2_skipws, sse2_rskipws },
+#endif
+#ifdef INISCAN_NEON
+    { "neon", neon_find2, neon_skipws, neon_rskipws },
+#endif
+    { "scalar", scalar_find2, scalar_skipws, scalar_rskipws }
+};
+
+#define INISCAN_NIMPLS  (int)(sizeof(iniscan_impls) / sizeof(iniscan_impls[0]))
+
+/* Returns non-zero if the running CPU supports implementation i */
+static int iniscan_supported(int i)
+{
+#ifdef INISCAN_AVX2
+    if (!strcmp(iniscan_impls[i].name, "avx2")) {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    (void)i ;
+    return 1 ;
+}
+
+/* The first call of any search selects the implementation */
+static const char * init_find2(const char * p, const char * end,
+                               int a, int b)
+{
+    iniparser_scanner_select(NULL);
+    return iniscan_ops_get()->find2(p, end, a, b);
+}
+
+static const char * init_skipws(const char * p, const char * end)
+{
+    iniparser_scanner_select(NULL);
+    return iniscan_ops_get()->skipws(p, end);
+}
+
+static const char * init_rskipws(const char * p, const char * end)
+{
+    iniparser_scanner_select(NULL);
+    return iniscan_ops_get()->rskipws(p, end);
+}
+
+static const iniscan_ops iniscan_init =
+    { "auto", init_find2, init_skipws, init_rskipws };
+
+const iniscan_ops * iniparser_scanner = &iniscan_init ;
+
+/*---------------------------------------------------------------------------
+                            Function codes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Force a search implementation.
+  @param    name    Implementation name: "scalar", "sse2", "avx2", "neon",
+                    or NULL for the best one the CPU supports.
+  @return   int 0 if Ok, -1 if the implementation is not available.
+
+  This function is meant for benchmarks and tests. The searches already
+  running when it is called finish with the previous implementation.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_scanner_select(const char * name)
+{
+    int     i ;
+
+    for (i=0 ; i<INISCAN_NIMPLS ; i++) {
+        if ((name == NULL || !strcmp(name, iniscan_impls[i].name)) &&
+            iniscan_supported(i)) {
+            /* The searches are replaced together: concurrent first */
+            /* uses see either the init functions or the selected ones */
+            __atomic_store_n(&iniparser_scanner, &iniscan_impls[i],
+                             __ATOMIC_RELEASE);
+            return 0 ;
+        }
+    }
+    return -1 ;
+}
+
+/* vim: set ts=4 et sw=4 tw=75 */
@@ -0,0 +1,73 @@
+/*-------------------------------------------------------------------------*/
+/**
+   @file    iniscan.h
+   @date    Oct 2026
+   @version 4.0
+   @brief   Vectorized character search for the ini parser.
+
+   This module provides the few byte searches the parser spends its time
+   in: finding a structural character (end of line, equal sign, comment
+   or quote) and skipping blanks. Each search has a scalar
+   implementation and, where the CPU supports it, SSE2, AVX2 or NEON
+   ones processing 16 or 32 bytes at a time. The implementation is
+   picked at runtime on first use.
+
+   Blanks are the characters isspace() accepts in the C locale. No
+   search ever reads outside of the provided range.
+*/
+/*--------------------------------------------------------------------------*/
+
+#ifndef _INISCAN_H_
+#define _INISCAN_H_
+
+/*---------------------------------------------------------------------------
+                                New types
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Search implementation
+
+  This object holds one implementation of each search. All functions
+  work on the range [p, end) and return end when nothing is found.
+ */
+/*-------------------------------------------------------------------------*/
+typedef struct _iniscan_ops_ {
+    const char   *  name ;  /** Implementation name */
+    /** First occurrence of character a or b */
+    const char * (* find2)(const char * p, const char * end, int a, int b);
+    /** First non-blank character */
+    const char * (* skipws)(const char * p, const char * end);
+    /** Position following the last non-blank character, or p */
+    const char * (* rskipws)(const char * p, const char * end);
+} iniscan_ops ;
+
+/** Implementation in use, selected on first use */
+extern const iniscan_ops * iniparser_scanner ;
+
+/** Implementation in use, read atomically */
+#define iniscan_ops_get() \
+    __atomic_load_n(&iniparser_scanner, __ATOMIC_ACQUIRE)
+
+/** True for the characters isspace() accepts in the C locale */
+#define iniscan_isblank(c) \
+    ((c)==' ' || (unsigned)((unsigned char)(c) - '\t') < 5u)
+
+/*---------------------------------------------------------------------------
+                            Function prototypes
+ ---------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Force a search implementation.
+  @param    name    Implementation name: "scalar", "sse2", "avx2", "neon",
+                    or NULL for the best one the CPU supports.
+  @return   int 0 if Ok, -1 if the implementation is not available.
+
+  This function is meant for benchmarks and tests. The searches already
+  running when it is called finish with the previous implementation.
+ */
+/*--------------------------------------------------------------------------*/
+int iniparser_scanner_select(const char * name);
+
+#endif
@@ -1,10 +1,15 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/time.h>
 
 #include "iniparser.h"
+#include "iniscan.h"
+#include "iniread.h"
+#include "example.h"
 
 double epoch_double()
 {
@@ -16,22 +21,213 @@ double epoch_double()
 void stop_timer(char *s, double t1)
 {
     double t2 = epoch_double();
-    printf("%15s: %f\n", s, t2 - t1);
+    printf("%17s: %f\n", s, t2 - t1);
 }
 
 #ifndef BENCHSIZE
 #define BENCHSIZE 256
 #endif
 
+#ifndef BENCHTHREADS
+#define BENCHTHREADS 4
+#endif
+
+/* Work of a stress thread: load a file, or look up a shared dictionary */
+/* or configuration */
+typedef struct {
+    dictionary * ini;
+    ini_config * conf;
+    char       * ini_name;
+    char       * secs;
+    char       * keys;
+    int          errs;
+} bench_job;
+
+/* Looks every key of the grid up, in upper case to exercise the */
+/* lowercasing, and counts wrong answers */
+void * bench_worker(void * arg)
+{
+    bench_job  * b = arg;
+    dictionary * d = b->ini;
+    char         buffer[64];
+    char       * p;
+    int          i, j, ticket;
+
+    if (b->ini == NULL && b->conf == NULL)
+        d = iniparser_load(b->ini_name);
+    if (d == NULL && b->conf == NULL) {
+        b->errs++;
+        return NULL;
+    }
+    for(i = 0 ; i < BENCHSIZE ; i++) {
+        for(j = 0 ; j < BENCHSIZE ; j++) {
+            sprintf(buffer, "%s:%s", b->secs + 12 * i, b->keys + 12 * j);
+            for(p = buffer ; *p ; p++) {
+                if(*p >= 'a' && *p <= 'z')
+                    *p -= 'a' - 'A';
+            }
+            if(b->conf)
+                d = iniparser_config_acquire(b->conf, &ticket);
+            if(iniparser_getint(d, buffer, 0) != 1)
+                b->errs++;
+            if(b->conf)
+                iniparser_config_release(b->conf, ticket);
+        }
+    }
+    if (b->ini == NULL && b->conf == NULL) {
+        iniparser_freedict(d);
+    }
+    return NULL;
+}
+
+/* Streaming parser callback counting the keys */
+int bench_value(void * ctx, char * key, int klen, char * val, int vlen,
+                int lineno)
+{
+    (void)key; (void)klen; (void)val; (void)vlen; (void)lineno;
+    (*(int *)ctx)++;
+    return 0;
+}
+
+/* Returns the number of mappings of files called name, or -1 */
+int bench_mapped(char * name)
+{
+    FILE * f = fopen("/proc/self/maps", "r");
+    char   buf[512];
+    int    n = 0;
+
+    if(f == NULL)
+        return -1;
+    while(fgets(buf, sizeof(buf), f))
+        n += strstr(buf, name) != NULL;
+    fclose(f);
+    return n;
+}
+
+/* Returns 0 if a and b dump the same sections and keys in the same */
+/* order */
+int bench_same(dictionary * a, dictionary * b)
+{
+    size_t na, nb;
+    char * da, * db;
+    int    diff;
+
+    if(a == NULL || b == NULL)
+        return -1;
+    na = iniparser_dump_ini_to_buffer(a, NULL, 0);
+    nb = iniparser_dump_ini_to_buffer(b, NULL, 0);
+    if(na != nb)
+        return -1;
+    da = malloc(na + 1);
+    db = malloc(nb + 1);
+    iniparser_dump_ini_to_buffer(a, da, na + 1);
+    iniparser_dump_ini_to_buffer(b, db, nb + 1);
+    diff = memcmp(da, db, na);
+    free(da);
+    free(db);
+    return diff;
+}
+
+/* Runs BENCHTHREADS jobs, on as many threads if threaded is set, */
+/* returns the number of wrong answers */
+int bench_stress(dictionary * ini, ini_config * conf, char * ini_name,
+                 char * secs, char * keys, int threaded)
+{
+    pthread_t    tid[BENCHTHREADS];
+    bench_job    jobs[BENCHTHREADS];
+    int          i, j, errs = 0;
+
+    for(i = 0 ; i < BENCHTHREADS ; i++) {
+        jobs[i].ini = ini;
+        jobs[i].conf = conf;
+        jobs[i].ini_name = ini_name;
+        jobs[i].secs = secs;
+        jobs[i].keys = keys;
+        jobs[i].errs = 0;
+        if(!threaded) {
+            bench_worker(&jobs[i]);
+        } else if(pthread_create(&tid[i], NULL, bench_worker, &jobs[i])) {
+            exit(-1);
+        }
+    }
+    for(i = 0 ; i < BENCHTHREADS ; i++) {
+        /* The main thread reloads the configuration meanwhile */
+        for(j = 0 ; threaded && conf && i == 0 && j < 8 ; j++) {
+            if(iniparser_config_reload(conf, ini_name, 0))
+                errs++;
+        }
+        if(threaded)
+            pthread_join(tid[i], NULL);
+        errs += jobs[i].errs;
+    }
+    return errs;
+}
+
+/* Completion of an asynchronous load */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    dictionary    * ini;
+    int             done;
+} bench_wait;
+
+void bench_loaded(void * ctx, dictionary * d)
+{
+    bench_wait * w = ctx;
+
+    pthread_mutex_lock(&w->lock);
+    w->ini = d;
+    w->done = 1;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+/* Loads a file with iniparser_load_async() and waits for it */
+dictionary * bench_async(char * ini_name)
+{
+    bench_wait w;
+
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.cond, NULL);
+    w.ini = NULL;
+    w.done = 0;
+    if(iniparser_load_async(ini_name, 0, bench_loaded, &w) == 0) {
+        pthread_mutex_lock(&w.lock);
+        while(!w.done)
+            pthread_cond_wait(&w.cond, &w.lock);
+        pthread_mutex_unlock(&w.lock);
+    }
+    pthread_cond_destroy(&w.cond);
+    pthread_mutex_destroy(&w.lock);
+    return w.ini;
+}
+
 int main(int argc, char * argv[])
 {
     dictionary * ini ;
+    dictionary * copy ;
     char       * ini_name ;
     int          i, j ;
     FILE       * f;
     double       t1;
     char       * secs;
     char       * keys;
+    char         name[32];
+    char         line[65];
+    char       * dump;
+    char       * ways[2];
+    example      sc;
+    ini_stats    st;
+    unsigned long chunks;
+    size_t       size;
+    ini_key   ** handles;
+    ini_setting* settings;
+    int        * values;
+    ini_config * conf;
+    const char * scanners[] = { "scalar", "sse2", "avx2", "neon" };
+    const char * hnames[] = { "wyhash", "sfh" };
+    dict_hash_fn hashes[] = { dictionary_hash_wy, dictionary_hash_sfh };
+    unsigned     sum = 0;
 
 	if (argc<2) {
         ini_name = "bench.ini";
@@ -76,8 +272,37 @@ int main(int argc, char * argv[])
     stop_timer("Saving", t1);
     fclose(f);
 
+    /* Measure the output once, then write it to memory */
+    t1 = epoch_double();
+    size = iniparser_dump_ini_to_buffer(ini, NULL, 0);
+    dump = malloc(size + 1);
+    if(iniparser_dump_ini_to_buffer(ini, dump, size + 1) != size) {
+        printf("wrong dump size\n");
+        exit(-1);
+    }
+    stop_timer("Saving (buffer)", t1);
+    free(dump);
+
     dictionary_del(ini);
 
+    t1 = epoch_double();
+    ini = iniparser_load_mmap(ini_name);
+    stop_timer("Loading (mmap)", t1);
+
+    dictionary_del(ini);
+
+    for(i = 0 ; i < (int)(sizeof(scanners) / sizeof(scanners[0])) ; i++) {
+        if(iniparser_scanner_select(scanners[i]) < 0) {
+            continue;
+        }
+        sprintf(name, "Mapping (%s)", scanners[i]);
+        t1 = epoch_double();
+        ini = iniparser_load_mmap(ini_name);
+        stop_timer(name, t1);
+        dictionary_del(ini);
+    }
+    iniparser_scanner_select(NULL);
+
     t1 = epoch_double();
     ini = iniparser_load(ini_name);
     stop_timer("Loading", t1);
@@ -95,7 +320,627 @@ int main(int argc, char * argv[])
     }
     stop_timer("Getting", t1);
 
+    /* Section and key names are looked up as given, without copies */
+    t1 = epoch_double();
+    for(i = 0 ; i < BENCHSIZE ; i++) {
+        for(j = 0 ; j < BENCHSIZE ; j++) {
+            if(iniparser_get(ini, secs + 12 * i, keys + 12 * j) == NULL) {
+                printf("missing key\n");
+                exit(-1);
+            }
+        }
+    }
+    stop_timer("Getting (names)", t1);
+
+    handles = malloc(BENCHSIZE * BENCHSIZE * sizeof(ini_key *));
+    for(i = 0 ; i < BENCHSIZE ; i++) {
+        for(j = 0 ; j < BENCHSIZE ; j++) {
+            char buffer[64];
+            sprintf(buffer, "%s:%s", secs + 12 * i, keys + 12 * j);
+            handles[i * BENCHSIZE + j] = iniparser_key_new(buffer);
+        }
+    }
+    t1 = epoch_double();
+    for(i = 0 ; i < BENCHSIZE * BENCHSIZE ; i++) {
+        iniparser_getstring_h(ini, handles[i], NULL);
+    }
+    stop_timer("Getting (handles)", t1);
+
+    /* Integers are converted on first use, then read from the cache */
+    t1 = epoch_double();
+    for(j = 0 ; j < 4 ; j++) {
+        for(i = 0 ; i < BENCHSIZE * BENCHSIZE ; i++) {
+            int err;
+            if(iniparser_getint64_h(ini, handles[i], 0, &err) != 1 || err) {
+                printf("wrong integer\n");
+                exit(-1);
+            }
+        }
+    }
+    stop_timer("Getting (int64)", t1);
+
+    /* Settings are sorted by section, they are looked up by batches */
+    settings = malloc(BENCHSIZE * BENCHSIZE * sizeof(ini_setting));
+    values = malloc(BENCHSIZE * BENCHSIZE * sizeof(int));
+    for(i = 0 ; i < BENCHSIZE * BENCHSIZE ; i++) {
+        settings[i].key = malloc(24);
+        sprintf(settings[i].key, "%s:%s", secs + 12 * (i / BENCHSIZE),
+                keys + 12 * (i % BENCHSIZE));
+        settings[i].type = INI_TYPE_INT;
+        settings[i].def = NULL;
+        settings[i].dest = values + i;
+        values[i] = 0;
+    }
+    t1 = epoch_double();
+    if(iniparser_lookup(ini, settings, BENCHSIZE * BENCHSIZE)
+       != BENCHSIZE * BENCHSIZE) {
+        printf("wrong lookup\n");
+        exit(-1);
+    }
+    stop_timer("Getting (batch)", t1);
+    for(i = 0 ; i < BENCHSIZE * BENCHSIZE ; i++) {
+        if(values[i] != 1) {
+            printf("wrong integer\n");
+            exit(-1);
+        }
+        free(settings[i].key);
+    }
+    free(settings);
+    free(values);
+
+    t1 = epoch_double();
+    for(i = 0 ; i < iniparser_getnsec(ini) ; i++) {
+        char * v;
+        j = 0;
+        while (iniparser_key_iter(ini, iniparser_getsecname(ini, i), &j, &v))
+            sum += (unsigned)v[0];
+    }
+    stop_timer("Enumerating", t1);
+
+    /* Remove and add back keys, for tables keeping tombstones */
+    t1 = epoch_double();
+    for(i = 0 ; i < BENCHSIZE * BENCHSIZE ; i++) {
+        char buffer[64];
+        sprintf(buffer, "%s:%s", secs + 12 * (i % BENCHSIZE),
+                keys + 12 * ((i / BENCHSIZE + i) % BENCHSIZE));
+        iniparser_unset(ini, buffer);
+        iniparser_set(ini, buffer, "2");
+    }
+    stop_timer("Churning", t1);
+
+    /* Sections are numbered past a removed one without moving them */
+    dictionary_unset(ini, secs + 12);
+    {
+        char * first = iniparser_getsecname(ini, 1);
+
+        for(i = 1 ; i < iniparser_getnsec(ini) ; i++) {
+            if(strcmp(iniparser_getsecname(ini, i), secs + 12 * (i + 1))) {
+                printf("wrong section order\n");
+                exit(-1);
+            }
+        }
+        if(iniparser_getnsec(ini) != BENCHSIZE - 1 ||
+           iniparser_getsecname(ini, 1) != first) {
+            printf("section names moved\n");
+            exit(-1);
+        }
+    }
+
+    /* Values outlive the growth of their section */
+    {
+        char * v;
+
+        sprintf(line, "%s:%s", secs + 24, keys);
+        iniparser_set(ini, line, "short");
+        v = iniparser_getstring(ini, line, NULL);
+        for(i = 0 ; i < 2 * BENCHSIZE ; i++) {
+            sprintf(line, "%s:new%08x", secs + 24, i);
+            iniparser_set(ini, line, "1");
+        }
+        sprintf(line, "%s:%s", secs + 24, keys + 12);
+        iniparser_unset(ini, line);
+        sprintf(line, "%s:%s", secs + 24, keys);
+        if(v != iniparser_getstring(ini, line, NULL) || strcmp(v, "short")) {
+            printf("value moved\n");
+            exit(-1);
+        }
+    }
+    for(i = 0 ; i < BENCHSIZE * BENCHSIZE ; i++) {
+        iniparser_key_free(handles[i]);
+    }
+    free(handles);
+
+    t1 = epoch_double();
+    dictionary_del(ini);
+    stop_timer("Freeing", t1);
+
+    for(i = 0 ; i < 2 ; i++) {
+        sprintf(name, "Hashing (%s)", hnames[i]);
+        t1 = epoch_double();
+        for(j = 0 ; j < BENCHSIZE * BENCHSIZE ; j++) {
+            char buffer[64];
+            memcpy(buffer, secs + 12 * (j / BENCHSIZE), 11);
+            buffer[11] = ':';
+            memcpy(buffer + 12, keys + 12 * (j % BENCHSIZE), 12);
+            sum += hashes[i](buffer, 23, 0);
+        }
+        stop_timer(name, t1);
+
+        ini = dictionary_new(0);
+        dictionary_hashing(ini, hashes[i], 0);
+        t1 = epoch_double();
+        for(j = 0 ; j < BENCHSIZE * BENCHSIZE ; j++) {
+            char buffer[64];
+            memcpy(buffer, secs + 12 * (j / BENCHSIZE), 11);
+            buffer[11] = ':';
+            memcpy(buffer + 12, keys + 12 * (j % BENCHSIZE), 12);
+            dictionary_set(ini, buffer, "1");
+            dictionary_get(ini, buffer, NULL);
+        }
+        sprintf(name, "Storing (%s)", hnames[i]);
+        stop_timer(name, t1);
+        dictionary_del(ini);
+    }
+    if(sum == 1) {
+        printf("\n");
+    }
+
+    /* Longest single insertion, growing one large dictionary */
+    for(i = 0 ; i < 2 ; i++) {
+        double worst = 0, t2;
+
+        ini = dictionary_new(0);
+        dictionary_incremental(ini, i);
+        for(j = 0 ; j < BENCHSIZE * BENCHSIZE ; j++) {
+            char buffer[64];
+            memcpy(buffer, secs + 12 * (j / BENCHSIZE), 11);
+            buffer[11] = ':';
+            memcpy(buffer + 12, keys + 12 * (j % BENCHSIZE), 12);
+            t1 = epoch_double();
+            dictionary_set(ini, buffer, "1");
+            if((t2 = epoch_double() - t1) > worst) {
+                worst = t2;
+            }
+        }
+        printf("%17s: %f\n", i ? "Worst set (incr)" : "Worst set", worst);
+        dictionary_del(ini);
+    }
+
+    t1 = epoch_double();
+    ini = iniparser_load_flags(ini_name, INI_LOAD_ARENA);
+    stop_timer("Loading (arena)", t1);
+
+    t1 = epoch_double();
+    dictionary_del(ini);
+    stop_timer("Freeing (arena)", t1);
+
+    t1 = epoch_double();
+    ini = iniparser_load_flags(ini_name, INI_LOAD_PRESIZE);
+    stop_timer("Loading (presize)", t1);
+    iniparser_freedict(ini);
+
+    t1 = epoch_double();
+    ini = iniparser_load_flags(ini_name, INI_LOAD_INTERN);
+    stop_timer("Loading (intern)", t1);
+    iniparser_freedict(ini);
+
+    t1 = epoch_double();
+    ini = iniparser_load_flags(ini_name, INI_LOAD_FLAT);
+    stop_timer("Loading (flat)", t1);
+
+    /* Flat keys are found in a single probe */
+    t1 = epoch_double();
+    for(i = 0 ; i < BENCHSIZE ; i++) {
+        for(j = 0 ; j < BENCHSIZE ; j++) {
+            char buffer[64];
+            memcpy(buffer, secs + 12 * i, 11);
+            buffer[11] = ':';
+            memcpy(buffer + 12, keys + 12 * j, 12);
+            if(iniparser_getstring(ini, buffer, NULL) == NULL) {
+                printf("missing key\n");
+                exit(-1);
+            }
+        }
+    }
+    stop_timer("Getting (flat)", t1);
+    iniparser_freedict(ini);
+
+    /* Keys with a colon are not mistaken for keys of another section */
+    if(!(f = fopen("bench.flat", "w"))) {
+        exit(-1);
+    }
+    fprintf(f, "[s]\na:b = 1\n[s:a]\nb = 2\n[t]\nc = 3\n");
+    fclose(f);
+    ini = iniparser_load_flags("bench.flat", INI_LOAD_FLAT);
+    if(ini == NULL || iniparser_getnsec(ini) != 2 ||
+       strcmp(iniparser_getstring(ini, "s:a:b", ""), "1") ||
+       iniparser_get(ini, "s", "a:b") == NULL ||
+       iniparser_get(ini, "s:a", "b") != NULL ||
+       strcmp(iniparser_getstring(ini, "t:c", ""), "3")) {
+        printf("flat keys collide\n");
+        exit(-1);
+    }
+    iniparser_freedict(ini);
+    remove("bench.flat");
+
+    /* Each field of a generated schema is at the slot of its key */
+    for(i = 0 ; i < example_schema.n ; i++) {
+        if(iniparser_schema_slot(&example_schema,
+               iniparser_schema_hash(example_fields[i].key,
+                                     example_fields[i].len,
+                                     example_schema.seed)) != i) {
+            printf("schema field not found\n");
+            exit(-1);
+        }
+    }
+    if(!(f = fopen("bench.sch", "w"))) {
+        exit(-1);
+    }
+    fprintf(f, "[Pizza]\nHAM = yes\nMushrooms = 0\nCapres = true\n"
+               "Olives = 12\n[Wine]\nGrape = Cabernet\nYear = 0x7d0\n"
+               "Color = red\n[Dessert]\nCake = 1\n");
+    fclose(f);
+    ini = example_load("bench.sch", &sc);
+    if(ini == NULL || iniparser_getnsec(ini) != 3 ||
+       sc.pizza.ham != 1 || sc.pizza.mushrooms != 0 ||
+       sc.pizza.capres != 1 || sc.wine.year != 2000 ||
+       sc.wine.grape == NULL || strcmp(sc.wine.grape, "Cabernet")) {
+        printf("schema values not converted\n");
+        exit(-1);
+    }
+    /* Missing keys keep their defaults, or 0 */
+    if(sc.pizza.cheese != 0 || sc.wine.country != NULL ||
+       sc.wine.alcohol != -1.0) {
+        printf("schema defaults not set\n");
+        exit(-1);
+    }
+    /* Unknown keys go to the dictionary, known ones do not */
+    if(iniparser_getint(ini, "pizza:olives", 0) != 12 ||
+       strcmp(iniparser_getstring(ini, "wine:color", ""), "red") ||
+       iniparser_getint(ini, "dessert:cake", 0) != 1 ||
+       iniparser_find_entry(ini, "pizza:ham") ||
+       iniparser_find_entry(ini, "wine:grape")) {
+        printf("unknown schema keys lost\n");
+        exit(-1);
+    }
+    iniparser_freedict(ini);
+    remove("bench.sch");
+
+    /* Unsigned 64-bit values, up to UINT64_MAX and no further */
+    {
+        int err;
+
+        ini = dictionary_new(0);
+        iniparser_set(ini, "n", NULL);
+        iniparser_set(ini, "n:max", "18446744073709551615");
+        iniparser_set(ini, "n:hex", "0xffffffffffffffff");
+        iniparser_set(ini, "n:above", "9223372036854775808");
+        iniparser_set(ini, "n:over", "18446744073709551616");
+        iniparser_set(ini, "n:neg", "-1");
+        iniparser_set(ini, "n:zero", "-0");
+        iniparser_set(ini, "n:bad", "12abc");
+        if(iniparser_getuint64(ini, "n:max", 0, &err) != UINT64_MAX || err ||
+           iniparser_getuint64(ini, "n:hex", 0, &err) != UINT64_MAX || err ||
+           iniparser_getuint64(ini, "n:above", 0, &err) !=
+           ((uint64_t)1 << 63) || err ||
+           iniparser_getint64(ini, "n:above", 0, &err) != INT64_MAX ||
+           err != ERANGE ||
+           iniparser_getuint64(ini, "n:zero", 1, &err) != 0 || err) {
+            printf("unsigned 64-bit value not converted\n");
+            exit(-1);
+        }
+        if(iniparser_getuint64(ini, "n:over", 0, &err) != UINT64_MAX ||
+           err != ERANGE ||
+           iniparser_getuint64(ini, "n:neg", 1, &err) != 0 || err != ERANGE ||
+           iniparser_getuint64(ini, "n:bad", 0, &err) != 12 || err != EINVAL ||
+           iniparser_getuint64(ini, "n:none", 42, &err) != 42 ||
+           err != ENOENT) {
+            printf("unsigned 64-bit error not reported\n");
+            exit(-1);
+        }
+        dictionary_del(ini);
+    }
+
+    t1 = epoch_double();
+    ini = iniparser_load_flags(ini_name, INI_LOAD_PRESIZE | INI_LOAD_MMAP |
+                                         INI_LOAD_ARENA);
+    stop_timer("Loading (all)", t1);
+    iniparser_freedict(ini);
+
+    /* Only the sections looked up are parsed */
+    t1 = epoch_double();
+    ini = iniparser_load_flags(ini_name, INI_LOAD_LAZY);
+    for(i = 0 ; i < 4 ; i++) {
+        if(iniparser_get(ini, secs + 12 * i, keys) == NULL) {
+            printf("missing key\n");
+            exit(-1);
+        }
+    }
+    stop_timer("Loading (lazy)", t1);
+
+    /* Pending sections are neither removed keys nor hidden by overlays */
+    sprintf(line, "%s:%s", secs + 12 * (BENCHSIZE - 1), keys + 12);
+    if(iniparser_getstring(ini, line, NULL) == NULL ||
+       iniparser_getint(ini, line, 0) != 1) {
+        printf("missing lazy key\n");
+        exit(-1);
+    }
+    copy = iniparser_overlay(ini);
+    sprintf(line, "%s:%s", secs + 12 * (BENCHSIZE - 2), keys + 12);
+    iniparser_set(copy, line, "3");
+    sprintf(line, "%s:%s", secs + 12 * (BENCHSIZE - 3), keys + 12);
+    iniparser_unset(copy, line);
+    if(copy == NULL ||
+       iniparser_getint(copy, line, 0) != 0 ||
+       iniparser_getint(ini, line, 0) != 1) {
+        printf("overlay of lazy sections failed\n");
+        exit(-1);
+    }
+    sprintf(line, "%s:%s", secs + 12 * (BENCHSIZE - 2), keys + 12);
+    if(iniparser_getint(copy, line, 0) != 3 ||
+       iniparser_getint(ini, line, 0) != 1) {
+        printf("overlay of lazy sections failed\n");
+        exit(-1);
+    }
+    sprintf(line, "%s:%s", secs + 12 * (BENCHSIZE - 4), keys);
+    if(iniparser_getint(copy, line, 0) != 1) {
+        printf("overlay of lazy sections failed\n");
+        exit(-1);
+    }
+    iniparser_freedict(copy);
+
+    /* A copy of the file with one key changed, then reloaded */
+    copy = iniparser_load(ini_name);
+    sprintf(line, "%s:%s", secs + 12 * (BENCHSIZE / 2), keys);
+    iniparser_set(copy, line, "2");
+    if(!(f = fopen("bench.new", "w"))) {
+        exit(-1);
+    }
+    iniparser_dump_ini(copy, f);
+    fclose(f);
+    t1 = epoch_double();
+    if(iniparser_reload(ini, "bench.new", NULL, NULL) != 1 ||
+       iniparser_getint(ini, line, 0) != 2) {
+        printf("reload failed\n");
+        exit(-1);
+    }
+    stop_timer("Reloading", t1);
+
+    /* Versions replaced again and again are not all kept mapped, but */
+    /* unchanged values stay where they are */
+    sprintf(name, "%s:%s", secs, keys);
+    dump = iniparser_getstring(ini, name, NULL);
+    for(i = 0 ; i < 8 ; i++) {
+        iniparser_set(copy, line, i % 2 ? "2" : "3");
+        if(!(f = fopen("bench.tmp", "w"))) {
+            exit(-1);
+        }
+        iniparser_dump_ini(copy, f);
+        fclose(f);
+        rename("bench.tmp", "bench.new");
+        if(iniparser_reload(ini, "bench.new", NULL, NULL) != 1) {
+            printf("reload failed\n");
+            exit(-1);
+        }
+    }
+    if(bench_mapped("bench.new") > 1 ||
+       iniparser_getstring(ini, name, NULL) != dump || strcmp(dump, "1")) {
+        printf("stale versions kept\n");
+        exit(-1);
+    }
+    iniparser_freedict(copy);
+    iniparser_freedict(ini);
+    remove("bench.new");
+
+    /* Blank lines between sections, some after a continued line */
+    if(!(f = fopen("bench.par", "w"))) {
+        exit(-1);
+    }
+    for(i = 0 ; i < BENCHSIZE ; i++) {
+        fprintf(f, "\n[%s]\n", secs + 12 * i);
+        for(j = 0 ; j < BENCHSIZE ; j++) {
+            fprintf(f, "%s = %08x%08x%08x%08x\n", keys + 12 * j, i, j, i, j);
+        }
+        if(i % 4 == 0) {
+            fprintf(f, "cont = %d \\\n\n", i);
+        }
+    }
+    size = (size_t)ftell(f);
+    fclose(f);
+    iniparser_stats(&st);
+    chunks = st.chunks;
+    copy = iniparser_load_parallel("bench.par", BENCHTHREADS);
+    if(iniparser_stats(&st) == 0 && size >= 2 << 20 &&
+       st.chunks - chunks < 2) {
+        printf("file not loaded in chunks\n");
+        exit(-1);
+    }
+    ini = iniparser_load("bench.par");
+    if(bench_same(copy, ini)) {
+        printf("chunks loaded differently\n");
+        exit(-1);
+    }
+    iniparser_freedict(copy);
+    /* Asynchronous loads, with the io_uring and with the thread */
+    ways[0] = "io_uring";
+    ways[1] = "thread";
+    for(i = 0 ; i < 2 ; i++) {
+        if(iniparser_readahead_select(ways[i]))
+            continue;
+        copy = bench_async("bench.par");
+        if(bench_same(copy, ini)) {
+            printf("loaded differently through %s\n", ways[i]);
+            exit(-1);
+        }
+        iniparser_freedict(copy);
+    }
+    iniparser_readahead_select(NULL);
+    iniparser_freedict(ini);
+    remove("bench.par");
+
+    t1 = epoch_double();
+    ini = iniparser_load_parallel(ini_name, BENCHTHREADS);
+    stop_timer("Loading (threads)", t1);
+
+    t1 = epoch_double();
+    iniparser_save_binary(ini, "bench.bin", ini_name);
+    stop_timer("Saving (binary)", t1);
+    iniparser_freedict(ini);
+
+    t1 = epoch_double();
+    ini = iniparser_load_binary("bench.bin", ini_name);
+    stop_timer("Loading (binary)", t1);
+    if(ini == NULL || ini->map == NULL ||
+       bench_stress(ini, NULL, ini_name, secs, keys, 0)) {
+        printf("binary image not loaded\n");
+        exit(-1);
+    }
+    /* Strings of the image are neither freed nor moved when changed */
+    {
+        char buffer[64];
+
+        sprintf(buffer, "%s:%s", secs, keys);
+        iniparser_set(ini, buffer, "changed");
+        sprintf(buffer, "%s:%s", secs, keys + 12);
+        iniparser_unset(ini, buffer);
+        sprintf(buffer, "%s:added", secs);
+        iniparser_set(ini, buffer, "added");
+        if(strcmp(iniparser_getstring(ini, buffer, ""), "added")) {
+            printf("binary image not modified\n");
+            exit(-1);
+        }
+        sprintf(buffer, "%s:%s", secs, keys);
+        if(strcmp(iniparser_getstring(ini, buffer, ""), "changed")) {
+            printf("binary image not modified\n");
+            exit(-1);
+        }
+        sprintf(buffer, "%s:%s", secs, keys + 12);
+        if(iniparser_find_entry(ini, buffer)) {
+            printf("binary image not modified\n");
+            exit(-1);
+        }
+        sprintf(buffer, "%s:%s", secs + 12, keys + 12);
+        if(iniparser_getint(ini, buffer, 0) != 1) {
+            printf("binary image not modified\n");
+            exit(-1);
+        }
+    }
+    iniparser_freedict(ini);
+    remove("bench.bin");
+
+    /* Keys counted from small reads, without building a dictionary */
+    if(!(f = fopen(ini_name, "r"))) {
+        exit(-1);
+    }
+    t1 = epoch_double();
+    {
+        ini_handler  h = { NULL, bench_value, NULL };
+        ini_parser * p = iniparser_parser_new(&h, &j);
+        char         chunk[4096];
+        size_t       n;
+
+        j = 0;
+        while((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+            iniparser_parser_feed(p, chunk, n);
+        iniparser_parser_end(p);
+        iniparser_parser_free(p);
+    }
+    stop_timer("Streaming", t1);
+    fclose(f);
+    if(j != BENCHSIZE * BENCHSIZE) {
+        printf("%d keys streamed\n", j);
+        exit(-1);
+    }
+
+    /* Same work on one thread, then on BENCHTHREADS */
+    for(i = 0 ; i < 2 ; i++) {
+        t1 = epoch_double();
+        j = bench_stress(NULL, NULL, ini_name, secs, keys, i);
+        sprintf(name, "Stress load (%d)", i ? BENCHTHREADS : 1);
+        stop_timer(name, t1);
+        if(j) {
+            printf("%d wrong lookups\n", j);
+            exit(-1);
+        }
+    }
+    ini = iniparser_load(ini_name);
+    for(i = 0 ; i < 2 ; i++) {
+        t1 = epoch_double();
+        j = bench_stress(ini, NULL, ini_name, secs, keys, i);
+        sprintf(name, "Stress get (%d)", i ? BENCHTHREADS : 1);
+        stop_timer(name, t1);
+        if(j) {
+            printf("%d wrong lookups\n", j);
+            exit(-1);
+        }
+    }
+
+    /* Shared configuration, reloaded while threads read it */
+    conf = iniparser_config_new(ini, BENCHTHREADS);
+    for(i = 0 ; i < 2 ; i++) {
+        t1 = epoch_double();
+        j = bench_stress(NULL, conf, ini_name, secs, keys, i);
+        sprintf(name, "Stress conf (%d)", i ? BENCHTHREADS : 1);
+        stop_timer(name, t1);
+        if(j) {
+            printf("%d wrong lookups\n", j);
+            exit(-1);
+        }
+    }
+    iniparser_config_free(conf);
+
+    /* Same grid with quoted values and comments on every line */
+    if(!(f = fopen(ini_name, "w"))) {
+        exit(-1);
+    }
+    for(i = 0 ; i < BENCHSIZE ; i++) {
+        fprintf(f, "[%s]\n", secs + 12 * i);
+        for(j = 0 ; j < BENCHSIZE ; j++) {
+            fprintf(f, "%s = \"%d\" ; comment\n", keys + 12 * j, j);
+        }
+    }
+    fclose(f);
+
+    t1 = epoch_double();
+    ini = iniparser_load(ini_name);
+    stop_timer("Loading (quoted)", t1);
+
     dictionary_del(ini);
 
+    /* Multi-megabyte values, on one line and over many lines */
+    memset(line, 'x', 64);
+    line[64] = 0;
+    if(!(f = fopen(ini_name, "w"))) {
+        exit(-1);
+    }
+    fprintf(f, "[long]\nblob = ");
+    for(i = 0 ; i < (1 << 22) / 64 ; i++) {
+        fputs(line, f);
+    }
+    fprintf(f, "\ncert = \\\n");
+    for(i = 0 ; i < (1 << 21) / 64 ; i++) {
+        fprintf(f, "%s\\\n", line);
+    }
+    fprintf(f, "end\n");
+    fclose(f);
+
+    for(i = 0 ; i < 2 ; i++) {
+        t1 = epoch_double();
+        ini = i ? iniparser_load_mmap(ini_name) : iniparser_load(ini_name);
+        stop_timer(i ? "Mapping (long)" : "Loading (long)", t1);
+        if(strlen(iniparser_getstring(ini, "long:blob", "")) != 1 << 22 ||
+           strlen(iniparser_getstring(ini, "long:cert", "")) != (1 << 21) + 3) {
+            printf("long values truncated\n");
+            exit(-1);
+        }
+        iniparser_freedict(ini);
+    }
+
+    /* Counters of the whole run, if the library keeps them */
+    if(iniparser_stats(&st) == 0) {
+        printf("\n");
+        iniparser_dump_stats(&st, stdout);
+    }
+
 	return 0 ;
 }
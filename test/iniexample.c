@@ -4,9 +4,11 @@
 #include <unistd.h>
 
 #include "iniparser.h"
+#include "example.h"
 
 void create_example_ini_file(void);
 int  parse_ini_file(char * ini_name);
+int  parse_ini_schema(char * ini_name);
 
 int main(int argc, char * argv[])
 {
@@ -15,6 +17,9 @@ int main(int argc, char * argv[])
     if (argc<2) {
         create_example_ini_file();
         status = parse_ini_file("example.ini");
+        if (status == 0) {
+            status = parse_ini_schema("example.ini");
+        }
     } else {
         status = parse_ini_file(argv[1]);
     }
@@ -97,4 +102,32 @@ int parse_ini_file(char * ini_name)
     return 0 ;
 }
 
+/* Same as parse_ini_file(), with the structure inigen generated from */
+/* example-schema.ini */
+int parse_ini_schema(char * ini_name)
+{
+    dictionary  *   ini ;
+    example         c ;
+
+    ini = example_load(ini_name, &c);
+    if (ini==NULL) {
+        fprintf(stderr, "cannot parse file: %s\n", ini_name);
+        return -1 ;
+    }
+
+    printf("Pizza (schema):\n");
+    printf("Ham:       [%d]\n", c.pizza.ham);
+    printf("Mushrooms: [%d]\n", c.pizza.mushrooms);
+    printf("Capres:    [%d]\n", c.pizza.capres);
+    printf("Cheese:    [%d]\n", c.pizza.cheese);
+
+    printf("Wine (schema):\n");
+    printf("Grape:     [%s]\n", c.wine.grape ? c.wine.grape : "UNDEF");
+    printf("Year:      [%d]\n", c.wine.year);
+    printf("Country:   [%s]\n", c.wine.country ? c.wine.country : "UNDEF");
+    printf("Alcohol:   [%g]\n", c.wine.alcohol);
+
+    iniparser_freedict(ini);
+    return 0 ;
+}
 
@@ -0,0 +1,513 @@
+/*
+ * Benchmark suite: ini files of different shapes, each loaded and
+ * looked up over several runs. Every case reports the median and the
+ * best time per operation, the input throughput of loads, the memory
+ * allocations of a run and the peak resident set size.
+ *
+ * usage: perf [-r runs] [-o text|csv|json] [workload ...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "iniparser.h"
+
+#define PERF_RUNS       5
+#define PERF_MAXRUNS    101
+
+/* Lookup cases repeat over the keys for at least this many operations */
+#define PERF_MINOPS     400000L
+
+/* List of "section:key" strings */
+typedef struct {
+    char   ** v;
+    int       n;
+    int       sz;
+} perf_keys;
+
+/* Workload: an ini file and the keys it holds */
+typedef struct {
+    const char * name;
+    void      (* gen)(FILE * f, perf_keys * hits, perf_keys * misses);
+} perf_workload;
+
+/* State of the cases of a workload */
+typedef struct {
+    char       * file;      /* Generated ini file */
+    long         size;      /* Size of file in bytes */
+    perf_keys    hits;      /* Keys of the file */
+    perf_keys    misses;    /* Keys that are not in the file */
+    dictionary * d;         /* Dictionary of the lookup cases */
+    dictionary * tmp;       /* Dictionary loaded by a run */
+} perf_input;
+
+/* Case: run() returns the number of operations it did */
+typedef struct {
+    const char * name;
+    long      (* run)(perf_input * in, int flags);
+    int          flags;     /* Load flags passed to run() */
+    int          load;      /* Non-zero to report file throughput */
+} perf_case;
+
+/* Result of a case */
+typedef struct {
+    double       median;    /* Median ns per operation */
+    double       best;      /* Best ns per operation */
+    double       mbs;       /* MB/s of input at the median, or 0 */
+    double       allocs;    /* Allocations per run */
+    long         rss;       /* Peak resident set size in kB, or -1 */
+} perf_result;
+
+/*
+ * Allocations are counted by wrapping the allocator of the C library,
+ * which is only possible with glibc: elsewhere they are reported as -1.
+ */
+#if defined(__GLIBC__)
+extern void * __libc_malloc(size_t n);
+extern void * __libc_calloc(size_t n, size_t m);
+extern void * __libc_realloc(void * p, size_t n);
+extern void   __libc_free(void * p);
+
+static unsigned long perf_allocs;
+
+/* Threaded and asynchronous loads allocate from several threads */
+#define perf_count()    ((void)__atomic_fetch_add(&perf_allocs, 1, \
+                                                  __ATOMIC_RELAXED))
+
+void * malloc(size_t n)
+{
+    perf_count();
+    return __libc_malloc(n);
+}
+
+void * calloc(size_t n, size_t m)
+{
+    perf_count();
+    return __libc_calloc(n, m);
+}
+
+void * realloc(void * p, size_t n)
+{
+    perf_count();
+    return __libc_realloc(p, n);
+}
+
+void free(void * p)
+{
+    __libc_free(p);
+}
+
+#define perf_counting 1
+#else
+static unsigned long perf_allocs;
+#define perf_counting 0
+#endif
+
+double perf_now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/* Resets the peak resident set size, returns 0 if Ok */
+int perf_rss_reset()
+{
+    FILE * f = fopen("/proc/self/clear_refs", "w");
+    int    ok;
+
+    if(f == NULL)
+        return -1;
+    ok = fputs("5", f) >= 0;
+    return (fclose(f) == 0 && ok) ? 0 : -1;
+}
+
+/* Returns the peak resident set size in kB since the last reset, or */
+/* since the start of the process if it cannot be reset */
+long perf_rss_peak()
+{
+    struct rusage u;
+    FILE        * f = fopen("/proc/self/status", "r");
+    char          line[128];
+    long          kb = -1;
+
+    while(f != NULL && fgets(line, sizeof(line), f) != NULL) {
+        if(!strncmp(line, "VmHWM:", 6)) {
+            kb = atol(line + 6);
+            break;
+        }
+    }
+    if(f != NULL)
+        fclose(f);
+    if(kb < 0 && getrusage(RUSAGE_SELF, &u) == 0)
+        kb = u.ru_maxrss;
+    return kb;
+}
+
+void perf_add(perf_keys * k, const char * fmt, int a, int b)
+{
+    char buf[64];
+
+    if(k->n == k->sz) {
+        k->sz = k->sz ? 2 * k->sz : 1024;
+        k->v = realloc(k->v, k->sz * sizeof(char *));
+        if(k->v == NULL)
+            exit(-1);
+    }
+    sprintf(buf, fmt, a, b);
+    if((k->v[k->n++] = strdup(buf)) == NULL)
+        exit(-1);
+}
+
+void perf_clear(perf_keys * k)
+{
+    int i;
+
+    for(i = 0 ; i < k->n ; i++)
+        free(k->v[i]);
+    free(k->v);
+    memset(k, 0, sizeof(*k));
+}
+
+/* Many sections of one key, as in host inventories */
+void gen_tiny(FILE * f, perf_keys * hits, perf_keys * misses)
+{
+    int i;
+
+    for(i = 0 ; i < 20000 ; i++) {
+        fprintf(f, "[host%05d]\naddr = 10.%d.%d.1\n", i, i / 256, i % 256);
+        perf_add(hits, "host%05d:addr", i, 0);
+        perf_add(misses, i % 2 ? "host%05d:port" : "nohost%05d:addr", i, 0);
+    }
+}
+
+/* A few sections of many keys */
+void gen_huge(FILE * f, perf_keys * hits, perf_keys * misses)
+{
+    int i, j;
+
+    for(i = 0 ; i < 4 ; i++) {
+        fprintf(f, "[table%d]\n", i);
+        for(j = 0 ; j < 25000 ; j++) {
+            fprintf(f, "entry%06d = %d\n", j, i * j);
+            perf_add(hits, "table%d:entry%06d", i, j);
+            perf_add(misses, "table%d:missing%06d", i, j);
+        }
+    }
+}
+
+/* Values of a few kilobytes */
+void gen_long(FILE * f, perf_keys * hits, perf_keys * misses)
+{
+    int i, j;
+
+    for(i = 0 ; i < 2000 ; i++) {
+        if(i % 100 == 0)
+            fprintf(f, "[blob%d]\n", i / 100);
+        fprintf(f, "data%04d = ", i);
+        for(j = 0 ; j < 4096 ; j++)
+            fputc('a' + (i + j) % 26, f);
+        fputc('\n', f);
+        perf_add(hits, "blob%d:data%04d", i / 100, i);
+        perf_add(misses, "blob%d:nodata%04d", i / 100, i);
+    }
+}
+
+/* Values continued over several lines */
+void gen_multiline(FILE * f, perf_keys * hits, perf_keys * misses)
+{
+    int i;
+
+    for(i = 0 ; i < 10000 ; i++) {
+        if(i % 50 == 0)
+            fprintf(f, "[text%d]\n", i / 50);
+        fprintf(f, "para%05d = first part of the value \\\n"
+                   "    goes on in a second line \\\n"
+                   "    then a third one \\\n"
+                   "    and ends here\n", i);
+        perf_add(hits, "text%d:para%05d", i / 50, i);
+        perf_add(misses, "text%d:line%05d", i / 50, i);
+    }
+}
+
+/* Files that are mostly comments and blank lines */
+void gen_comments(FILE * f, perf_keys * hits, perf_keys * misses)
+{
+    int i, j;
+
+    for(i = 0 ; i < 10000 ; i++) {
+        if(i % 100 == 0)
+            fprintf(f, "\n# Section %d\n[part%d]\n", i / 100, i / 100);
+        for(j = 0 ; j < 6 ; j++)
+            fprintf(f, j % 2 ? "; comment line %d of the key below\n"
+                             : "# another comment, %d\n", j);
+        fprintf(f, "\nopt%05d = %d ; trailing comment\n", i, i);
+        perf_add(hits, "part%d:opt%05d", i / 100, i);
+        perf_add(misses, "part%d:noopt%05d", i / 100, i);
+    }
+}
+
+static const perf_workload workloads[] = {
+    { "tiny", gen_tiny },
+    { "huge", gen_huge },
+    { "long", gen_long },
+    { "multiline", gen_multiline },
+    { "comments", gen_comments }
+};
+
+long run_load(perf_input * in, int flags)
+{
+    if((in->tmp = iniparser_load_flags(in->file, flags)) == NULL)
+        exit(-1);
+    return in->hits.n;
+}
+
+/* Completion of an asynchronous load */
+typedef struct {
+    pthread_mutex_t   lock;
+    pthread_cond_t    cond;
+    dictionary      * d;
+    int               done;
+} perf_async;
+
+void async_done(void * ctx, dictionary * d)
+{
+    perf_async * a = ctx;
+
+    pthread_mutex_lock(&a->lock);
+    a->d = d;
+    a->done = 1;
+    pthread_cond_signal(&a->cond);
+    pthread_mutex_unlock(&a->lock);
+}
+
+/* Waits for the load, which includes starting its thread */
+long run_load_async(perf_input * in, int flags)
+{
+    perf_async a;
+
+    pthread_mutex_init(&a.lock, NULL);
+    pthread_cond_init(&a.cond, NULL);
+    a.done = 0;
+    if(iniparser_load_async(in->file, flags, async_done, &a) != 0)
+        exit(-1);
+    pthread_mutex_lock(&a.lock);
+    while(!a.done)
+        pthread_cond_wait(&a.cond, &a.lock);
+    pthread_mutex_unlock(&a.lock);
+    pthread_cond_destroy(&a.cond);
+    pthread_mutex_destroy(&a.lock);
+    if((in->tmp = a.d) == NULL)
+        exit(-1);
+    return in->hits.n;
+}
+
+/* Number of passes over n keys for a lookup case */
+#define perf_passes(n)  ((n) < PERF_MINOPS ? (int)(PERF_MINOPS / (n)) : 1)
+
+long run_hit(perf_input * in, int flags)
+{
+    int i, p, passes = perf_passes(in->hits.n);
+
+    (void)flags;
+    for(p = 0 ; p < passes ; p++) {
+        for(i = 0 ; i < in->hits.n ; i++) {
+            if(iniparser_getstring(in->d, in->hits.v[i], NULL) == NULL) {
+                printf("missing key %s\n", in->hits.v[i]);
+                exit(-1);
+            }
+        }
+    }
+    return (long)passes * in->hits.n;
+}
+
+long run_miss(perf_input * in, int flags)
+{
+    int i, p, passes = perf_passes(in->misses.n);
+
+    (void)flags;
+    for(p = 0 ; p < passes ; p++) {
+        for(i = 0 ; i < in->misses.n ; i++) {
+            if(iniparser_getstring(in->d, in->misses.v[i], NULL) != NULL) {
+                printf("unexpected key %s\n", in->misses.v[i]);
+                exit(-1);
+            }
+        }
+    }
+    return (long)passes * in->misses.n;
+}
+
+/* Every key is removed, then set again */
+long run_churn(perf_input * in, int flags)
+{
+    int i;
+
+    (void)flags;
+    for(i = 0 ; i < in->hits.n ; i++) {
+        iniparser_unset(in->d, in->hits.v[i]);
+        if(iniparser_set(in->d, in->hits.v[i], "churned") != 0)
+            exit(-1);
+    }
+    return 2L * in->hits.n;
+}
+
+static const perf_case cases[] = {
+    { "load", run_load, 0, 1 },
+    { "load-mmap", run_load, INI_LOAD_MMAP, 1 },
+    { "load-arena", run_load, INI_LOAD_ARENA, 1 },
+    { "load-flat", run_load, INI_LOAD_FLAT, 1 },
+    { "load-async", run_load_async, 0, 1 },
+    { "hit", run_hit, 0, 0 },
+    { "miss", run_miss, 0, 0 },
+    { "hit-flat", run_hit, INI_LOAD_FLAT, 0 },
+    { "miss-flat", run_miss, INI_LOAD_FLAT, 0 },
+    { "churn", run_churn, 0, 0 }
+};
+
+#define NWORKLOADS  (int)(sizeof(workloads) / sizeof(workloads[0]))
+#define NCASES      (int)(sizeof(cases) / sizeof(cases[0]))
+
+int cmp_double(const void * a, const void * b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Runs a case once to warm up, then runs times */
+void perf_measure(perf_input * in, const perf_case * c, int runs,
+                  perf_result * res)
+{
+    double        ns[PERF_MAXRUNS], t;
+    unsigned long allocs = 0, a;
+    long          ops;
+    int           r, reset;
+
+    if(!c->load) {
+        if((in->d = iniparser_load_flags(in->file, c->flags)) == NULL)
+            exit(-1);
+    }
+    reset = perf_rss_reset();
+    for(r = -1 ; r < runs ; r++) {
+        a = __atomic_load_n(&perf_allocs, __ATOMIC_RELAXED);
+        t = perf_now();
+        ops = c->run(in, c->flags);
+        t = perf_now() - t;
+        a = __atomic_load_n(&perf_allocs, __ATOMIC_RELAXED) - a;
+        if(in->tmp != NULL) {
+            iniparser_freedict(in->tmp);
+            in->tmp = NULL;
+        }
+        if(r >= 0) {
+            ns[r] = t / ops;
+            allocs += a;
+        }
+    }
+    qsort(ns, runs, sizeof(double), cmp_double);
+    res->median = runs % 2 ? ns[runs / 2]
+                           : (ns[runs / 2 - 1] + ns[runs / 2]) / 2;
+    res->best = ns[0];
+    res->mbs = c->load ? in->size / (res->median * in->hits.n) * 1e3 : 0;
+    res->allocs = perf_counting ? (double)allocs / runs : -1;
+    res->rss = reset == 0 ? perf_rss_peak() : -1;
+    if(in->d != NULL) {
+        iniparser_freedict(in->d);
+        in->d = NULL;
+    }
+}
+
+void perf_print(const char * fmt, const char * work, const char * name,
+                perf_result * res, int first)
+{
+    if(!strcmp(fmt, "csv")) {
+        if(first)
+            printf("workload,case,ns_per_op,best_ns_per_op,mb_per_s,"
+                   "allocs_per_run,peak_rss_kb\n");
+        printf("%s,%s,%.1f,%.1f,%.1f,%.0f,%ld\n", work, name, res->median,
+               res->best, res->mbs, res->allocs, res->rss);
+    } else if(!strcmp(fmt, "json")) {
+        printf("%s    {\"workload\": \"%s\", \"case\": \"%s\", "
+               "\"ns_per_op\": %.1f, \"best_ns_per_op\": %.1f, "
+               "\"mb_per_s\": %.1f, \"allocs_per_run\": %.0f, "
+               "\"peak_rss_kb\": %ld}", first ? "" : ",\n", work, name,
+               res->median, res->best, res->mbs, res->allocs, res->rss);
+    } else {
+        if(first)
+            printf("%-10s %-10s %10s %10s %8s %12s %10s\n", "workload",
+                   "case", "ns/op", "best", "MB/s", "allocs/run",
+                   "peak kB");
+        printf("%-10s %-10s %10.1f %10.1f %8.1f %12.0f %10ld\n", work, name,
+               res->median, res->best, res->mbs, res->allocs, res->rss);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char * argv[])
+{
+    perf_input   in;
+    perf_result  res;
+    const char * fmt = "text";
+    int          runs = PERF_RUNS, i, j, c, first = 1, selected;
+    FILE       * f;
+
+    while((c = getopt(argc, argv, "r:o:")) != -1) {
+        switch(c) {
+        case 'r':
+            runs = atoi(optarg);
+            break;
+        case 'o':
+            fmt = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r runs] [-o text|csv|json] "
+                            "[workload ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(runs < 1 || runs > PERF_MAXRUNS) {
+        fprintf(stderr, "perf: runs must be between 1 and %d\n",
+                PERF_MAXRUNS);
+        return 1;
+    }
+
+    for(j = optind ; j < argc ; j++) {
+        for(i = 0 ; i < NWORKLOADS && strcmp(argv[j], workloads[i].name) ; i++)
+            ;
+        if(i == NWORKLOADS) {
+            fprintf(stderr, "perf: unknown workload %s\n", argv[j]);
+            return 1;
+        }
+    }
+
+    if(!strcmp(fmt, "json"))
+        printf("{\"runs\": %d, \"results\": [\n", runs);
+    memset(&in, 0, sizeof(in));
+    in.file = "perf.ini";
+    for(i = 0 ; i < NWORKLOADS ; i++) {
+        selected = optind == argc;
+        for(j = optind ; j < argc ; j++)
+            selected |= !strcmp(argv[j], workloads[i].name);
+        if(!selected)
+            continue;
+
+        if((f = fopen(in.file, "w")) == NULL)
+            return 1;
+        workloads[i].gen(f, &in.hits, &in.misses);
+        in.size = ftell(f);
+        fclose(f);
+        for(j = 0 ; j < NCASES ; j++) {
+            perf_measure(&in, &cases[j], runs, &res);
+            perf_print(fmt, workloads[i].name, cases[j].name, &res, first);
+            first = 0;
+        }
+        perf_clear(&in.hits);
+        perf_clear(&in.misses);
+        unlink(in.file);
+    }
+    if(!strcmp(fmt, "json"))
+        printf("\n]}\n");
+    return 0;
+}
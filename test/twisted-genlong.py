@@ -0,0 +1,17 @@
+# -*- coding: utf-8 -*-
+import os
+import sys
+
+if __name__=="__main__":
+    f=open('twisted-long.ini', 'w')
+    f.write('[long]\n')
+    # 4 MB value on a single line
+    f.write('blob=%s\n' % ('QUJDRA==' * (1 << 19)))
+    # 2 MB value over 76 character lines
+    f.write('cert=\\\n')
+    for i in range(1 << 15):
+        f.write('%s\\\n' % ('TUlJQ' * 13)[:64])
+    f.write('END\n')
+    # 1 MB key
+    f.write('%s=1\n' % ('k' * (1 << 20)))
+    f.close()